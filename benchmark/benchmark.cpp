@@ -66,8 +66,8 @@ void BenchmarkClient::on_started()
 	start_benchmark();
 }
 
-BenchmarkServer::BenchmarkServer(const ServerFactory& factory)
-	: _server(factory(*this))
+BenchmarkServer::BenchmarkServer(const ServerFactory& factory, const ynet::Server::Options& options)
+	: _server(factory(*this, options))
 {
 	std::unique_lock<std::mutex> lock(_mutex);
 	_server_started_condition.wait(lock, [this]{ return _server_started; });
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 
 #include <ynet.h>
 
 using ClientFactory = std::function<std::unique_ptr<ynet::Client>(ynet::Client::Callbacks&, const ynet::Client::Options&)>;
-using ServerFactory = std::function<std::unique_ptr<ynet::Server>(ynet::Server::Callbacks&)>;
+using ServerFactory = std::function<std::unique_ptr<ynet::Server>(ynet::Server::Callbacks&, const ynet::Server::Options&)>;
 
 struct BenchmarkLocal
 {
@@ -15,9 +16,41 @@ struct BenchmarkLocal
 		return ynet::Client::create_local(callbacks, "ynet-benchmark", options);
 	}
 
-	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks)
+	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks, const ynet::Server::Options& options)
 	{
-		return ynet::Server::create_local(callbacks, "ynet-benchmark");
+		return ynet::Server::create_local(callbacks, "ynet-benchmark", options);
+	}
+};
+
+// Local connections transferring the data through shared memory.
+struct BenchmarkLocalShm
+{
+	static std::unique_ptr<ynet::Client> create_client(ynet::Client::Callbacks& callbacks, const ynet::Client::Options& options)
+	{
+		auto shm_options = options;
+		shm_options.socket.shared_memory_size = 1 << 20;
+		return BenchmarkLocal::create_client(callbacks, shm_options);
+	}
+
+	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks, const ynet::Server::Options& options)
+	{
+		auto shm_options = options;
+		shm_options.socket.shared_memory_size = 1 << 20;
+		return BenchmarkLocal::create_server(callbacks, shm_options);
+	}
+};
+
+// In-process connections, which measure the library overhead without the system calls.
+struct BenchmarkInprocess
+{
+	static std::unique_ptr<ynet::Client> create_client(ynet::Client::Callbacks& callbacks, const ynet::Client::Options& options)
+	{
+		return ynet::Client::create_inprocess(callbacks, "ynet-benchmark", options);
+	}
+
+	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks, const ynet::Server::Options& options)
+	{
+		return ynet::Server::create_inprocess(callbacks, "ynet-benchmark", options);
 	}
 };
 
@@ -28,9 +61,25 @@ struct BenchmarkTcp
 		return ynet::Client::create_tcp(callbacks, "localhost", 5445, options);
 	}
 
-	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks)
+	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks, const ynet::Server::Options& options)
+	{
+		return ynet::Server::create_tcp(callbacks, 5445, options);
+	}
+};
+
+// TCP with the io_uring server backend (if supported by the kernel).
+struct BenchmarkTcpUring
+{
+	static std::unique_ptr<ynet::Client> create_client(ynet::Client::Callbacks& callbacks, const ynet::Client::Options& options)
+	{
+		return BenchmarkTcp::create_client(callbacks, options);
+	}
+
+	static std::unique_ptr<ynet::Server> create_server(ynet::Server::Callbacks& callbacks, const ynet::Server::Options& options)
 	{
-		return ynet::Server::create_tcp(callbacks, 5445);
+		auto uring_options = options;
+		uring_options.io_uring = true;
+		return BenchmarkTcp::create_server(callbacks, uring_options);
 	}
 };
 
@@ -67,7 +116,7 @@ private:
 class BenchmarkServer : public ynet::Server::Callbacks
 {
 public:
-	BenchmarkServer(const ServerFactory&);
+	BenchmarkServer(const ServerFactory&, const ynet::Server::Options& = {});
 
 protected:
 	void stop();
@@ -0,0 +1,93 @@
+#include "chatty.h"
+
+namespace
+{
+	ynet::Server::Options make_server_options(bool batch, int shutdown_timeout)
+	{
+		ynet::Server::Options options;
+		options.shutdown_timeout = shutdown_timeout;
+		options.nonblocking_send = true;
+		options.batch_received = batch;
+		options.listen_backlog = 4096;
+		return options;
+	}
+}
+
+ChattyClients::ChattyClients(const ClientFactory& factory, size_t count, size_t message_size, ynet::ClientContext& context)
+	: _message(message_size)
+{
+	ynet::Client::Options client_options;
+	client_options.context = &context;
+	client_options.nonblocking_send = true;
+	_clients.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		_clients.emplace_back(factory(*this, client_options));
+	std::unique_lock<std::mutex> lock(_mutex);
+	_connected_condition.wait(lock, [this, count]{ return _connected == count; });
+}
+
+ChattyClients::~ChattyClients()
+{
+	_clients.clear();
+}
+
+void ChattyClients::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	connection->send(_message.data(), _message.size());
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_connected;
+	}
+	_connected_condition.notify_one();
+}
+
+void ChattyClients::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	connection->send(data, size);
+	_marks.fetch_add(1, std::memory_order_relaxed);
+	_bytes.fetch_add(size * 2, std::memory_order_relaxed);
+}
+
+void ChattyClients::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+}
+
+void ChattyClients::on_failed_to_connect(int& reconnect_timeout)
+{
+	reconnect_timeout = 100;
+}
+
+ChattyServer::ChattyServer(const ServerFactory& factory, bool batch, int shutdown_timeout)
+	: BenchmarkServer(factory, make_server_options(batch, shutdown_timeout))
+{
+}
+
+void ChattyServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void ChattyServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_messages;
+		_bytes += size;
+	}
+	connection->send(data, size);
+}
+
+void ChattyServer::on_received_batch(const ynet::Server::Received* received, size_t count)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (size_t i = 0; i < count; ++i)
+			_bytes += received[i].size;
+		_messages += count;
+	}
+	for (size_t i = 0; i < count; ++i)
+		received[i].connection->send(received[i].data, received[i].size);
+}
+
+void ChattyServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
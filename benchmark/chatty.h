@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "benchmark.h"
+
+// A set of clients which keep sending small messages, echoing the data they receive back to the server.
+class ChattyClients : public ynet::Client::Callbacks
+{
+public:
+	ChattyClients(const ClientFactory&, size_t count, size_t message_size, ynet::ClientContext&);
+	~ChattyClients() override;
+
+	uint64_t bytes() const { return _bytes; }
+	uint64_t marks() const { return _marks; }
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+	void on_failed_to_connect(int&) override;
+
+private:
+	const std::vector<uint8_t> _message;
+	std::atomic<uint64_t> _marks{0};
+	std::atomic<uint64_t> _bytes{0};
+	std::mutex _mutex;
+	size_t _connected = 0;
+	std::condition_variable _connected_condition;
+	std::vector<std::unique_ptr<ynet::Client>> _clients;
+};
+
+// Echoes the received data, accounting it in state shared by all connections.
+class ChattyServer : public BenchmarkServer
+{
+public:
+	// The server accounts the data received during each event loop iteration at once if 'batch' is true.
+	ChattyServer(const ServerFactory&, bool batch, int shutdown_timeout = 0);
+	~ChattyServer() override { stop(); }
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_received_batch(const ynet::Server::Received*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	std::mutex _mutex;
+	uint64_t _messages = 0;
+	uint64_t _bytes = 0;
+};
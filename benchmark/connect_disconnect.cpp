@@ -2,16 +2,17 @@
 
 namespace
 {
-	const auto client_options = []
+	ynet::Client::Options make_client_options(ynet::Resolver* resolver)
 	{
 		ynet::Client::Options options;
 		options.shutdown_timeout = -1;
+		options.resolver = resolver;
 		return options;
-	}();
+	}
 }
 
-ConnectDisconnectClient::ConnectDisconnectClient(const ClientFactory& factory, int64_t seconds)
-	: BenchmarkClient(factory, client_options, seconds)
+ConnectDisconnectClient::ConnectDisconnectClient(const ClientFactory& factory, int64_t seconds, ynet::Resolver* resolver)
+	: BenchmarkClient(factory, make_client_options(resolver), seconds)
 {
 }
 
@@ -36,8 +37,8 @@ void ConnectDisconnectClient::on_failed_to_connect(int&)
 	discard_benchmark();
 }
 
-ConnectDisconnectServer::ConnectDisconnectServer(const ServerFactory& factory)
-	: BenchmarkServer(factory)
+ConnectDisconnectServer::ConnectDisconnectServer(const ServerFactory& factory, const ynet::Server::Options& options)
+	: BenchmarkServer(factory, options)
 {
 }
 
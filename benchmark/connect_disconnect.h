@@ -5,7 +5,7 @@
 class ConnectDisconnectClient : public BenchmarkClient
 {
 public:
-	ConnectDisconnectClient(const ClientFactory&, int64_t seconds);
+	ConnectDisconnectClient(const ClientFactory&, int64_t seconds, ynet::Resolver* = nullptr);
 
 	const unsigned marks() const { return _marks; }
 
@@ -22,7 +22,7 @@ private:
 class ConnectDisconnectServer : public BenchmarkServer
 {
 public:
-	ConnectDisconnectServer(const ServerFactory&);
+	ConnectDisconnectServer(const ServerFactory&, const ynet::Server::Options& = {});
 	~ConnectDisconnectServer() override { stop(); }
 
 private:
@@ -1,17 +1,84 @@
 #include "exchange.h"
 
+#include <stdexcept>
+
 namespace
 {
-	const auto client_options = []
+	ynet::Client::Options make_client_options(const ynet::SocketOptions& socket_options)
 	{
 		ynet::Client::Options options;
 		options.shutdown_timeout = -1;
+		options.socket = socket_options;
+		return options;
+	}
+
+	ynet::Server::Options make_server_options(const ynet::SocketOptions& socket_options)
+	{
+		ynet::Server::Options options;
+		options.socket = socket_options;
 		return options;
-	}();
+	}
+
+	ynet::Client::Options make_framed_client_options(bool builtin)
+	{
+		ynet::Client::Options options;
+		options.shutdown_timeout = -1;
+		options.framing = builtin ? ynet::Framing::Varint : ynet::Framing::None;
+		return options;
+	}
+
+	ynet::Server::Options make_framed_server_options(bool builtin)
+	{
+		ynet::Server::Options options;
+		options.framing = builtin ? ynet::Framing::Varint : ynet::Framing::None;
+		return options;
+	}
+
+	std::vector<uint8_t> make_batch(size_t message_size, size_t messages)
+	{
+		uint8_t prefix[ynet::MaxFramePrefixSize];
+		const auto prefix_size = ynet::write_frame_prefix(ynet::Framing::Varint, message_size, prefix);
+		std::vector<uint8_t> batch;
+		batch.reserve((prefix_size + message_size) * messages);
+		for (size_t i = 0; i < messages; ++i)
+		{
+			batch.insert(batch.end(), prefix, prefix + prefix_size);
+			batch.resize(batch.size() + message_size);
+		}
+		return batch;
+	}
 }
 
-ExchangeClient::ExchangeClient(const ClientFactory& factory, int64_t seconds, size_t bytes)
-	: BenchmarkClient(factory, client_options, seconds)
+template <typename Function>
+void ManualDeframer::process(const void* data, size_t size, Function&& function)
+{
+	_buffer.insert(_buffer.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+	size_t offset = 0;
+	for (;;)
+	{
+		size_t message_size = 0;
+		size_t prefix_size = 0;
+		for (unsigned shift = 0; offset + prefix_size < _buffer.size(); shift += 7)
+		{
+			const auto byte = _buffer[offset + prefix_size++];
+			message_size |= static_cast<size_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				break;
+			if (offset + prefix_size == _buffer.size())
+				prefix_size = 0;
+		}
+		if (!prefix_size || _buffer.size() - offset - prefix_size < message_size)
+			break;
+		// Applications usually hand out messages as separate vectors.
+		const std::vector<uint8_t> message(&_buffer[offset + prefix_size], &_buffer[offset + prefix_size] + message_size);
+		function(message.data(), message.size());
+		offset += prefix_size + message_size;
+	}
+	_buffer.erase(_buffer.begin(), _buffer.begin() + offset);
+}
+
+ExchangeClient::ExchangeClient(const ClientFactory& factory, int64_t seconds, size_t bytes, const ynet::SocketOptions& socket_options)
+	: BenchmarkClient(factory, make_client_options(socket_options), seconds)
 	, _buffer(bytes)
 {
 }
@@ -45,8 +112,8 @@ void ExchangeClient::on_failed_to_connect(int&)
 	discard_benchmark();
 }
 
-ExchangeServer::ExchangeServer(const ServerFactory& factory, size_t bytes)
-	: BenchmarkServer(factory)
+ExchangeServer::ExchangeServer(const ServerFactory& factory, size_t bytes, const ynet::SocketOptions& socket_options)
+	: BenchmarkServer(factory, make_server_options(socket_options))
 	, _buffer(bytes)
 {
 }
@@ -69,3 +136,83 @@ void ExchangeServer::on_received(const std::shared_ptr<ynet::Connection>& connec
 void ExchangeServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
 {
 }
+
+FramedExchangeClient::FramedExchangeClient(const ClientFactory& factory, int64_t seconds, size_t message_size, size_t messages, bool builtin)
+	: BenchmarkClient(factory, make_framed_client_options(builtin), seconds)
+	, _message_size(message_size)
+	, _messages(messages)
+	, _builtin(builtin)
+	, _batch(make_batch(message_size, messages))
+{
+}
+
+void FramedExchangeClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	start_benchmark();
+	connection->send(_batch.data(), _batch.size());
+}
+
+void FramedExchangeClient::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	if (_builtin)
+		on_message(connection, size);
+	else
+		_deframer.process(data, size, [this, &connection](const void*, size_t message_size){ on_message(connection, message_size); });
+}
+
+void FramedExchangeClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+}
+
+void FramedExchangeClient::on_failed_to_connect(int&)
+{
+	discard_benchmark();
+}
+
+void FramedExchangeClient::on_message(const std::shared_ptr<ynet::Connection>& connection, size_t size)
+{
+	if (size != _message_size)
+		throw std::logic_error("Unexpected received message size");
+	++_marks;
+	if (++_received < _messages)
+		return;
+	if (stop_benchmark())
+		return;
+	_received = 0;
+	connection->send(_batch.data(), _batch.size());
+}
+
+FramedExchangeServer::FramedExchangeServer(const ServerFactory& factory, size_t message_size, size_t messages, bool builtin)
+	: BenchmarkServer(factory, make_framed_server_options(builtin))
+	, _message_size(message_size)
+	, _messages(messages)
+	, _builtin(builtin)
+	, _batch(make_batch(message_size, messages))
+{
+}
+
+void FramedExchangeServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void FramedExchangeServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	if (_builtin)
+		on_message(connection, size);
+	else
+		_deframer.process(data, size, [this, &connection](const void*, size_t message_size){ on_message(connection, message_size); });
+}
+
+void FramedExchangeServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void FramedExchangeServer::on_message(const std::shared_ptr<ynet::Connection>& connection, size_t size)
+{
+	if (size != _message_size)
+		throw std::logic_error("Unexpected received message size");
+	if (++_received < _messages)
+		return;
+	_received = 0;
+	connection->send(_batch.data(), _batch.size());
+}
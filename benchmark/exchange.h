@@ -7,7 +7,7 @@
 class ExchangeClient : public BenchmarkClient
 {
 public:
-	ExchangeClient(const ClientFactory&, int64_t seconds, size_t bytes);
+	ExchangeClient(const ClientFactory&, int64_t seconds, size_t bytes, const ynet::SocketOptions& = {});
 
 	uint64_t bytes() const { return _marks * _buffer.size() * 2; }
 	uint64_t marks() const { return _marks; }
@@ -27,7 +27,7 @@ private:
 class ExchangeServer : public BenchmarkServer
 {
 public:
-	ExchangeServer(const ServerFactory&, size_t bytes);
+	ExchangeServer(const ServerFactory&, size_t bytes, const ynet::SocketOptions& = {});
 	~ExchangeServer() override { stop(); }
 
 private:
@@ -39,3 +39,65 @@ private:
 	std::vector<uint8_t> _buffer;
 	size_t _offset = 0;
 };
+
+// Reassembles varint-prefixed messages in a std::vector, like applications without library framing do.
+class ManualDeframer
+{
+public:
+	template <typename Function>
+	void process(const void* data, size_t size, Function&& function);
+
+private:
+	std::vector<uint8_t> _buffer;
+};
+
+// Exchanges batches of small framed messages, each batch being sent with a single call.
+class FramedExchangeClient : public BenchmarkClient
+{
+public:
+	// Messages are reassembled by the library if 'builtin' is true, and by the client otherwise.
+	FramedExchangeClient(const ClientFactory&, int64_t seconds, size_t message_size, size_t messages, bool builtin);
+
+	uint64_t bytes() const { return _marks * _message_size * 2; }
+	uint64_t marks() const { return _marks; }
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+	void on_failed_to_connect(int&) override;
+
+	void on_message(const std::shared_ptr<ynet::Connection>&, size_t size);
+
+private:
+	const size_t _message_size;
+	const size_t _messages;
+	const bool _builtin;
+	const std::vector<uint8_t> _batch;
+	ManualDeframer _deframer;
+	size_t _received = 0;
+	uint64_t _marks = 0; // Number of messages exchanged.
+};
+
+// Replies with a batch of framed messages to each received batch.
+class FramedExchangeServer : public BenchmarkServer
+{
+public:
+	FramedExchangeServer(const ServerFactory&, size_t message_size, size_t messages, bool builtin);
+	~FramedExchangeServer() override { stop(); }
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+	void on_message(const std::shared_ptr<ynet::Connection>&, size_t size);
+
+private:
+	const size_t _message_size;
+	const size_t _messages;
+	const bool _builtin;
+	const std::vector<uint8_t> _batch;
+	ManualDeframer _deframer;
+	size_t _received = 0;
+};
@@ -0,0 +1,42 @@
+#include "idle.h"
+
+IdleClients::IdleClients(const ClientFactory& factory, size_t count, ynet::ClientContext* context)
+{
+	ynet::Client::Options client_options;
+	client_options.shutdown_timeout = 0;
+	client_options.context = context;
+	_clients.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		_clients.emplace_back(factory(*this, client_options));
+	std::unique_lock<std::mutex> lock(_mutex);
+	_connected_condition.wait(lock, [this, count]{ return _connected == count; });
+}
+
+IdleClients::~IdleClients()
+{
+	_clients.clear();
+}
+
+void IdleClients::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_connected;
+	}
+	_connected_condition.notify_one();
+}
+
+void IdleClients::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+}
+
+void IdleClients::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	--_connected;
+}
+
+void IdleClients::on_failed_to_connect(int& reconnect_timeout)
+{
+	reconnect_timeout = 100;
+}
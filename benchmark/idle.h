@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "benchmark.h"
+
+// A set of clients which connect and stay idle.
+class IdleClients : public ynet::Client::Callbacks
+{
+public:
+	// The clients are served by the context if specified.
+	IdleClients(const ClientFactory&, size_t count, ynet::ClientContext* = nullptr);
+	~IdleClients() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+	void on_failed_to_connect(int&) override;
+
+private:
+	std::mutex _mutex;
+	size_t _connected = 0;
+	std::condition_variable _connected_condition;
+	std::vector<std::unique_ptr<ynet::Client>> _clients;
+};
@@ -1,11 +1,21 @@
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <new>
+#include <thread>
 #include <unordered_set>
 
+#include <sys/resource.h>
+
+#include "chatty.h"
 #include "connect_disconnect.h"
 #include "exchange.h"
+#include "idle.h"
 #include "receive.h"
 #include "send.h"
 
@@ -18,6 +28,9 @@ struct BenchmarkResults
 	uint64_t operations = 0;
 	size_t unit_bytes = 0;
 	uint64_t total_bytes = 0;
+	uint64_t cpu_milliseconds = 0; // Process CPU time, including the server.
+	uint64_t allocations = 0; // Global allocator calls made by the process, including the server.
+	std::string label;
 
 	BenchmarkResults() = default;
 
@@ -38,6 +51,57 @@ struct BenchmarkResults
 
 namespace
 {
+	std::atomic<uint64_t> allocation_count{0};
+}
+
+void* operator new(size_t size)
+{
+	::allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (const auto pointer = std::malloc(size ? size : 1))
+		return pointer;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+namespace
+{
+	uint64_t allocations()
+	{
+		return allocation_count.load(std::memory_order_relaxed);
+	}
+
+	uint64_t cpu_milliseconds()
+	{
+		::rusage usage = {};
+		::getrusage(RUSAGE_SELF, &usage);
+		const auto to_milliseconds = [](const ::timeval& time) { return time.tv_sec * uint64_t{1000} + time.tv_usec / 1000; };
+		return to_milliseconds(usage.ru_utime) + to_milliseconds(usage.ru_stime);
+	}
+
+	// Returns the value of a /proc/self/status field, e.g. "Threads" or "VmRSS".
+	std::string process_status(const std::string& name)
+	{
+		std::ifstream status("/proc/self/status");
+		for (std::string line; std::getline(status, line);)
+			if (line.compare(0, name.size() + 1, name + ":") == 0)
+				return line.substr(line.find_first_not_of(" \t", name.size() + 1));
+		return "?";
+	}
+
+	std::string make_cpu_per_gib(const BenchmarkResults& results)
+	{
+		return std::to_string(results.cpu_milliseconds * 1024.0 * 1024 * 1024 / results.total_bytes) + " CPU ms/GiB";
+	}
+
 	template <class T>
 	std::string make_human_readable(T bytes)
 	{
@@ -55,6 +119,21 @@ namespace
 		return std::to_string(bytes) + " T";
 	}
 
+	// Raises the open file limit to the maximum, returning true if it allows the specified number of descriptors.
+	bool reserve_files(size_t count)
+	{
+		::rlimit limit = {};
+		if (::getrlimit(RLIMIT_NOFILE, &limit) == -1)
+			return false;
+		if (limit.rlim_cur < limit.rlim_max)
+		{
+			limit.rlim_cur = limit.rlim_max;
+			if (::setrlimit(RLIMIT_NOFILE, &limit) == -1)
+				return false;
+		}
+		return limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= count;
+	}
+
 	void print_table(const Table& table)
 	{
 		size_t max_row_size = 0;
@@ -83,6 +162,8 @@ namespace
 		for (const auto& result : results)
 		{
 			Row row;
+			if (!result.label.empty())
+				row.emplace_back(result.label);
 			if (result.unit_bytes > 0)
 				row.emplace_back(make_human_readable(result.unit_bytes));
 			const auto seconds = result.milliseconds / 1000.0;
@@ -93,7 +174,11 @@ namespace
 			{
 				row.emplace_back(make_human_readable(result.total_bytes));
 				row.emplace_back(std::to_string(result.total_bytes / (seconds * 1024 * 1024)) + " MiB/s");
+				if (result.cpu_milliseconds > 0)
+					row.emplace_back(::make_cpu_per_gib(result));
 			}
+			if (result.allocations > 0)
+				row.emplace_back(std::to_string(result.allocations * 1.0 / result.operations) + " allocs/op");
 			table.emplace_back(std::move(row));
 		}
 		print_table(table);
@@ -108,6 +193,8 @@ namespace
 		{
 			Row row;
 			assert(first[i].unit_bytes == second[i].unit_bytes);
+			if (!first[i].label.empty())
+				row.emplace_back(first[i].label);
 			if (first[i].unit_bytes > 0)
 				row.emplace_back(make_human_readable(first[i].unit_bytes));
 			const auto seconds = first[i].milliseconds / 1000.0;
@@ -120,6 +207,16 @@ namespace
 			{
 				row.emplace_back(std::to_string(first[i].total_bytes / (seconds * 1024 * 1024)) + " MiB/s");
 				row.emplace_back(std::to_string(second[i].total_bytes / (seconds * 1024 * 1024)) + " MiB/s");
+				if (first[i].cpu_milliseconds > 0 && second[i].cpu_milliseconds > 0)
+				{
+					row.emplace_back(::make_cpu_per_gib(first[i]));
+					row.emplace_back(::make_cpu_per_gib(second[i]));
+				}
+			}
+			if (first[i].allocations > 0 && second[i].allocations > 0)
+			{
+				row.emplace_back(std::to_string(first[i].allocations * 1.0 / first[i].operations) + " allocs/op");
+				row.emplace_back(std::to_string(second[i].allocations * 1.0 / second[i].operations) + " allocs/op");
 			}
 			row.emplace_back(std::to_string(second_ops_s * 1.0 / first_ops_s) + " x");
 			table.emplace_back(std::move(row));
@@ -129,30 +226,126 @@ namespace
 }
 
 template <class Factory>
-BenchmarkResults benchmark_connect_disconnect(unsigned seconds)
+BenchmarkResults benchmark_chatty(unsigned seconds, size_t connections, size_t bytes, bool batch)
 {
-	std::cout << "Benchmarking connect-disconnect (1 thread, " << seconds << " s)..." << std::endl;
-	ConnectDisconnectServer server(Factory::create_server);
-	ConnectDisconnectClient client(Factory::create_client, seconds);
-	const auto milliseconds = client.run();
-	if (milliseconds < 0)
+	const auto& human_readable_bytes = ::make_human_readable(bytes);
+	std::cout << "Benchmarking " << (batch ? "batched" : "per-call") << " receive from chatty clients (" << seconds << " s, " << connections << " x " << human_readable_bytes << ")..." << std::endl;
+	ChattyServer server(Factory::create_server, batch);
+	ynet::ClientContext::Options context_options;
+	context_options.threads = 0;
+	const auto context = ynet::ClientContext::create(context_options);
+	ChattyClients clients(Factory::create_client, connections, bytes, *context);
+	const auto start_time = std::chrono::steady_clock::now();
+	const auto start_marks = clients.marks();
+	const auto start_bytes = clients.bytes();
+	std::this_thread::sleep_for(std::chrono::seconds{seconds});
+	const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+	BenchmarkResults results(milliseconds, clients.marks() - start_marks, bytes, clients.bytes() - start_bytes);
+	results.label = std::to_string(connections) + " conn";
+	return results;
+}
+
+template <class Factory>
+BenchmarkResults benchmark_connect_disconnect(unsigned seconds, unsigned threads = 1, bool reuse_port = false, ynet::Resolver* resolver = nullptr)
+{
+	std::cout << "Benchmarking connect-disconnect (" << threads << " thread(s)" << (reuse_port ? " with SO_REUSEPORT" : "") << (resolver ? " with resolver cache" : "") << ", " << seconds << " s)..." << std::endl;
+	ynet::Server::Options options;
+	options.io_threads = threads;
+	options.reuse_port = reuse_port;
+	ConnectDisconnectServer server(Factory::create_server, options);
+	std::vector<std::unique_ptr<ConnectDisconnectClient>> clients;
+	for (unsigned i = 0; i < threads; ++i)
+		clients.emplace_back(std::make_unique<ConnectDisconnectClient>(Factory::create_client, seconds, resolver));
+	std::vector<int64_t> milliseconds(threads);
+	const auto start_allocations = ::allocations();
+	{
+		std::vector<std::thread> client_threads;
+		for (unsigned i = 0; i < threads; ++i)
+			client_threads.emplace_back([&clients, &milliseconds, i]{ milliseconds[i] = clients[i]->run(); });
+		for (auto& thread : client_threads)
+			thread.join();
+	}
+	BenchmarkResults results;
+	results.allocations = ::allocations() - start_allocations;
+	for (unsigned i = 0; i < threads; ++i)
+	{
+		if (milliseconds[i] < 0)
+			return {};
+		results.milliseconds = std::max<uint64_t>(results.milliseconds, milliseconds[i]);
+		results.operations += clients[i]->marks();
+	}
+	results.label = std::to_string(threads) + " clients";
+	return results;
+}
+
+template <class Factory>
+BenchmarkResults benchmark_shutdown(const std::string& backend, size_t connections, int shutdown_timeout)
+{
+	std::cout << "Benchmarking " << backend << " server shutdown with chatty clients (" << connections << " conn, " << shutdown_timeout << " ms timeout)..." << std::endl;
+	// Each connection takes a descriptor on both sides.
+	if (!::reserve_files(connections * 2 + 64))
+	{
+		std::cout << "\tNot enough file descriptors" << std::endl;
 		return {};
-	return BenchmarkResults(milliseconds, client.marks());
+	}
+	auto server = std::make_unique<ChattyServer>(Factory::create_server, false, shutdown_timeout);
+	ynet::ClientContext::Options context_options;
+	context_options.threads = 0;
+	const auto context = ynet::ClientContext::create(context_options);
+	ChattyClients clients(Factory::create_client, connections, 16, *context);
+	const auto start_time = std::chrono::steady_clock::now();
+	server.reset();
+	const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+	BenchmarkResults results(milliseconds, connections);
+	results.label = backend + ", " + (shutdown_timeout < 0 ? "infinite" : std::to_string(shutdown_timeout) + " ms");
+	return results;
 }
 
 template <class Factory>
-BenchmarkResults benchmark_exchange(unsigned seconds, size_t bytes)
+BenchmarkResults benchmark_exchange(unsigned seconds, size_t bytes, bool nodelay = false)
 {
 	const auto& human_readable_bytes = ::make_human_readable(bytes);
-	std::cout << "Benchmarking exchange (" << seconds << " s, " << human_readable_bytes << ")..." << std::endl;
-	ExchangeServer server(Factory::create_server, bytes);
-	ExchangeClient client(Factory::create_client, seconds, bytes);
+	std::cout << "Benchmarking exchange" << (nodelay ? " with TCP_NODELAY" : "") << " (" << seconds << " s, " << human_readable_bytes << ")..." << std::endl;
+	ynet::SocketOptions socket_options;
+	socket_options.tcp_nodelay = nodelay;
+	ExchangeServer server(Factory::create_server, bytes, socket_options);
+	ExchangeClient client(Factory::create_client, seconds, bytes, socket_options);
 	const auto milliseconds = client.run();
 	if (milliseconds < 0)
 		return {};
 	return BenchmarkResults(milliseconds, client.marks(), bytes, client.bytes());
 }
 
+template <class Factory>
+BenchmarkResults benchmark_framed_exchange(unsigned seconds, size_t message_size, size_t messages, bool builtin)
+{
+	const auto& human_readable_bytes = ::make_human_readable(message_size);
+	std::cout << "Benchmarking framed exchange with " << (builtin ? "library" : "manual") << " framing (" << seconds << " s, " << messages << " x " << human_readable_bytes << ")..." << std::endl;
+	FramedExchangeServer server(Factory::create_server, message_size, messages, builtin);
+	FramedExchangeClient client(Factory::create_client, seconds, message_size, messages, builtin);
+	const auto milliseconds = client.run();
+	if (milliseconds < 0)
+		return {};
+	return BenchmarkResults(milliseconds, client.marks(), message_size, client.bytes());
+}
+
+template <class Factory>
+BenchmarkResults benchmark_idle(unsigned seconds, size_t connections, bool shared_threads = false)
+{
+	std::cout << "Benchmarking exchange with idle connections (" << seconds << " s, " << connections << " idle" << (shared_threads ? ", shared threads" : "") << ")..." << std::endl;
+	ExchangeServer server(Factory::create_server, 1);
+	const auto context = shared_threads ? ynet::ClientContext::create() : nullptr;
+	IdleClients idle_clients(Factory::create_client, connections, context.get());
+	std::cout << "\t" << ::process_status("Threads") << " threads, " << ::process_status("VmRSS") << " RSS" << std::endl;
+	ExchangeClient client(Factory::create_client, seconds, 1);
+	const auto milliseconds = client.run();
+	if (milliseconds < 0)
+		return {};
+	BenchmarkResults results(milliseconds, client.marks());
+	results.label = std::to_string(connections + 1) + " conn";
+	return results;
+}
+
 template <class Factory>
 BenchmarkResults benchmark_receive(unsigned seconds, size_t bytes)
 {
@@ -160,10 +353,29 @@ BenchmarkResults benchmark_receive(unsigned seconds, size_t bytes)
 	std::cout << "Benchmarking receive (" << seconds << " s, " << human_readable_bytes << ")..." << std::endl;
 	ReceiveServer server(Factory::create_server, bytes);
 	ReceiveClient client(Factory::create_client, seconds, bytes);
+	const auto cpu_start = ::cpu_milliseconds();
 	const auto milliseconds = client.run();
 	if (milliseconds < 0)
 		return {};
-	return BenchmarkResults(milliseconds, client.marks(), bytes, client.bytes());
+	BenchmarkResults results(milliseconds, client.marks(), bytes, client.bytes());
+	results.cpu_milliseconds = ::cpu_milliseconds() - cpu_start;
+	return results;
+}
+
+template <class Factory>
+BenchmarkResults benchmark_shared_receive(unsigned seconds, size_t bytes, bool zerocopy)
+{
+	const auto& human_readable_bytes = ::make_human_readable(bytes);
+	std::cout << "Benchmarking receive of shared buffers " << (zerocopy ? "without" : "with") << " copying (" << seconds << " s, " << human_readable_bytes << ")..." << std::endl;
+	ReceiveServer server(Factory::create_server, bytes, zerocopy);
+	ReceiveClient client(Factory::create_client, seconds, bytes);
+	const auto cpu_start = ::cpu_milliseconds();
+	const auto milliseconds = client.run();
+	if (milliseconds < 0)
+		return {};
+	BenchmarkResults results(milliseconds, client.marks(), bytes, client.bytes());
+	results.cpu_milliseconds = ::cpu_milliseconds() - cpu_start;
+	return results;
 }
 
 template <class Factory>
@@ -173,6 +385,22 @@ BenchmarkResults benchmark_send(unsigned seconds, size_t bytes)
 	std::cout << "Benchmarking send (" << seconds << " s, " << human_readable_bytes << ")..." << std::endl;
 	SendServer server(Factory::create_server);
 	SendClient client(Factory::create_client, seconds, bytes);
+	const auto cpu_start = ::cpu_milliseconds();
+	const auto milliseconds = client.run();
+	if (milliseconds < 0)
+		return {};
+	BenchmarkResults results(milliseconds, client.marks(), bytes, client.bytes());
+	results.cpu_milliseconds = ::cpu_milliseconds() - cpu_start;
+	return results;
+}
+
+template <class Factory>
+BenchmarkResults benchmark_fragmented_send(unsigned seconds, size_t bytes, size_t fragments, bool vectored)
+{
+	const auto& human_readable_bytes = ::make_human_readable(bytes);
+	std::cout << "Benchmarking " << (vectored ? "vectored" : "copying") << " send (" << seconds << " s, " << human_readable_bytes << " in " << fragments << " fragments)..." << std::endl;
+	SendServer server(Factory::create_server);
+	SendClient client(Factory::create_client, seconds, bytes, fragments, vectored);
 	const auto milliseconds = client.run();
 	if (milliseconds < 0)
 		return {};
@@ -190,6 +418,26 @@ int main(int argc, char** argv)
 		std::vector<BenchmarkResults> results;
 		results.emplace_back(benchmark_connect_disconnect<BenchmarkTcp>(1)); // TODO: Change seconds to attempts.
 		print_results(results);
+		std::vector<BenchmarkResults> shared;
+		std::vector<BenchmarkResults> reuse_port;
+		for (unsigned threads = 2; threads <= 8; threads *= 2)
+		{
+			shared.emplace_back(benchmark_connect_disconnect<BenchmarkTcp>(1, threads, false));
+			reuse_port.emplace_back(benchmark_connect_disconnect<BenchmarkTcp>(1, threads, true));
+		}
+		print_compared(shared, reuse_port);
+	}
+	if (options.count("connect-resolver"))
+	{
+		const auto resolver = ynet::Resolver::create();
+		std::vector<BenchmarkResults> uncached;
+		std::vector<BenchmarkResults> cached;
+		for (unsigned threads = 1; threads <= 4; threads *= 2)
+		{
+			uncached.emplace_back(benchmark_connect_disconnect<BenchmarkTcp>(test_seconds, threads));
+			cached.emplace_back(benchmark_connect_disconnect<BenchmarkTcp>(test_seconds, threads, false, resolver.get()));
+		}
+		print_compared(uncached, cached);
 	}
 	if (options.count("connect-local"))
 	{
@@ -204,6 +452,17 @@ int main(int argc, char** argv)
 			results.emplace_back(benchmark_send<BenchmarkTcp>(test_seconds, 1 << i));
 		print_results(results);
 	}
+	if (options.count("vectored"))
+	{
+		std::vector<BenchmarkResults> copying;
+		std::vector<BenchmarkResults> vectored;
+		for (int i = 4; i <= 24; ++i)
+		{
+			copying.emplace_back(benchmark_fragmented_send<BenchmarkTcp>(test_seconds, 1 << i, 4, false));
+			vectored.emplace_back(benchmark_fragmented_send<BenchmarkTcp>(test_seconds, 1 << i, 4, true));
+		}
+		print_compared(copying, vectored);
+	}
 	if (options.count("receive"))
 	{
 		std::vector<BenchmarkResults> results;
@@ -211,6 +470,17 @@ int main(int argc, char** argv)
 			results.emplace_back(benchmark_receive<BenchmarkTcp>(test_seconds, 1 << i));
 		print_results(results);
 	}
+	if (options.count("zerocopy"))
+	{
+		std::vector<BenchmarkResults> copying;
+		std::vector<BenchmarkResults> zerocopy;
+		for (int i = 12; i <= 26; ++i)
+		{
+			copying.emplace_back(benchmark_shared_receive<BenchmarkTcp>(test_seconds, 1 << i, false));
+			zerocopy.emplace_back(benchmark_shared_receive<BenchmarkTcp>(test_seconds, 1 << i, true));
+		}
+		print_compared(copying, zerocopy);
+	}
 	if (options.count("exchange"))
 	{
 		std::vector<BenchmarkResults> results;
@@ -218,6 +488,66 @@ int main(int argc, char** argv)
 			results.emplace_back(benchmark_exchange<BenchmarkTcp>(test_seconds, 1 << i));
 		print_results(results);
 	}
+	if (options.count("framing"))
+	{
+		std::vector<BenchmarkResults> manual;
+		std::vector<BenchmarkResults> builtin;
+		for (int i = 0; i <= 12; i += 2)
+		{
+			manual.emplace_back(benchmark_framed_exchange<BenchmarkTcp>(test_seconds, 1 << i, 256, false));
+			builtin.emplace_back(benchmark_framed_exchange<BenchmarkTcp>(test_seconds, 1 << i, 256, true));
+		}
+		print_compared(manual, builtin);
+	}
+	if (options.count("batch"))
+	{
+		std::vector<BenchmarkResults> per_call;
+		std::vector<BenchmarkResults> batched;
+		for (size_t connections = 10; connections <= 1000; connections *= 10)
+		{
+			per_call.emplace_back(benchmark_chatty<BenchmarkTcp>(test_seconds, connections, 16, false));
+			batched.emplace_back(benchmark_chatty<BenchmarkTcp>(test_seconds, connections, 16, true));
+		}
+		print_compared(per_call, batched);
+	}
+	if (options.count("shutdown"))
+	{
+		std::vector<BenchmarkResults> results;
+		for (const auto shutdown_timeout : {-1, 100, 0})
+			results.emplace_back(benchmark_shutdown<BenchmarkTcp>("epoll", 10000, shutdown_timeout));
+		for (const auto shutdown_timeout : {-1, 100, 0})
+			results.emplace_back(benchmark_shutdown<BenchmarkTcpUring>("io_uring", 10000, shutdown_timeout));
+		print_results(results);
+	}
+	if (options.count("nodelay"))
+	{
+		std::vector<BenchmarkResults> nagle;
+		std::vector<BenchmarkResults> nodelay;
+		for (int i = 0; i <= 20; ++i)
+		{
+			nagle.emplace_back(benchmark_exchange<BenchmarkTcp>(test_seconds, 1 << i, false));
+			nodelay.emplace_back(benchmark_exchange<BenchmarkTcp>(test_seconds, 1 << i, true));
+		}
+		print_compared(nagle, nodelay);
+	}
+	if (options.count("idle"))
+	{
+		std::vector<BenchmarkResults> results;
+		for (size_t connections = 1; connections <= 1000; connections *= 10)
+			results.emplace_back(benchmark_idle<BenchmarkTcp>(test_seconds, connections - 1));
+		print_results(results);
+	}
+	if (options.count("context"))
+	{
+		std::vector<BenchmarkResults> dedicated;
+		std::vector<BenchmarkResults> shared;
+		for (size_t connections = 1; connections <= 1000; connections *= 10)
+		{
+			dedicated.emplace_back(benchmark_idle<BenchmarkTcp>(test_seconds, connections - 1, false));
+			shared.emplace_back(benchmark_idle<BenchmarkTcp>(test_seconds, connections - 1, true));
+		}
+		print_compared(dedicated, shared);
+	}
 	if (options.count("local"))
 	{
 		std::vector<BenchmarkResults> tcp;
@@ -245,5 +575,95 @@ int main(int argc, char** argv)
 		}
 		print_compared(tcp, local);
 	}
+	if (options.count("shm"))
+	{
+		std::vector<BenchmarkResults> sockets;
+		std::vector<BenchmarkResults> shm;
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_send<BenchmarkLocal>(test_seconds, 1 << i));
+			shm.emplace_back(benchmark_send<BenchmarkLocalShm>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, shm);
+		sockets.clear();
+		shm.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_receive<BenchmarkLocal>(test_seconds, 1 << i));
+			shm.emplace_back(benchmark_receive<BenchmarkLocalShm>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, shm);
+		sockets.clear();
+		shm.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_exchange<BenchmarkLocal>(test_seconds, 1 << i));
+			shm.emplace_back(benchmark_exchange<BenchmarkLocalShm>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, shm);
+	}
+	if (options.count("inprocess"))
+	{
+		std::vector<BenchmarkResults> local;
+		std::vector<BenchmarkResults> inprocess;
+		for (int i = 0; i <= 29; ++i)
+		{
+			local.emplace_back(benchmark_send<BenchmarkLocal>(test_seconds, 1 << i));
+			inprocess.emplace_back(benchmark_send<BenchmarkInprocess>(test_seconds, 1 << i));
+		}
+		print_compared(local, inprocess);
+		local.clear();
+		inprocess.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			local.emplace_back(benchmark_receive<BenchmarkLocal>(test_seconds, 1 << i));
+			inprocess.emplace_back(benchmark_receive<BenchmarkInprocess>(test_seconds, 1 << i));
+		}
+		print_compared(local, inprocess);
+		local.clear();
+		inprocess.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			local.emplace_back(benchmark_exchange<BenchmarkLocal>(test_seconds, 1 << i));
+			inprocess.emplace_back(benchmark_exchange<BenchmarkInprocess>(test_seconds, 1 << i));
+		}
+		print_compared(local, inprocess);
+		// The per-message dispatch cost is what remains of the framed exchange without the system calls.
+		local.clear();
+		inprocess.clear();
+		for (int i = 0; i <= 12; i += 2)
+		{
+			local.emplace_back(benchmark_framed_exchange<BenchmarkLocal>(test_seconds, 1 << i, 256, true));
+			inprocess.emplace_back(benchmark_framed_exchange<BenchmarkInprocess>(test_seconds, 1 << i, 256, true));
+		}
+		print_compared(local, inprocess);
+	}
+	if (options.count("io_uring"))
+	{
+		std::vector<BenchmarkResults> sockets;
+		std::vector<BenchmarkResults> uring;
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_send<BenchmarkTcp>(test_seconds, 1 << i));
+			uring.emplace_back(benchmark_send<BenchmarkTcpUring>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, uring);
+		sockets.clear();
+		uring.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_receive<BenchmarkTcp>(test_seconds, 1 << i));
+			uring.emplace_back(benchmark_receive<BenchmarkTcpUring>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, uring);
+		sockets.clear();
+		uring.clear();
+		for (int i = 0; i <= 29; ++i)
+		{
+			sockets.emplace_back(benchmark_exchange<BenchmarkTcp>(test_seconds, 1 << i));
+			uring.emplace_back(benchmark_exchange<BenchmarkTcpUring>(test_seconds, 1 << i));
+		}
+		print_compared(sockets, uring);
+	}
 	return 0;
 }
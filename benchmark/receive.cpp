@@ -8,6 +8,21 @@ namespace
 		options.shutdown_timeout = 0; // The server sends us data as long as it can, so infinite wait for graceful disconnect is not an option.
 		return options;
 	}();
+
+	// The buffer is never modified, so it can be sent again before the previous send completes.
+	std::shared_ptr<const void> make_shared_buffer(size_t size)
+	{
+		const auto buffer = std::make_shared<std::vector<uint8_t>>(size);
+		return std::shared_ptr<const void>(buffer, buffer->data());
+	}
+
+	ynet::Server::Options shared_server_options(bool zerocopy)
+	{
+		ynet::Server::Options options;
+		options.nonblocking_send = true;
+		options.zerocopy_send = zerocopy;
+		return options;
+	}
 }
 
 ReceiveClient::ReceiveClient(const ClientFactory& factory, int64_t seconds, size_t bytes)
@@ -46,9 +61,19 @@ ReceiveServer::ReceiveServer(const ServerFactory& factory, size_t bytes)
 {
 }
 
+ReceiveServer::ReceiveServer(const ServerFactory& factory, size_t bytes, bool zerocopy)
+	: BenchmarkServer(factory, shared_server_options(zerocopy))
+	, _shared_buffer(make_shared_buffer(bytes))
+	, _shared_size(bytes)
+{
+}
+
 void ReceiveServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
 {
-	while (connection->send(_buffer.data(), _buffer.size()));
+	if (_shared_buffer)
+		send_shared(connection);
+	else
+		while (connection->send(_buffer.data(), _buffer.size()));
 }
 
 void ReceiveServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
@@ -58,3 +83,14 @@ void ReceiveServer::on_received(const std::shared_ptr<ynet::Connection>&, const
 void ReceiveServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
 {
 }
+
+void ReceiveServer::on_writable(const std::shared_ptr<ynet::Connection>& connection)
+{
+	send_shared(connection);
+}
+
+void ReceiveServer::send_shared(const std::shared_ptr<ynet::Connection>& connection)
+{
+	// Sending fails when the queue is full (or the connection is closed).
+	while (connection->send_zerocopy(_shared_buffer, _shared_size));
+}
@@ -27,13 +27,22 @@ class ReceiveServer : public BenchmarkServer
 {
 public:
 	ReceiveServer(const ServerFactory&, size_t bytes);
+
+	// Sends the same shared buffer over and over with nonblocking sends, with or without copying.
+	ReceiveServer(const ServerFactory&, size_t bytes, bool zerocopy);
+
 	~ReceiveServer() override { stop(); }
 
 private:
 	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
 	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
 	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_writable(const std::shared_ptr<ynet::Connection>&) override;
+
+	void send_shared(const std::shared_ptr<ynet::Connection>&);
 
 private:
 	std::vector<uint8_t> _buffer;
+	std::shared_ptr<const void> _shared_buffer;
+	size_t _shared_size = 0;
 };
@@ -1,5 +1,7 @@
 #include "send.h"
 
+#include <algorithm>
+
 namespace
 {
 	const auto client_options = []
@@ -16,12 +18,35 @@ SendClient::SendClient(const ClientFactory& factory, int64_t seconds, size_t byt
 {
 }
 
+SendClient::SendClient(const ClientFactory& factory, int64_t seconds, size_t bytes, size_t fragments, bool vectored)
+	: BenchmarkClient(factory, client_options, seconds)
+	, _buffer(bytes)
+	, _vectored(vectored)
+{
+	for (size_t i = 0; i < fragments; ++i)
+	{
+		_fragments.emplace_back(bytes * (i + 1) / fragments - bytes * i / fragments);
+		_blocks.push_back({_fragments.back().data(), _fragments.back().size()});
+	}
+}
+
 void SendClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
 {
 	start_benchmark();
 	do
 	{
-		connection->send(_buffer.data(), _buffer.size());
+		if (_vectored)
+			connection->send(_blocks.data(), _blocks.size());
+		else
+		{
+			size_t offset = 0;
+			for (const auto& fragment : _fragments)
+			{
+				std::copy(fragment.begin(), fragment.end(), _buffer.begin() + offset);
+				offset += fragment.size();
+			}
+			connection->send(_buffer.data(), _buffer.size());
+		}
 		++_marks;
 	} while (!stop_benchmark());
 }
@@ -9,6 +9,10 @@ class SendClient : public BenchmarkClient
 public:
 	SendClient(const ClientFactory&, int64_t seconds, size_t bytes);
 
+	// Sends the data split into several buffers, either copying them
+	// into a contiguous one before each send or sending them as separate blocks.
+	SendClient(const ClientFactory&, int64_t seconds, size_t bytes, size_t fragments, bool vectored);
+
 	uint64_t bytes() const { return _marks * _buffer.size(); }
 	uint64_t marks() const { return _marks; }
 
@@ -20,6 +24,9 @@ private:
 
 private:
 	std::vector<uint8_t> _buffer;
+	std::vector<std::vector<uint8_t>> _fragments;
+	std::vector<ynet::Connection::Block> _blocks;
+	bool _vectored = false;
 	size_t _offset = 0;
 	uint64_t _marks = 0;
 };
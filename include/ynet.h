@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -11,31 +12,233 @@ namespace ynet
 	{
 	public:
 
+		// Block of data to send.
+		struct Block
+		{
+			const void* data;
+			size_t size;
+		};
+
+		// Peer IP address in binary form, e.g. for hashing or access checks.
+		struct Endpoint
+		{
+			enum class Family : uint8_t
+			{
+				IPv4,
+				IPv6,
+			};
+
+			Family family = Family::IPv4;
+			uint16_t port = 0;
+			uint8_t ip[16] = {}; // In network byte order. IPv4 addresses occupy the first four bytes.
+		};
+
 		virtual ~Connection() = default;
 
 		// Aborts the connection, interrupting all active IO operations, if any,
 		// and preventing new ones from starting.
 		virtual void abort() = 0;
 
-		// Returns the peer IP address.
-		virtual std::string address() const = 0;
+		// Returns the peer IP address, formatting it on the first call.
+		// IPv4 peers of dual-stack servers are reported as IPv4 addresses.
+		virtual const std::string& address() const = 0;
+
+		// Returns the peer IP address and port without formatting them.
+		// Local and in-process connections report the IPv4 loopback address with zero port.
+		virtual Endpoint endpoint() const = 0;
 
-		// Synchronously sends a block of data to the peer.
-		// Returns true if the entire block was sent.
+		// Sends a block of data to the peer.
+		// Returns true if the entire block was sent, or queued to be sent
+		// if the connection sends data asynchronously (see Server::Options::nonblocking_send).
 		virtual bool send(const void* data, size_t size) = 0;
 
+		// Sends several blocks of data as a single one without copying them into a contiguous buffer.
+		virtual bool send(const Block* blocks, size_t count) = 0;
+
+		// Sends a block of data from a reference-counted buffer, which must not be modified until released.
+		// If the connection uses zero-copy sends (see Server::Options::zerocopy_send), the data isn't copied,
+		// and the buffer is referenced until the kernel has released it (see Server::Callbacks::on_zerocopy_completed).
+		// Otherwise the data is sent like a regular block, and the buffer is released as soon as the data is sent.
+		virtual bool send_zerocopy(const std::shared_ptr<const void>& data, size_t size) = 0;
+
+		// Sends a part of a regular file, ordered with the data sent by other functions.
+		// The data is transferred by the kernel without being copied to user space where possible.
+		// The file descriptor is duplicated and may be closed as soon as the function returns,
+		// but the file contents are read when the data is actually sent.
+		// Returns false if the connection can't send data or the file is shorter than requested.
+		// Truncating the file before its data is sent closes the connection.
+		virtual bool send_file(int file, uint64_t offset, size_t size) = 0;
+
+		// Sends a block of data with file descriptors attached to its first byte, e.g. listening sockets
+		// or memory files to share with the peer (see SocketOptions::max_received_descriptors).
+		// The descriptors are duplicated and may be closed as soon as the function returns.
+		// The block must not be empty, and at most MaxSentDescriptors descriptors may be sent at once.
+		// Returns false if the connection can't send descriptors, which only local connections
+		// not using shared memory (see SocketOptions::shared_memory_size) or io_uring can.
+		virtual bool send_descriptors(const void* data, size_t size, const int* descriptors, size_t count) = 0;
+
+		// Returns a reference to the data passed to the on_received call in progress, which keeps it valid
+		// after the call returns, e.g. to be processed by another thread. The data must not be modified.
+		// Must only be called from on_received. Retaining the data doesn't copy it unless
+		// it has been received by the io_uring backend or reassembled from several parts (see Framing),
+		// and the buffer is reused for receiving once all the references to it are released.
+		virtual std::shared_ptr<const void> retain_received() = 0;
+
+		// Returns the size of the data queued to be sent.
+		virtual size_t pending_bytes() const = 0;
+
+		// Aborts the connection if nothing is received or sent during the specified number of milliseconds,
+		// counting from the call. Zero disables the timeout. Only server connections and connections
+		// of clients using a context have idle timeouts, the function does nothing for other connections.
+		virtual void set_idle_timeout(int milliseconds) = 0;
+
 		// Initiates a graceful shutdown.
 		// The connection can't be used to send data after this function is called,
 		// but data may still be received before the connection terminates.
 		virtual void shutdown() = 0;
 	};
 
+	// Message framing (see Server::Options::framing and Client::Options::framing).
+	// Framed connections pass each complete message to a single on_received call,
+	// directly from the receive buffer unless the message has been received in several parts.
+	// Sent data isn't framed automatically (see write_frame_prefix).
+	enum class Framing
+	{
+		None, // Received data is passed in parts of arbitrary size.
+		Varint, // Each message is prefixed with its size encoded as an unsigned LEB128 varint.
+		Fixed32, // Each message is prefixed with its size encoded as a 32-bit big-endian integer.
+	};
+
+	// Maximum size of a message size prefix.
+	constexpr size_t MaxFramePrefixSize = 10;
+
+	// Writes the size prefix of a message to the buffer, which must be at least MaxFramePrefixSize bytes long.
+	// Returns the prefix size. The prefix and the message may be sent together using
+	// the Connection::send overload for multiple blocks without copying the message.
+	size_t write_frame_prefix(Framing, size_t message_size, void* buffer);
+
+	// Maximum number of file descriptors sent with a single block (see Connection::send_descriptors).
+	constexpr size_t MaxSentDescriptors = 253;
+
+	// Connection socket options. TCP-specific options are ignored by local connections.
+	struct SocketOptions
+	{
+		// Size of the buffer the received data is read into, i.e. the maximum size of the data
+		// passed to a single on_received call.
+		size_t receive_buffer_size = 64 * 1024;
+
+		// Kernel socket buffer sizes (SO_SNDBUF and SO_RCVBUF). Zero means the system default.
+		int kernel_send_buffer_size = 0;
+		int kernel_receive_buffer_size = 0;
+
+		// Disable Nagle's algorithm (TCP_NODELAY), sending small blocks without waiting
+		// for the previous ones to be acknowledged. Reduces the latency of request-response exchanges.
+		bool tcp_nodelay = false;
+
+		// Acknowledge received data immediately instead of delaying the acknowledgement (TCP_QUICKACK).
+		// The kernel may reset the mode, so it is reenabled after each receive.
+		bool tcp_quickack = false;
+
+		// Detect dead peers using TCP keepalive probes (SO_KEEPALIVE).
+		bool keepalive = false;
+
+		// Keepalive parameters (TCP_KEEPIDLE, TCP_KEEPINTVL and TCP_KEEPCNT):
+		// seconds of idleness before the first probe, seconds between probes,
+		// and the number of unanswered probes after which the connection is dropped.
+		// Zero means the system default.
+		int keepalive_idle = 0;
+		int keepalive_interval = 0;
+		int keepalive_count = 0;
+
+		// Size of the shared memory ring buffer to transfer the data of each direction of a local connection,
+		// bypassing the socket which is then only used to exchange the buffers and to detect disconnections.
+		// Each side sends its data through its own buffer, and both the client and the server must enable it,
+		// otherwise the connections fail. Zero disables shared memory. The size is rounded up to a power of two.
+		// Ignored by TCP connections. Servers using shared memory don't use io_uring (see Server::Options::io_uring).
+		size_t shared_memory_size = 0;
+
+		// Maximum number of file descriptors a local connection receives with a single block of data
+		// (see on_received_descriptors). The excess descriptors are closed. Zero disables receiving
+		// descriptors, making the kernel close them instead. Ignored by TCP connections and connections
+		// using shared memory. Servers receiving descriptors don't use io_uring (see Server::Options::io_uring).
+		size_t max_received_descriptors = 0;
+
+		// Use SOCK_SEQPACKET local sockets, which preserve message boundaries: the data sent by each
+		// Connection::send call (or another sending function) is passed to a single on_received call.
+		// Larger messages than receive_buffer_size abort the connection, messages which don't fit
+		// into the kernel send buffer can't be sent, and empty ones aren't sent at all.
+		// Both the client and the server must enable it, otherwise the connections fail. Ignored by TCP
+		// connections. Such connections don't use shared memory, and servers using them don't use io_uring.
+		bool seqpacket = false;
+
+		constexpr SocketOptions() noexcept {}
+	};
+
+	// Threads serving connections of multiple clients (see Client::Options::context).
+	// Memory and context switch overhead of such clients depends on the number of threads
+	// rather than on the number of clients.
+	class ClientContext
+	{
+	public:
+
+		// Context options.
+		struct Options
+		{
+			// Number of threads serving the clients, each client being served by one of them.
+			// Zero means the number of hardware threads.
+			unsigned threads = 1;
+
+			// Size of the buffer each thread receives data into.
+			// Clients may receive data in smaller parts (see SocketOptions::receive_buffer_size),
+			// and can't receive larger messages over SOCK_SEQPACKET sockets (see SocketOptions::seqpacket).
+			size_t receive_buffer_size = 64 * 1024;
+
+			constexpr Options() noexcept {}
+		};
+
+		// Creates a client context. The context must outlive the clients using it.
+		static std::unique_ptr<ClientContext> create(const Options& = {});
+
+		virtual ~ClientContext() = default;
+	};
+
+	// Host name resolver caching the results for the clients using it (see Client::Options::resolver).
+	// Clients served by a context resolve names asynchronously, without blocking the context threads.
+	class Resolver
+	{
+	public:
+
+		// Resolver options.
+		struct Options
+		{
+			// Number of milliseconds to cache resolved addresses for. The system resolver
+			// doesn't report the actual DNS record lifetime, so it is the same for all names.
+			// Zero disables caching.
+			int ttl = 60 * 1000;
+
+			// Number of milliseconds to cache resolution failures for. Zero disables caching.
+			int negative_ttl = 5 * 1000;
+
+			// File in the /etc/hosts format to look the names up in instead of using the system resolver.
+			std::string hosts_file;
+
+			Options() noexcept {}
+		};
+
+		// Creates a resolver. The resolver must outlive the clients using it.
+		static std::unique_ptr<Resolver> create(const Options& = {});
+
+		virtual ~Resolver() = default;
+	};
+
 	// Network client.
 	class Client
 	{
 	public:
 
-		// All callbacks are called from the client thread.
+		// All callbacks are called from the client thread, which is one of the context threads
+		// if the client uses a context (see Options::context).
+		// A client must not be destroyed from its callbacks.
 		struct Callbacks
 		{
 			virtual ~Callbacks() = default;
@@ -50,11 +253,24 @@ namespace ynet
 			// Called when the client has received a message.
 			virtual void on_received(const std::shared_ptr<Connection>&, const void* data, size_t size) = 0;
 
+			// Called when the client has received file descriptors, before on_received is called
+			// for the data they have been sent with (see SocketOptions::max_received_descriptors).
+			// The callback takes the ownership of the descriptors. The default implementation closes them.
+			virtual void on_received_descriptors(const std::shared_ptr<Connection>&, const int* descriptors, size_t count);
+
 			// Called when the client has been disconnected from the server.
 			// 'reconnect_timeout' should be set to a nonnegative value
 			// to try to reconnect in the specified number of milliseconds.
 			virtual void on_disconnected(const std::shared_ptr<Connection>&, int& reconnect_timeout) = 0;
 
+			// Called when the connection send queue has reached the high water mark.
+			// The default implementation does nothing.
+			virtual void on_send_buffer_full(const std::shared_ptr<Connection>&);
+
+			// Called when the connection send queue has drained to the low water mark
+			// after on_send_buffer_full. The default implementation does nothing.
+			virtual void on_writable(const std::shared_ptr<Connection>&);
+
 			// Called when a connection attempt fails.
 			// 'reconnect_timeout' should be set to a nonnegative value
 			// to try to reconnect in the specified number of milliseconds.
@@ -72,12 +288,46 @@ namespace ynet
 			// A negative value means infinite timeout. Zero means instant connection reset.
 			int shutdown_timeout = 0;
 
+			// Number of milliseconds to wait for a connection attempt to complete
+			// before reporting failure, not including name resolution. Zero means the system timeout.
+			// If the host has several addresses, they are tried in parallel with a short delay
+			// between the attempts, and the first established connection is used.
+			int connect_timeout = 0;
+
+			// Connection socket options.
+			SocketOptions socket;
+
+			// Context to serve the client connections with instead of a dedicated thread.
+			ClientContext* context = nullptr;
+
+			// Resolver to cache the host name resolution results with.
+			// Without one, the name is resolved anew on each connection attempt.
+			Resolver* resolver = nullptr;
+
+			// Pass received data to on_received in complete messages.
+			Framing framing = Framing::None;
+
+			// Maximum size of a received framed message. A larger message aborts the connection.
+			size_t max_message_size = 1024 * 1024;
+
+			// Queue the data the connection can't send immediately instead of waiting for it to be sent,
+			// so that a slow server doesn't block the other clients served by the same context thread.
+			// Requires a context. See Server::Options for the details.
+			bool nonblocking_send = false;
+			size_t send_high_water_mark = 1024 * 1024;
+			size_t send_low_water_mark = 256 * 1024;
+
 			constexpr Options() noexcept {}
 		};
 
 		// Creates a local client.
 		static std::unique_ptr<Client> create_local(Callbacks&, const std::string& name, const Options& = {});
 
+		// Creates an in-process client connecting to the in-process server with the same name
+		// (see Server::create_inprocess). The client always has a dedicated thread, ignoring Options::context.
+		// A connection attempt fails immediately if there is no such server.
+		static std::unique_ptr<Client> create_inprocess(Callbacks&, const std::string& name, const Options& = {});
+
 		// Creates a TCP client.
 		static std::unique_ptr<Client> create_tcp(Callbacks&, const std::string& host, uint16_t port, const Options& = {});
 
@@ -89,8 +339,18 @@ namespace ynet
 	{
 	public:
 
-		// All callbacks are called from the server thread.
-		// No server functions may be called from the callbacks.
+		// Data received from a connection (see Callbacks::on_received_batch).
+		struct Received
+		{
+			std::shared_ptr<Connection> connection;
+			const void* data;
+			size_t size;
+		};
+
+		// Callbacks are called from the server threads (see Options::io_threads).
+		// All callbacks for a connection are called from the same thread,
+		// but callbacks for different connections may be called concurrently.
+		// No server functions except Server::schedule and Server::broadcast may be called from the callbacks.
 		struct Callbacks
 		{
 			virtual ~Callbacks() = default;
@@ -110,26 +370,131 @@ namespace ynet
 			// Called when the server has received a message from a client.
 			virtual void on_received(const std::shared_ptr<Connection>&, const void* data, size_t size) = 0;
 
+			// Called instead of on_received if Options::batch_received is set, with all the data
+			// a server thread has received during one event loop iteration, in the order of arrival.
+			// The data is only valid until the call returns. Connections disconnected during the iteration
+			// have their data passed before on_disconnected is called for them.
+			// The default implementation calls on_received for each item.
+			virtual void on_received_batch(const Received*, size_t count);
+
+			// Called when the server has received file descriptors from a client, before the data
+			// they have been sent with is passed to on_received or added to the batch
+			// (see SocketOptions::max_received_descriptors). The callback takes the ownership
+			// of the descriptors. The default implementation closes them.
+			virtual void on_received_descriptors(const std::shared_ptr<Connection>&, const int* descriptors, size_t count);
+
 			// Called when a client has been disconnected from the server.
 			virtual void on_disconnected(const std::shared_ptr<Connection>&) = 0;
+
+			// Called when the connection send queue has reached Options::send_high_water_mark.
+			// The default implementation does nothing.
+			virtual void on_send_buffer_full(const std::shared_ptr<Connection>&);
+
+			// Called when the connection send queue has drained to Options::send_low_water_mark
+			// after on_send_buffer_full. The default implementation does nothing.
+			virtual void on_writable(const std::shared_ptr<Connection>&);
+
+			// Called when the kernel has released a buffer sent without copying,
+			// unless the connection has been disconnected before that.
+			// The default implementation does nothing.
+			virtual void on_zerocopy_completed(const std::shared_ptr<Connection>&, const std::shared_ptr<const void>& data);
 		};
 
 		// Server options.
 		struct Options
 		{
-			// Number of milliseconds to wait for clients to shut down gracefully during server destruction.
-			// A negative value means infinite timeout. Zero means instant shutdown.
+			// Number of milliseconds to wait for clients to shut down gracefully during server destruction,
+			// after which the remaining connections are aborted. A negative value means infinite timeout.
+			// Zero means instant shutdown. The data received after the shutdown has started is discarded.
 			int shutdown_timeout = 0;
 
+			// Number of threads serving the connections, each connection being served by one of them.
+			// Zero means the number of hardware threads.
+			unsigned io_threads = 1;
+
+			// Accept connections in every thread instead of distributing them from the first one.
+			// TCP servers open a listening socket per thread with SO_REUSEPORT,
+			// and local servers share one listening socket among all threads.
+			bool reuse_port = false;
+
+			// Queue the data the connection can't send immediately instead of waiting for it to be sent,
+			// so that slow clients don't block the other connections served by the same thread.
+			bool nonblocking_send = false;
+
+			// Queued data size starting from which sending fails in nonblocking mode.
+			// The queue may exceed it by at most one block.
+			size_t send_high_water_mark = 1024 * 1024;
+
+			// Queued data size at which the connection becomes writable again after reaching the high water mark.
+			size_t send_low_water_mark = 256 * 1024;
+
+			// Send the data passed to Connection::send_zerocopy without copying it (using MSG_ZEROCOPY)
+			// if the socket supports it. Requires nonblocking_send. Only pays off for large blocks.
+			bool zerocopy_send = false;
+
+			// Use io_uring to serve the connections if the kernel supports it.
+			// Falls back to the default implementation otherwise. Server threads don't wait for the data
+			// they send to connections served by other threads to be sent, and such sends fail
+			// if more than 1 MiB is already queued for the connection.
+			bool io_uring = false;
+
+			// Maximum number of connections waiting to be accepted (the 'listen' backlog).
+			// Connection attempts exceeding it may be refused or retried by the clients.
+			int listen_backlog = 16;
+
+			// Socket options of the accepted connections.
+			SocketOptions socket;
+
+			// Pass received data to on_received in complete messages.
+			Framing framing = Framing::None;
+
+			// Maximum size of a received framed message. A larger message aborts the connection.
+			size_t max_message_size = 1024 * 1024;
+
+			// Pass the received data to on_received_batch once per event loop iteration instead of
+			// calling on_received for each part, amortizing the per-call overhead of small messages.
+			// The data received during an iteration is kept in a few pooled buffers rather than copied.
+			bool batch_received = false;
+
 			constexpr Options() noexcept {}
 		};
 
 		// Creates a local server.
 		static std::unique_ptr<Server> create_local(Callbacks&, const std::string& name, const Options& = {});
 
-		// Creates a TCP server.
+		// Creates an in-process server, which is connected to by in-process clients of the same process
+		// (see Client::create_inprocess). The data is copied between the sides in memory, and system calls
+		// are only made to wait for the peer, but otherwise the connections behave like local ones,
+		// e.g. to test the callbacks or to benchmark them without the kernel overhead.
+		// In-process names are separate from local ones, and the server fails to start
+		// if another in-process server uses the name. The only socket options used are receive_buffer_size
+		// and kernel_send_buffer_size, the latter limiting the data a connection with blocking sends
+		// may send ahead of the peer (256 KiB if zero). Options::io_uring is ignored.
+		static std::unique_ptr<Server> create_inprocess(Callbacks&, const std::string& name, const Options& = {});
+
+		// Creates a TCP server listening on all local IPv4 and IPv6 addresses
+		// using a single dual-stack socket, or IPv4 only if IPv6 is disabled.
 		static std::unique_ptr<Server> create_tcp(Callbacks&, uint16_t port, const Options& = {});
 
+		// Creates a TCP server listening on a numeric IPv4 or IPv6 address, e.g. "127.0.0.1" or "::".
+		// IPv6 addresses, including the wildcard one, don't accept IPv4 connections.
+		static std::unique_ptr<Server> create_tcp_bound(Callbacks&, const std::string& address, uint16_t port, const Options& = {});
+
+		// Sends a block of data from a reference-counted buffer to several connections,
+		// e.g. to the subscribers of a topic. The buffer must not be modified until released.
+		// Connections using nonblocking sends (see Options::nonblocking_send) queue the buffer
+		// instead of copying it, so the memory used doesn't depend on the number of connections,
+		// and each server thread sends the data to all its connections at once.
+		// Other connections send it like Connection::send_zerocopy. May be called from any thread,
+		// including the callbacks. Returns the number of connections which have sent or queued the data.
+		static size_t broadcast(const std::shared_ptr<Connection>* connections, size_t count, const std::shared_ptr<const void>& data, size_t size);
+
 		virtual ~Server() = default;
+
+		// Calls the function from one of the server threads in the specified number of milliseconds,
+		// e.g. to enforce request deadlines or to do periodic work without a dedicated thread.
+		// May be called from any thread, including the callbacks and the scheduled functions.
+		// Returns false if the server isn't running. Calls still pending when the server stops aren't made.
+		virtual bool schedule(int milliseconds, std::function<void()>&&) = 0;
 	};
 }
@@ -1,5 +1,8 @@
 #include "address.h"
 
+#include <cstring>
+#include <fstream>
+#include <sstream>
 #include <system_error>
 
 #include <arpa/inet.h>
@@ -37,47 +40,110 @@ namespace ynet
 		{
 			::sockaddr_storage sockaddr = {};
 			if (addrinfo->ai_addr->sa_family == AF_INET)
-			{
-				::sockaddr_in& sockaddr_in = reinterpret_cast<::sockaddr_in&>(sockaddr);
-				sockaddr_in = *reinterpret_cast<const ::sockaddr_in*>(addrinfo->ai_addr);
-				sockaddr_in.sin_port = ::htons(port);
-			}
+				reinterpret_cast<::sockaddr_in&>(sockaddr) = *reinterpret_cast<const ::sockaddr_in*>(addrinfo->ai_addr);
 			else if (addrinfo->ai_addr->sa_family == AF_INET6)
-			{
-				::sockaddr_in6& sockaddr_in6 = reinterpret_cast<::sockaddr_in6&>(sockaddr);
-				sockaddr_in6 = *reinterpret_cast<const ::sockaddr_in6*>(addrinfo->ai_addr);
-				sockaddr_in6.sin6_port = ::htons(port);
-			}
+				reinterpret_cast<::sockaddr_in6&>(sockaddr) = *reinterpret_cast<const ::sockaddr_in6*>(addrinfo->ai_addr);
 			else
 				continue;
+			set_port(sockaddr, port);
+			addresses.emplace_back(sockaddr);
+		}
+		return addresses;
+	}
+
+	std::vector<::sockaddr_storage> resolve_from_file(const std::string& path, const std::string& host, uint16_t port)
+	{
+		const auto parse = [port](const std::string& text, std::vector<::sockaddr_storage>& addresses)
+		{
+			::sockaddr_storage sockaddr = {};
+			if (!parse_address(text, port, sockaddr))
+				return false;
 			addresses.emplace_back(sockaddr);
+			return true;
+		};
+
+		std::vector<::sockaddr_storage> addresses;
+		// Numeric addresses are resolved without looking them up, like getaddrinfo does.
+		if (parse(host, addresses))
+			return addresses;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line.substr(0, line.find('#')));
+			std::string address;
+			if (!(stream >> address))
+				continue;
+			for (std::string name; stream >> name; )
+			{
+				if (name == host)
+				{
+					parse(address, addresses);
+					break;
+				}
+			}
 		}
 		return addresses;
 	}
 
-	std::string to_string(const ::sockaddr_storage& sockaddr)
+	bool parse_address(const std::string& text, uint16_t port, ::sockaddr_storage& sockaddr)
+	{
+		sockaddr = {};
+		if (::inet_pton(AF_INET, text.c_str(), &reinterpret_cast<::sockaddr_in&>(sockaddr).sin_addr) == 1)
+			sockaddr.ss_family = AF_INET;
+		else if (::inet_pton(AF_INET6, text.c_str(), &reinterpret_cast<::sockaddr_in6&>(sockaddr).sin6_addr) == 1)
+			sockaddr.ss_family = AF_INET6;
+		else
+			return false;
+		set_port(sockaddr, port);
+		return true;
+	}
+
+	void set_port(::sockaddr_storage& sockaddr, uint16_t port)
+	{
+		if (sockaddr.ss_family == AF_INET)
+			reinterpret_cast<::sockaddr_in&>(sockaddr).sin_port = ::htons(port);
+		else if (sockaddr.ss_family == AF_INET6)
+			reinterpret_cast<::sockaddr_in6&>(sockaddr).sin6_port = ::htons(port);
+	}
+
+	Connection::Endpoint to_endpoint(const ::sockaddr_storage& sockaddr)
 	{
-		// Windows requires non-const inet_ntop address argument.
+		Connection::Endpoint endpoint;
 		switch (sockaddr.ss_family)
 		{
 		case AF_INET:
 			{
-				char buffer[INET_ADDRSTRLEN];
-				auto address = reinterpret_cast<const ::sockaddr_in&>(sockaddr).sin_addr;
-				if (!::inet_ntop(AF_INET, &address, buffer, INET_ADDRSTRLEN))
-					throw std::system_error(errno, std::generic_category());
-				return buffer;
+				const auto& sockaddr_in = reinterpret_cast<const ::sockaddr_in&>(sockaddr);
+				endpoint.port = ::ntohs(sockaddr_in.sin_port);
+				std::memcpy(endpoint.ip, &sockaddr_in.sin_addr, sizeof sockaddr_in.sin_addr);
+				return endpoint;
 			}
 		case AF_INET6:
 			{
-				char buffer[INET6_ADDRSTRLEN];
-				auto address = reinterpret_cast<const ::sockaddr_in6&>(sockaddr).sin6_addr;
-				if (!::inet_ntop(AF_INET6, &address, buffer, INET6_ADDRSTRLEN))
-					throw std::system_error(errno, std::generic_category());
-				return buffer;
+				const auto& sockaddr_in6 = reinterpret_cast<const ::sockaddr_in6&>(sockaddr);
+				endpoint.port = ::ntohs(sockaddr_in6.sin6_port);
+				// Dual-stack sockets represent IPv4 peers as IPv4-mapped IPv6 addresses (::ffff:a.b.c.d).
+				if (IN6_IS_ADDR_V4MAPPED(&sockaddr_in6.sin6_addr))
+					std::memcpy(endpoint.ip, sockaddr_in6.sin6_addr.s6_addr + 12, 4);
+				else
+				{
+					endpoint.family = Connection::Endpoint::Family::IPv6;
+					std::memcpy(endpoint.ip, sockaddr_in6.sin6_addr.s6_addr, sizeof sockaddr_in6.sin6_addr.s6_addr);
+				}
+				return endpoint;
 			}
 		default:
 			throw std::logic_error("Only IPv4/IPv6 addresses are supported");
 		}
 	}
+
+	std::string to_string(const Connection::Endpoint& endpoint)
+	{
+		char buffer[INET6_ADDRSTRLEN];
+		const auto family = endpoint.family == Connection::Endpoint::Family::IPv6 ? AF_INET6 : AF_INET;
+		if (!::inet_ntop(family, endpoint.ip, buffer, sizeof buffer))
+			throw std::system_error(errno, std::generic_category());
+		return buffer;
+	}
 }
@@ -4,10 +4,25 @@
 #include <string>
 #include <vector>
 
+#include <ynet.h>
+
 struct sockaddr_storage;
 
 namespace ynet
 {
+	// Resolves the host name using the system resolver.
 	std::vector<::sockaddr_storage> resolve(const std::string& host, uint16_t port);
-	std::string to_string(const ::sockaddr_storage&);
+
+	// Resolves the host name using a file in the /etc/hosts format.
+	std::vector<::sockaddr_storage> resolve_from_file(const std::string& path, const std::string& host, uint16_t port);
+
+	// Parses a numeric IPv4 or IPv6 address.
+	bool parse_address(const std::string&, uint16_t port, ::sockaddr_storage&);
+
+	void set_port(::sockaddr_storage&, uint16_t port);
+
+	// Converts IPv4-mapped IPv6 addresses to IPv4 ones.
+	Connection::Endpoint to_endpoint(const ::sockaddr_storage&);
+
+	std::string to_string(const Connection::Endpoint&);
 }
@@ -4,15 +4,58 @@
 
 namespace ynet
 {
-	void ServerBackend::Callbacks::on_received(const std::shared_ptr<Connection>& connection, void* buffer, size_t buffer_size, bool& disconnected)
+	void ServerBackend::Callbacks::on_received(const std::shared_ptr<Connection>& connection, ReceiveBuffer& buffer, Batch& batch, bool& disconnected)
 	{
 		for (;;)
 		{
-			const auto size = static_cast<ConnectionImpl*>(connection.get())->receive(buffer, buffer_size, &disconnected);
-			if (size > 0)
-				_callbacks.on_received(connection, buffer, size);
-			if (size < buffer_size)
+			const auto impl = static_cast<ReceivingConnection*>(connection.get());
+			buffer.renew(impl->min_receive_size());
+			const auto data = buffer.data();
+			const auto size_limit = buffer.size();
+			const auto size = impl->receive(data, size_limit, &disconnected);
+			buffer.consume(size);
+			impl->deliver_descriptors([this, &connection](const int* descriptors, size_t count){ _callbacks.on_received_descriptors(connection, descriptors, count); });
+			if (size > 0 && !on_received(connection, data, size, batch, &buffer))
+			{
+				disconnected = true;
+				break;
+			}
+			if (size < size_limit)
 				break;
 		}
 	}
+
+	bool ServerBackend::Callbacks::on_received(const std::shared_ptr<Connection>& connection, const void* data, size_t size, Batch& batch, const ReceiveBuffer* buffer)
+	{
+		const auto impl = static_cast<ConnectionImpl*>(connection.get());
+		if (_batch_received)
+			return impl->deliver(data, size, _framing, _max_message_size, buffer, [impl, &connection, &batch, buffer](const void* message, size_t message_size)
+			{
+				if (buffer && buffer->contains(message))
+				{
+					// Consecutive receives usually share the buffer.
+					if (batch._buffers.empty() || batch._buffers.back() != buffer->retain())
+						batch._buffers.emplace_back(buffer->retain());
+				}
+				else
+				{
+					batch._buffers.emplace_back(impl->retain_received());
+					message = batch._buffers.back().get();
+				}
+				batch._received.push_back({connection, message, message_size});
+			});
+		return impl->deliver(data, size, _framing, _max_message_size, buffer, [this, &connection](const void* message, size_t message_size)
+		{
+			_callbacks.on_received(connection, message, message_size);
+		});
+	}
+
+	void ServerBackend::Callbacks::on_received_batch(Batch& batch)
+	{
+		if (batch._received.empty())
+			return;
+		_callbacks.on_received_batch(batch._received.data(), batch._received.size());
+		batch._received.clear();
+		batch._buffers.clear();
+	}
 }
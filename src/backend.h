@@ -1,29 +1,63 @@
 #pragma once
 
+#include <vector>
+
 #include <ynet.h>
 
+#include "pool.h"
+
 namespace ynet
 {
 	class ServerBackend
 	{
 	public:
 
+		class Callbacks;
+
+		// Data received by a server thread during one loop iteration (see Server::Options::batch_received).
+		class Batch
+		{
+		public:
+			bool empty() const { return _received.empty(); }
+
+		private:
+			friend Callbacks;
+			std::vector<Server::Received> _received;
+			std::vector<std::shared_ptr<const void>> _buffers; // Keep the received data valid until the batch is passed.
+		};
+
 		class Callbacks
 		{
 		public:
-			Callbacks(Server::Callbacks& callbacks): _callbacks(callbacks) {}
+			Callbacks(Server::Callbacks& callbacks, const Server::Options& options)
+				: _callbacks(callbacks), _framing(options.framing), _max_message_size(options.max_message_size), _batch_received(options.batch_received) {}
 
 			void on_connected(const std::shared_ptr<Connection>& connection) { _callbacks.on_connected(connection); }
-			void on_received(const std::shared_ptr<Connection>&, void* buffer, size_t buffer_size, bool& disconnected);
+
+			// The received data is added to the batch instead of being passed to on_received if the server uses batches.
+			// The first overload receives the data from a ReceivingConnection.
+			void on_received(const std::shared_ptr<Connection>&, ReceiveBuffer&, Batch&, bool& disconnected);
+			bool on_received(const std::shared_ptr<Connection>&, const void* data, size_t size, Batch&, const ReceiveBuffer* = nullptr); // Returns false if the connection has been aborted.
+
+			// Passes the batched data to on_received_batch, if any, and clears the batch.
+			void on_received_batch(Batch&);
+
 			void on_disconnected(const std::shared_ptr<Connection>& connection) { _callbacks.on_disconnected(connection); }
+			void on_send_buffer_full(const std::shared_ptr<Connection>& connection) { _callbacks.on_send_buffer_full(connection); }
+			void on_writable(const std::shared_ptr<Connection>& connection) { _callbacks.on_writable(connection); }
+			void on_zerocopy_completed(const std::shared_ptr<Connection>& connection, const std::shared_ptr<const void>& data) { _callbacks.on_zerocopy_completed(connection, data); }
 
 		private:
 			Server::Callbacks& _callbacks;
+			const Framing _framing;
+			const size_t _max_message_size;
+			const bool _batch_received;
 		};
 
 		virtual ~ServerBackend() = default;
 
 		virtual void run(Callbacks&) = 0;
+		virtual void schedule(int milliseconds, std::function<void()>&&) = 0;
 		virtual void shutdown(int milliseconds) = 0;
 	};
 }
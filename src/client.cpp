@@ -7,7 +7,7 @@
 
 namespace ynet
 {
-	ClientImpl::ClientImpl(Callbacks& callbacks, const Options& options, const std::function<std::unique_ptr<ConnectionImpl>()>& factory)
+	ClientImpl::ClientImpl(Callbacks& callbacks, const Options& options, const std::function<std::unique_ptr<ReceivingConnection>()>& factory)
 		: _callbacks(callbacks)
 		, _options(options)
 		, _factory(factory)
@@ -45,7 +45,7 @@ namespace ynet
 	void ClientImpl::run()
 	{
 		_callbacks.on_started();
-		std::vector<uint8_t> receive_buffer;
+		std::unique_ptr<ReceiveBuffer> receive_buffer;
 		for (;;)
 		{
 			int reconnect_timeout = -1;
@@ -59,16 +59,24 @@ namespace ynet
 							break;
 						_connection = connection.get();
 					}
-					receive_buffer.resize(connection->receive_buffer_size());
+					if (!receive_buffer)
+						receive_buffer = std::make_unique<ReceiveBuffer>(connection->receive_buffer_size());
 					const std::shared_ptr<Connection> connection_ptr = std::move(connection);
 					// Note that the original connection pointer is no longer valid.
 					_callbacks.on_connected(connection_ptr);
+					const auto on_message = [this, &connection_ptr](const void* message, size_t message_size){ _callbacks.on_received(connection_ptr, message, message_size); };
+					const auto on_descriptors = [this, &connection_ptr](const int* descriptors, size_t count){ _callbacks.on_received_descriptors(connection_ptr, descriptors, count); };
 					for (;;)
 					{
-						const auto size = _connection->receive(receive_buffer.data(), receive_buffer.size(), nullptr);
+						receive_buffer->renew(_connection->min_receive_size());
+						const auto data = receive_buffer->data();
+						const auto size = _connection->receive(data, receive_buffer->size(), nullptr);
 						if (size == 0)
 							break;
-						_callbacks.on_received(connection_ptr, receive_buffer.data(), size);
+						receive_buffer->consume(size);
+						_connection->deliver_descriptors(on_descriptors);
+						if (!_connection->deliver(data, size, _options.framing, _options.max_message_size, receive_buffer.get(), on_message))
+							break;
 					}
 					// There is no point in graceful closure at this point
 					// because the connection is either closed or broken here.
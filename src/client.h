@@ -1,18 +1,19 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
 #include <thread>
 
 #include <ynet.h>
 
 namespace ynet
 {
-	class ConnectionImpl;
+	class ReceivingConnection;
 
 	class ClientImpl : public Client
 	{
 	public:
-		ClientImpl(Callbacks&, const Options&, const std::function<std::unique_ptr<ConnectionImpl>()>& factory);
+		ClientImpl(Callbacks&, const Options&, const std::function<std::unique_ptr<ReceivingConnection>()>& factory);
 		~ClientImpl() override;
 
 	private:
@@ -21,9 +22,9 @@ namespace ynet
 	private:
 		Callbacks& _callbacks;
 		const Options _options;
-		const std::function<std::unique_ptr<ConnectionImpl>()> _factory;
+		const std::function<std::unique_ptr<ReceivingConnection>()> _factory;
 		std::mutex _mutex;
-		ConnectionImpl* _connection = nullptr;
+		ReceivingConnection* _connection = nullptr;
 		bool _stopping = false;
 		std::condition_variable _stop_event;
 		std::condition_variable _disconnect_event;
@@ -0,0 +1,41 @@
+#include "connection.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "address.h"
+
+namespace ynet
+{
+	const std::string& ConnectionImpl::address() const
+	{
+		std::call_once(_address_formatted, [this]{ _address = to_string(_endpoint); });
+		return _address;
+	}
+
+	std::shared_ptr<const void> ConnectionImpl::retain_received()
+	{
+		if (!_received_data)
+			return {};
+		if (_receive_buffer && _receive_buffer->contains(_received_data))
+			return {_receive_buffer->retain(), _received_data};
+		// The data is in a buffer which is reused as soon as the callback returns.
+		const std::shared_ptr<uint8_t> copy(new uint8_t[std::max<size_t>(_received_size, 1)], std::default_delete<uint8_t[]>());
+		std::memcpy(copy.get(), _received_data, _received_size);
+		return copy;
+	}
+
+	ReceivingConnection::~ReceivingConnection()
+	{
+		discard_descriptors();
+	}
+
+	void ReceivingConnection::discard_descriptors()
+	{
+		for (const auto descriptor : _received_descriptors)
+			::close(descriptor);
+		_received_descriptors.clear();
+	}
+}
@@ -1,21 +1,95 @@
 #pragma once
 
+#include <mutex>
+#include <vector>
+
 #include <ynet.h>
 
+#include "framing.h"
+#include "pool.h"
+
 namespace ynet
 {
+	class Broadcast;
+
 	class ConnectionImpl : public Connection
 	{
 	public:
-		ConnectionImpl(std::string&& address) : _address(std::move(address)) {}
-		~ConnectionImpl() override = default;
+		ConnectionImpl(const Endpoint& endpoint) : _endpoint(endpoint) {}
+
+		const std::string& address() const override;
+		Endpoint endpoint() const override { return _endpoint; }
+		std::shared_ptr<const void> retain_received() final;
 
-		std::string address() const override { return _address; }
+		// Sends a block of a buffer shared with other connections (see Server::broadcast).
+		// Connections served by loops may only queue the block, adding themselves to the broadcast.
+		virtual bool broadcast(const std::shared_ptr<const void>& data, size_t size, Broadcast&) { return send_zerocopy(data, size); }
+
+		// Passes the received data to the function, message by message if the connection uses framing.
+		// Aborts the connection and returns false if the data violates the framing.
+		// The data may be retained without copying if it is in the receive buffer.
+		template <typename Function>
+		bool deliver(const void* data, size_t size, Framing framing, size_t max_message_size, const ReceiveBuffer* buffer, Function&& function)
+		{
+			_receive_buffer = buffer;
+			const auto on_message = [this, &function](const void* message, size_t message_size)
+			{
+				_received_data = message;
+				_received_size = message_size;
+				function(message, message_size);
+				_received_data = nullptr;
+			};
+			if (framing == Framing::None)
+			{
+				on_message(data, size);
+				return true;
+			}
+			if (!_deframer)
+				_deframer = std::make_unique<Deframer>(framing, max_message_size);
+			if (_deframer->process(data, size, on_message))
+				return true;
+			abort();
+			return false;
+		}
+
+	private:
+		const Endpoint _endpoint;
+		mutable std::once_flag _address_formatted;
+		mutable std::string _address; // Formatted on demand, because most connections never need it.
+		const ReceiveBuffer* _receive_buffer = nullptr;
+		const void* _received_data = nullptr;
+		size_t _received_size = 0;
+		std::unique_ptr<Deframer> _deframer; // Created on the first delivery.
+	};
+
+	// A connection which receives the data when asked, unlike the ones whose data is received by the loop serving them.
+	class ReceivingConnection : public ConnectionImpl
+	{
+	public:
+		using ConnectionImpl::ConnectionImpl;
+		~ReceivingConnection() override;
 
 		virtual size_t receive(void* data, size_t size, bool* disconnected) = 0;
 		virtual size_t receive_buffer_size() const = 0;
 
-	private:
-		const std::string _address;
+		// Returns the size of the free buffer space 'receive' must be given for the received messages
+		// not to be truncated, or zero if the connection doesn't preserve message boundaries.
+		virtual size_t min_receive_size() const { return 0; }
+
+		// Passes the file descriptors received with the last data to the function, which takes their ownership.
+		template <typename Function>
+		void deliver_descriptors(Function&& function)
+		{
+			if (_received_descriptors.empty())
+				return;
+			function(_received_descriptors.data(), _received_descriptors.size());
+			_received_descriptors.clear();
+		}
+
+		// Closes the file descriptors received with the data being discarded.
+		void discard_descriptors();
+
+	protected:
+		std::vector<int> _received_descriptors; // Received by 'receive', owned until delivered.
 	};
 }
@@ -0,0 +1,137 @@
+#include "connector.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+namespace
+{
+	// Alternates address families starting with the one preferred by the resolver,
+	// so that a broken family doesn't delay connecting by more than one attempt.
+	void interleave_families(std::vector<ynet::Connector::Target>& targets)
+	{
+		if (targets.empty())
+			return;
+		const auto first_family = targets.front().sockaddr.ss_family;
+		std::vector<ynet::Connector::Target> first;
+		std::vector<ynet::Connector::Target> second;
+		for (auto& target : targets)
+			(target.sockaddr.ss_family == first_family ? first : second).emplace_back(std::move(target));
+		targets.clear();
+		for (size_t i = 0; i < std::max(first.size(), second.size()); ++i)
+		{
+			if (i < first.size())
+				targets.emplace_back(std::move(first[i]));
+			if (i < second.size())
+				targets.emplace_back(std::move(second[i]));
+		}
+	}
+}
+
+namespace ynet
+{
+	constexpr std::chrono::milliseconds Connector::AttemptDelay;
+
+	Connector::Connector(std::vector<Target>&& targets, SocketConnection::Transport transport, const SocketOptions& options)
+		: _targets(std::move(targets))
+		, _transport(transport)
+		, _options(options)
+	{
+		interleave_families(_targets);
+	}
+
+	int Connector::start_attempt()
+	{
+		while (_next_target < _targets.size())
+		{
+			const auto target = _next_target++;
+			const auto& sockaddr = _targets[target].sockaddr;
+			const auto tcp = _transport == SocketConnection::Transport::Tcp;
+			// The family may be unsupported, e.g. if IPv6 is disabled.
+			const auto type = !tcp && _options.seqpacket ? SOCK_SEQPACKET : SOCK_STREAM;
+			const auto socket = ::socket(sockaddr.ss_family, type | SOCK_NONBLOCK, tcp ? IPPROTO_TCP : 0);
+			if (socket == -1)
+				continue;
+			Socket attempt_socket(socket);
+			// The receive buffer size should be set before connecting for the TCP window to be scaled accordingly.
+			if (!set_buffer_sizes(socket, _options) || (tcp && !set_tcp_options(socket, _options)))
+				continue;
+			// Local sockets either connect immediately or fail with EAGAIN if the server backlog is full.
+			if (::connect(socket, reinterpret_cast<const ::sockaddr*>(&sockaddr), _targets[target].sockaddr_size) == -1 && errno != EINPROGRESS)
+				continue;
+			_attempts.push_back({std::move(attempt_socket), target});
+			return socket;
+		}
+		return -1;
+	}
+
+	std::unique_ptr<SocketConnection> Connector::complete_attempt(int socket)
+	{
+		const auto attempt = std::find_if(_attempts.begin(), _attempts.end(), [socket](const Attempt& attempt){ return attempt.socket.get() == socket; });
+		if (attempt == _attempts.end())
+			return {};
+		int error = 0;
+		auto error_size = static_cast<socklen_t>(sizeof error);
+		if (::getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &error_size) == -1 || error)
+		{
+			_attempts.erase(attempt);
+			return {};
+		}
+		// Connections are blocking unless they enable nonblocking sends.
+		if (::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL) & ~O_NONBLOCK) == -1)
+			throw std::system_error(errno, std::generic_category());
+		auto connection = std::make_unique<SocketConnection>(_targets[attempt->target].endpoint, std::move(attempt->socket), SocketConnection::Side::Client, _transport, _options);
+		_attempts.erase(attempt);
+		if (_transport == SocketConnection::Transport::Local && _options.shared_memory_size > 0 && !_options.seqpacket && !connection->enable_shared_memory(_options.shared_memory_size))
+			return {};
+		return connection;
+	}
+
+	std::vector<int> Connector::sockets() const
+	{
+		std::vector<int> sockets;
+		sockets.reserve(_attempts.size());
+		for (const auto& attempt : _attempts)
+			sockets.emplace_back(attempt.socket.get());
+		return sockets;
+	}
+
+	std::unique_ptr<SocketConnection> Connector::connect(std::chrono::milliseconds timeout)
+	{
+		const auto deadline = timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max();
+		auto next_attempt = Clock::now();
+		std::vector<::pollfd> fds;
+		for (;;)
+		{
+			const auto now = Clock::now();
+			if (next_attempt <= now)
+				next_attempt = start_attempt() != -1 && has_targets() ? now + AttemptDelay : Clock::time_point::max();
+			if (_attempts.empty() || now >= deadline)
+				return {};
+			fds.clear();
+			for (const auto& attempt : _attempts)
+				fds.push_back({attempt.socket.get(), POLLOUT, 0});
+			const auto wakeup = std::min(deadline, next_attempt);
+			// Rounding up prevents waking up just before the time and waiting again with zero timeout.
+			const auto wait = wakeup == Clock::time_point::max() ? -1
+				: static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wakeup - now + std::chrono::milliseconds{1} - Clock::duration{1}).count());
+			if (::poll(fds.data(), fds.size(), wait) == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				throw std::system_error(errno, std::generic_category());
+			}
+			for (const auto& fd : fds)
+			{
+				if (!fd.revents)
+					continue;
+				if (auto connection = complete_attempt(fd.fd))
+					return connection;
+				// A failed attempt is replaced immediately.
+				next_attempt = Clock::now();
+			}
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+
+#include <sys/socket.h>
+
+#include "socket.h"
+
+namespace ynet
+{
+	// Connects to one of the target addresses using nonblocking sockets.
+	// A new attempt is started when the previous one fails or doesn't complete in time,
+	// without abandoning the attempts in progress ("Happy Eyeballs", RFC 8305).
+	class Connector
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Target
+		{
+			::sockaddr_storage sockaddr;
+			socklen_t sockaddr_size;
+			Connection::Endpoint endpoint; // Peer address of the connection.
+		};
+
+		// Time to wait for an attempt to complete before starting the next one.
+		static constexpr std::chrono::milliseconds AttemptDelay{250};
+
+		Connector(std::vector<Target>&&, SocketConnection::Transport, const SocketOptions&);
+
+		// Starts connecting to the next target, skipping the ones which fail immediately.
+		// Returns the socket to wait for writability, or -1 if there are no more targets.
+		int start_attempt();
+
+		// Checks the result of the attempt when its socket becomes writable or fails.
+		// Returns the connection if the attempt has succeeded, otherwise closes the socket.
+		std::unique_ptr<SocketConnection> complete_attempt(int socket);
+
+		// Returns the sockets of the attempts in progress.
+		std::vector<int> sockets() const;
+
+		bool has_attempts() const { return !_attempts.empty(); }
+		bool has_targets() const { return _next_target < _targets.size(); }
+
+		// Connects synchronously. Zero timeout means no limit besides the system one.
+		std::unique_ptr<SocketConnection> connect(std::chrono::milliseconds timeout);
+
+	private:
+		struct Attempt
+		{
+			Socket socket;
+			size_t target;
+		};
+
+		std::vector<Target> _targets;
+		const SocketConnection::Transport _transport;
+		const SocketOptions _options;
+		size_t _next_target = 0;
+		std::list<Attempt> _attempts;
+	};
+}
@@ -0,0 +1,262 @@
+#include "context.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "socket.h"
+
+namespace ynet
+{
+	ClientContextImpl::ClientContextImpl(const Options& options)
+		: _resolver([]
+		{
+			Resolver::Options resolver_options;
+			resolver_options.ttl = 0;
+			resolver_options.negative_ttl = 0;
+			return resolver_options;
+		}())
+	{
+		const auto threads = options.threads > 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+		_loops.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			_loops.emplace_back(std::make_unique<EventLoop>(std::max<size_t>(options.receive_buffer_size, 1)));
+		_threads.reserve(threads);
+		for (const auto& loop : _loops)
+			_threads.emplace_back([&loop]{ loop->run(); });
+	}
+
+	ClientContextImpl::~ClientContextImpl()
+	{
+		// The loops exit as soon as the connections left by the destroyed clients are closed.
+		for (const auto& loop : _loops)
+			loop->stop();
+		for (auto& thread : _threads)
+			thread.join();
+	}
+
+	EventLoop& ClientContextImpl::next_loop()
+	{
+		return *_loops[_next_loop++ % _loops.size()];
+	}
+
+	ContextClient::ContextClient(Callbacks& callbacks, const Options& options, const Factory& factory)
+		: _callbacks(callbacks)
+		, _options(options)
+		, _factory(factory)
+		, _loop(static_cast<ClientContextImpl*>(options.context)->next_loop())
+	{
+		_loop.post([this]
+		{
+			_callbacks.on_started();
+			connect();
+		});
+	}
+
+	ContextClient::~ContextClient()
+	{
+		_loop.post([this]{ stop(); });
+		std::unique_lock<std::mutex> lock(_mutex);
+		_release_event.wait(lock, [this]{ return _released; });
+	}
+
+	void ContextClient::on_connected(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_callbacks.on_connected(connection);
+	}
+
+	void ContextClient::on_received(const std::shared_ptr<SocketConnection>& connection, ReceiveBuffer& buffer, bool& disconnected)
+	{
+		const auto on_message = [this, &connection](const void* message, size_t message_size){ _callbacks.on_received(connection, message, message_size); };
+		const auto on_descriptors = [this, &connection](const int* descriptors, size_t count){ _callbacks.on_received_descriptors(connection, descriptors, count); };
+		for (;;)
+		{
+			buffer.renew(connection->min_receive_size());
+			const auto data = buffer.data();
+			const auto size_limit = std::min(buffer.size(), connection->receive_buffer_size());
+			const auto size = connection->receive(data, size_limit, &disconnected);
+			buffer.consume(size);
+			connection->deliver_descriptors(on_descriptors);
+			if (size > 0 && !connection->deliver(data, size, _options.framing, _options.max_message_size, &buffer, on_message))
+			{
+				disconnected = true;
+				break;
+			}
+			if (size < size_limit)
+				break;
+		}
+	}
+
+	void ContextClient::on_disconnected(const std::shared_ptr<SocketConnection>& connection)
+	{
+		// There is no point in graceful closure at this point
+		// because the connection is either closed or broken here.
+		connection->abort();
+		_connection.reset();
+		cancel_timer(_timer);
+		int reconnect_timeout = -1;
+		_callbacks.on_disconnected(connection, reconnect_timeout);
+		retry(reconnect_timeout);
+	}
+
+	void ContextClient::on_send_buffer_full(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_callbacks.on_send_buffer_full(connection);
+	}
+
+	void ContextClient::on_writable(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_callbacks.on_writable(connection);
+	}
+
+	void ContextClient::cancel_timer(EventLoop::Timer& timer)
+	{
+		if (timer)
+		{
+			_loop.cancel(timer);
+			timer = {};
+		}
+	}
+
+	void ContextClient::complete_attempt(int socket)
+	{
+		auto connection = _connector->complete_attempt(socket);
+		if (!connection)
+		{
+			// A failed attempt is replaced immediately.
+			start_attempt();
+			return;
+		}
+		reset_connector();
+		connection->enable_nonblocking_receive();
+		if (_options.nonblocking_send)
+		{
+			const auto high_water_mark = std::max<size_t>(_options.send_high_water_mark, 1);
+			connection->enable_output_queue(_loop, high_water_mark, std::min(_options.send_low_water_mark, high_water_mark - 1), false);
+		}
+		_connection = std::move(connection);
+		_loop.add(std::shared_ptr<SocketConnection>(_connection), *this);
+	}
+
+	void ContextClient::connect()
+	{
+		_creating_connector = true;
+		_factory([this](const std::shared_ptr<Connector>& connector)
+		{
+			if (_loop.is_current())
+				start_connecting(connector);
+			else
+				_loop.post([this, connector]{ start_connecting(connector); });
+		});
+	}
+
+	void ContextClient::fail_to_connect()
+	{
+		reset_connector();
+		int reconnect_timeout = -1;
+		_callbacks.on_failed_to_connect(reconnect_timeout);
+		retry(reconnect_timeout);
+	}
+
+	void ContextClient::release()
+	{
+		// The client may be destroyed as soon as the mutex is unlocked.
+		std::lock_guard<std::mutex> lock(_mutex);
+		_released = true;
+		_release_event.notify_one();
+	}
+
+	void ContextClient::reset_connector()
+	{
+		if (!_connector)
+			return;
+		for (const auto socket : _connector->sockets())
+			_loop.unwatch(socket);
+		_connector.reset();
+		cancel_timer(_timer);
+		cancel_timer(_connect_timer);
+	}
+
+	void ContextClient::retry(int reconnect_timeout)
+	{
+		if (reconnect_timeout >= 0 && !_stopping)
+		{
+			start_timer(_timer, std::chrono::milliseconds(reconnect_timeout), [this]{ connect(); });
+			return;
+		}
+		_stopped = true;
+		_callbacks.on_stopped();
+		if (_stopping)
+			release();
+	}
+
+	void ContextClient::start_attempt()
+	{
+		cancel_timer(_timer);
+		const auto socket = _connector->start_attempt();
+		if (socket == -1)
+		{
+			if (!_connector->has_attempts())
+				fail_to_connect();
+			return;
+		}
+		_loop.watch(socket, [this, socket]{ complete_attempt(socket); });
+		if (_connector->has_targets())
+			start_timer(_timer, Connector::AttemptDelay, [this]{ start_attempt(); });
+	}
+
+	void ContextClient::start_connecting(const std::shared_ptr<Connector>& connector)
+	{
+		_creating_connector = false;
+		if (_stopping)
+		{
+			retry(-1);
+			return;
+		}
+		_connector = connector;
+		if (_options.connect_timeout > 0)
+			start_timer(_connect_timer, std::chrono::milliseconds(_options.connect_timeout), [this]{ fail_to_connect(); });
+		start_attempt();
+	}
+
+	void ContextClient::start_timer(EventLoop::Timer& timer, EventLoop::Clock::duration duration, std::function<void()>&& function)
+	{
+		assert(!timer);
+		timer = _loop.schedule(EventLoop::Clock::now() + duration, [&timer, function = std::move(function)]
+		{
+			timer = {};
+			function();
+		});
+	}
+
+	void ContextClient::stop()
+	{
+		_stopping = true;
+		if (_stopped)
+		{
+			release();
+			return;
+		}
+		if (_creating_connector)
+		{
+			// The client stops when the connector is created.
+			return;
+		}
+		if (!_connection)
+		{
+			// The client is either connecting or waiting to reconnect.
+			reset_connector();
+			cancel_timer(_timer);
+			retry(-1);
+			return;
+		}
+		// The client stops when the connection is closed.
+		if (_options.shutdown_timeout == 0)
+			_connection->abort();
+		else
+		{
+			_connection->shutdown();
+			if (_options.shutdown_timeout > 0)
+				start_timer(_timer, std::chrono::milliseconds(_options.shutdown_timeout), [this]{ _connection->abort(); });
+		}
+	}
+}
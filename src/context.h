@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+
+#include <ynet.h>
+
+#include "connector.h"
+#include "loop.h"
+#include "resolver.h"
+
+namespace ynet
+{
+	class ClientContextImpl : public ClientContext
+	{
+	public:
+		explicit ClientContextImpl(const Options&);
+		~ClientContextImpl() override;
+
+		// Returns the loop to serve the next client.
+		EventLoop& next_loop();
+
+		// Returns the resolver for the clients which don't have one.
+		ResolverImpl& resolver() { return _resolver; }
+
+	private:
+		ResolverImpl _resolver;
+		std::vector<std::unique_ptr<EventLoop>> _loops;
+		std::vector<std::thread> _threads;
+		std::atomic<size_t> _next_loop{0};
+	};
+
+	// Client served by a context loop.
+	class ContextClient
+		: public Client
+		, private EventLoop::Handler
+	{
+	public:
+		// Creates a connector and passes it to the callback, possibly from another thread
+		// (e.g. after resolving the host name asynchronously).
+		using Factory = std::function<void(const std::function<void(const std::shared_ptr<Connector>&)>&)>;
+
+		ContextClient(Callbacks&, const Options&, const Factory&);
+		~ContextClient() override;
+
+	private:
+		void on_connected(const std::shared_ptr<SocketConnection>&) override;
+		void on_received(const std::shared_ptr<SocketConnection>&, ReceiveBuffer&, bool& disconnected) override;
+		void on_disconnected(const std::shared_ptr<SocketConnection>&) override;
+		void on_send_buffer_full(const std::shared_ptr<SocketConnection>&) override;
+		void on_writable(const std::shared_ptr<SocketConnection>&) override;
+
+		void cancel_timer(EventLoop::Timer&);
+		void complete_attempt(int socket);
+		void connect();
+		void fail_to_connect();
+		void release();
+		void reset_connector();
+		void retry(int reconnect_timeout);
+		void start_attempt();
+		void start_connecting(const std::shared_ptr<Connector>&);
+		void start_timer(EventLoop::Timer&, EventLoop::Clock::duration, std::function<void()>&&);
+		void stop();
+
+	private:
+		Callbacks& _callbacks;
+		const Options _options;
+		const Factory _factory;
+		EventLoop& _loop;
+		// The following members are accessed only from the loop thread.
+		bool _creating_connector = false;
+		std::shared_ptr<Connector> _connector;
+		std::shared_ptr<SocketConnection> _connection;
+		bool _stopping = false;
+		bool _stopped = false;
+		// Inactive timers are default-constructed.
+		EventLoop::Timer _timer; // Next connection attempt, reconnection or shutdown timeout.
+		EventLoop::Timer _connect_timer;
+		// The loop doesn't reference the client after it has been released.
+		std::mutex _mutex;
+		bool _released = false;
+		std::condition_variable _release_event;
+	};
+}
@@ -0,0 +1,70 @@
+#include "framing.h"
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+
+namespace ynet
+{
+	size_t write_frame_prefix(Framing framing, size_t message_size, void* buffer)
+	{
+		const auto bytes = static_cast<uint8_t*>(buffer);
+		switch (framing)
+		{
+		case Framing::None:
+			return 0;
+		case Framing::Varint:
+			{
+				size_t size = 0;
+				for (; message_size >= 0x80; message_size >>= 7)
+					bytes[size++] = static_cast<uint8_t>(message_size | 0x80);
+				bytes[size++] = static_cast<uint8_t>(message_size);
+				return size;
+			}
+		case Framing::Fixed32:
+			if (message_size > UINT32_MAX)
+				throw std::length_error("Message is too large for a 32-bit prefix");
+			bytes[0] = static_cast<uint8_t>(message_size >> 24);
+			bytes[1] = static_cast<uint8_t>(message_size >> 16);
+			bytes[2] = static_cast<uint8_t>(message_size >> 8);
+			bytes[3] = static_cast<uint8_t>(message_size);
+			return 4;
+		}
+		return 0;
+	}
+
+	Deframer::Prefix Deframer::read_prefix(const uint8_t*& data, size_t& size)
+	{
+		assert(_framing != Framing::None);
+		while (size > 0)
+		{
+			const auto byte = *data++;
+			--size;
+			bool complete = false;
+			if (_framing == Framing::Varint)
+			{
+				// The last byte may only contain the highest bit of a 64-bit value.
+				if (_prefix_bytes == MaxFramePrefixSize - 1 && byte > 1)
+					return Prefix::Invalid;
+				_prefix_value |= static_cast<uint64_t>(byte & 0x7f) << (7 * _prefix_bytes++);
+				complete = !(byte & 0x80);
+			}
+			else
+			{
+				_prefix_value = _prefix_value << 8 | byte;
+				complete = ++_prefix_bytes == 4;
+			}
+			// The value only grows with each byte, so oversized messages are detected early.
+			if (_prefix_value > _max_message_size)
+				return Prefix::Invalid;
+			if (complete)
+			{
+				_message_size = static_cast<size_t>(_prefix_value);
+				_prefix_value = 0;
+				_prefix_bytes = 0;
+				return Prefix::Complete;
+			}
+		}
+		return Prefix::Incomplete;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <ynet.h>
+
+namespace ynet
+{
+	// Splits the received data into messages, copying only the ones received in several parts.
+	class Deframer
+	{
+	public:
+		Deframer(Framing framing, size_t max_message_size) : _framing(framing), _max_message_size(max_message_size) {}
+
+		// Calls the function for each message completed by the data.
+		// Returns false if the data contains an invalid prefix or a message is too large.
+		template <typename Function>
+		bool process(const void* data, size_t size, Function&& function)
+		{
+			auto bytes = static_cast<const uint8_t*>(data);
+			while (size > 0)
+			{
+				if (_reassembling)
+				{
+					const auto part_size = std::min(size, _message_size - _message.size());
+					_message.insert(_message.end(), bytes, bytes + part_size);
+					bytes += part_size;
+					size -= part_size;
+					if (_message.size() < _message_size)
+						break;
+					_reassembling = false;
+					function(_message.data(), _message.size());
+					_message.clear();
+					continue;
+				}
+				switch (read_prefix(bytes, size))
+				{
+				case Prefix::Incomplete: return true;
+				case Prefix::Invalid: return false;
+				case Prefix::Complete: break;
+				}
+				if (_message_size <= size)
+				{
+					// The message is passed directly from the receive buffer.
+					function(bytes, _message_size);
+					bytes += _message_size;
+					size -= _message_size;
+				}
+				else
+				{
+					_message.reserve(_message_size);
+					_message.assign(bytes, bytes + size);
+					_reassembling = true;
+					break;
+				}
+			}
+			return true;
+		}
+
+	private:
+		enum class Prefix
+		{
+			Incomplete,
+			Complete,
+			Invalid,
+		};
+
+		// Consumes the bytes of the message size prefix, setting the message size when it is complete.
+		Prefix read_prefix(const uint8_t*& data, size_t& size);
+
+	private:
+		const Framing _framing;
+		const size_t _max_message_size;
+		uint64_t _prefix_value = 0;
+		unsigned _prefix_bytes = 0;
+		size_t _message_size = 0;
+		bool _reassembling = false;
+		std::vector<uint8_t> _message;
+	};
+}
@@ -0,0 +1,784 @@
+#include "inprocess.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <unistd.h>
+
+#include "backend.h"
+#include "connection.h"
+#include "socket.h"
+#include "timer.h"
+
+namespace
+{
+	// Amount of data a blocking sender may get ahead of the receiver by if its socket options
+	// don't specify the kernel send buffer size, comparable to the default socket buffer sizes.
+	constexpr size_t DefaultPipeCapacity = 256 * 1024;
+
+	size_t pipe_capacity(const ynet::SocketOptions& options)
+	{
+		return options.kernel_send_buffer_size > 0 ? static_cast<size_t>(options.kernel_send_buffer_size) : DefaultPipeCapacity;
+	}
+}
+
+namespace ynet
+{
+	// In-process connections pretend to come from the IPv4 loopback address like local ones.
+	const Connection::Endpoint InprocessEndpoint{Connection::Endpoint::Family::IPv4, 0, {127, 0, 0, 1}};
+
+	class InprocessLoop;
+	class InprocessServer;
+
+	// Data sent in one direction of a connection and not yet received.
+	struct InprocessPipe
+	{
+		std::vector<uint8_t> data;
+		size_t offset = 0; // Start of the unread data.
+		size_t capacity = 0; // Blocking sends wait for free space. Zero means nonblocking sends.
+		size_t high_water_mark = 0;
+		size_t low_water_mark = 0;
+		bool full = false; // Reached the high water mark and hasn't drained to the low one since.
+		bool closed = false; // Nothing more is sent, because the sender has shut down or the receiver is gone.
+
+		size_t size() const { return data.size() - offset; }
+
+		void write(const void* block, size_t block_size)
+		{
+			// The read data is dropped once there is more of it than of the unread one,
+			// so each byte is moved at most once on average.
+			if (offset > 0 && offset >= size())
+			{
+				data.erase(data.begin(), data.begin() + offset);
+				offset = 0;
+			}
+			const auto bytes = static_cast<const uint8_t*>(block);
+			data.insert(data.end(), bytes, bytes + block_size);
+		}
+
+		size_t read(void* buffer, size_t buffer_size)
+		{
+			const auto read_size = std::min(buffer_size, size());
+			if (!read_size)
+				return 0;
+			std::memcpy(buffer, data.data() + offset, read_size);
+			offset += read_size;
+			if (offset == data.size())
+			{
+				data.clear();
+				offset = 0;
+			}
+			return read_size;
+		}
+
+		void close()
+		{
+			closed = true;
+			data.clear();
+			offset = 0;
+		}
+	};
+
+	// State shared by both sides of a connection. The client side waits for the changes made by the server side
+	// using the condition variable, and the server side is checked by its loop when the client side notifies it.
+	struct InprocessChannel
+	{
+		std::mutex mutex;
+		std::condition_variable changed; // Data to receive, free space to send, or the connection closing.
+		InprocessPipe to_client;
+		InprocessPipe to_server;
+		std::weak_ptr<InprocessLoop> loop; // Serving the server side until it's erased from the loop.
+		uint64_t id = 0; // Identifies the server side in the loop.
+		bool notified = false; // The loop has a pending notification about the server side.
+		bool active = false; // Data has been sent or received since the loop has checked the idle timeout.
+
+		// Makes the loop check the server side. Must be called with the mutex locked.
+		// Returns the loop to wake using 'unlock_and_wake', if any.
+		std::shared_ptr<InprocessLoop> notify_loop();
+
+		// Unlocks the mutex and wakes the threads waiting for the changes. The waiting threads are woken
+		// after unlocking, so that they don't have to wait for the mutex right away.
+		void unlock_and_wake(std::unique_lock<std::mutex>&, const std::shared_ptr<InprocessLoop>& notified_loop = {});
+	};
+
+	class InprocessConnection : public ReceivingConnection
+	{
+	public:
+		enum class Side
+		{
+			Client,
+			Server,
+		};
+
+		InprocessConnection(const std::shared_ptr<InprocessChannel>& channel, Side side, size_t receive_buffer_size)
+			: ReceivingConnection{InprocessEndpoint}
+			, _channel{channel}
+			, _side{side}
+			, _input{side == Side::Client ? channel->to_client : channel->to_server}
+			, _output{side == Side::Client ? channel->to_server : channel->to_client}
+			, _receive_buffer_size{receive_buffer_size}
+		{
+		}
+
+		~InprocessConnection() override;
+
+		void abort() override;
+		bool send(const void* data, size_t size) override;
+		bool send(const Block* blocks, size_t count) override;
+		bool send_zerocopy(const std::shared_ptr<const void>& data, size_t size) override { return send(data.get(), size); }
+		bool send_file(int file, uint64_t offset, size_t size) override;
+		bool send_descriptors(const void*, size_t, const int*, size_t) override { return false; } // There is no socket to pass them through.
+		size_t pending_bytes() const override;
+		void set_idle_timeout(int milliseconds) override;
+		void shutdown() override;
+
+		// Client sides wait for data to receive, server sides only check for it.
+		size_t receive(void* data, size_t size, bool* disconnected) override;
+		size_t receive_buffer_size() const override { return _receive_buffer_size; }
+
+		// The server side notifications are identified by the connection ID.
+		uint64_t id() const { return _channel->id; }
+
+		bool is_output_full() const;
+
+		// Lets the peer notify the loop again. Must be called before the loop checks the connection.
+		void take_notification();
+
+		// Returns true if data has been sent or received since the previous call.
+		bool take_active();
+
+		// Stops notifying the loop. Must be called before the connection is erased from the loop.
+		void detach_loop();
+
+	private:
+		const std::shared_ptr<InprocessChannel> _channel;
+		const Side _side;
+		InprocessPipe& _input;
+		InprocessPipe& _output;
+		const size_t _receive_buffer_size;
+	};
+
+	// Serves a set of in-process connections in a single thread.
+	class InprocessLoop
+	{
+	public:
+		using Clock = TimerWheel::Clock;
+
+		explicit InprocessLoop(size_t buffer_size);
+		~InprocessLoop();
+
+		// Adds a connection to the loop from any thread.
+		void post(std::shared_ptr<InprocessConnection>&&);
+
+		// Calls the function from the loop thread. May be called from any thread.
+		void post(std::function<void()>&&);
+
+		// Makes the loop check the connection for received data, disconnection and output queue state changes
+		// once woken. May be called from any thread.
+		void notify(uint64_t id);
+
+		// Wakes the loop to process the notifications. May be called from any thread.
+		void wake() { _wakeup.notify_one(); }
+
+		// Calls the function from the loop thread at the specified time. Must be called from the loop thread.
+		void schedule(Clock::time_point, std::function<void()>&&);
+
+		// Makes the loop abort the connection once it has been idle for the specified time,
+		// starting from now. Zero disables the timeout. May be called from any thread.
+		void set_idle_timeout(uint64_t id, int milliseconds);
+
+		// Gracefully shuts down all connections, aborting the ones still open at the deadline.
+		// The loop exits when all connections are closed. May be called from any thread.
+		void stop(Clock::time_point deadline = Clock::time_point::max());
+
+		void run(ServerBackend::Callbacks&);
+
+		bool is_current() const { return std::this_thread::get_id() == _thread; }
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<InprocessConnection> connection;
+			bool full = false; // The output queue was reported as full.
+			Clock::duration idle_timeout{};
+			Clock::time_point last_active; // Last time the peer has sent or received data.
+			TimerWheel::Timer idle_timer;
+		};
+
+		void abort_all();
+		void add(std::shared_ptr<InprocessConnection>&&);
+		void erase(Entry&);
+		void expire_idle(Entry&);
+		void process(uint64_t id);
+		void process_posted();
+
+	private:
+		ReceiveBuffer _buffer;
+		ServerBackend::Callbacks* _callbacks = nullptr;
+		ServerBackend::Batch _batch;
+		std::thread::id _thread;
+		PooledMap<uint64_t, Entry> _connections = create_pooled_map<uint64_t, Entry>();
+		TimerWheel _timers;
+		Clock::time_point _now; // Time the current iteration has started.
+		std::vector<uint64_t> _processing; // Notifications being processed.
+		bool _stopping = false;
+		bool _aborting = false; // The shutdown deadline has expired.
+		Clock::time_point _abort_time = Clock::time_point::max();
+		TimerWheel::Timer _abort_timer;
+		std::mutex _mutex;
+		std::condition_variable _wakeup;
+		bool _woken = false;
+		std::vector<std::shared_ptr<InprocessConnection>> _posted;
+		std::vector<std::function<void()>> _tasks;
+		std::vector<uint64_t> _notified;
+		bool _stop_requested = false;
+		Clock::time_point _stop_deadline = Clock::time_point::max();
+	};
+
+	class InprocessServer : public ServerBackend
+	{
+	public:
+		InprocessServer(const std::string& name, const Server::Options&);
+		~InprocessServer() override;
+
+		void run(Callbacks&) final;
+		void schedule(int milliseconds, std::function<void()>&&) final;
+		void shutdown(int milliseconds) final;
+
+		// Creates a connection, passing its server side to one of the loops and returning the client side.
+		// Must be called with the registry locked.
+		std::unique_ptr<ReceivingConnection> accept(const SocketOptions& client_options);
+
+	private:
+		void unregister();
+
+	private:
+		const std::string _name;
+		const SocketOptions _socket_options;
+		const size_t _send_high_water_mark; // Zero for blocking sends.
+		const size_t _send_low_water_mark;
+		const std::shared_ptr<BufferPool> _connection_pool; // Server sides of the connections are allocated from it.
+		std::vector<std::shared_ptr<InprocessLoop>> _loops; // Connections only reference them weakly.
+		size_t _next_loop = 0;
+		size_t _next_timer_loop = 0;
+		uint64_t _last_id = 0;
+	};
+}
+
+namespace
+{
+	// Servers accepting in-process connections. The names are separate from the local socket ones.
+	struct Registry
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, ynet::InprocessServer*> servers;
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+}
+
+namespace ynet
+{
+	std::shared_ptr<InprocessLoop> InprocessChannel::notify_loop()
+	{
+		if (notified)
+			return {};
+		auto locked_loop = loop.lock();
+		if (!locked_loop)
+			return {};
+		notified = true;
+		locked_loop->notify(id);
+		return locked_loop;
+	}
+
+	void InprocessChannel::unlock_and_wake(std::unique_lock<std::mutex>& lock, const std::shared_ptr<InprocessLoop>& notified_loop)
+	{
+		lock.unlock();
+		changed.notify_all();
+		if (notified_loop)
+			notified_loop->wake();
+	}
+
+	InprocessConnection::~InprocessConnection()
+	{
+		// Like closing a socket, this lets the peer receive the data sent so far, but not send more.
+		std::unique_lock<std::mutex> lock{_channel->mutex};
+		_input.close();
+		_output.closed = true;
+		_channel->unlock_and_wake(lock, _channel->notify_loop());
+	}
+
+	void InprocessConnection::abort()
+	{
+		std::unique_lock<std::mutex> lock{_channel->mutex};
+		_input.close();
+		_output.close();
+		_channel->unlock_and_wake(lock, _channel->notify_loop());
+	}
+
+	bool InprocessConnection::send(const void* data, size_t size)
+	{
+		const Block block{data, size};
+		return send(&block, 1);
+	}
+
+	bool InprocessConnection::send(const Block* blocks, size_t count)
+	{
+		std::unique_lock<std::mutex> lock{_channel->mutex};
+		if (_output.closed)
+			return false;
+		// Only the loop is notified about the data sent by the client side.
+		const auto notify_loop = _side == Side::Client;
+		if (!_output.capacity)
+		{
+			if (_output.size() >= _output.high_water_mark)
+				return false;
+			for (size_t i = 0; i < count; ++i)
+				_output.write(blocks[i].data, blocks[i].size);
+			_channel->active = true;
+			// The loop reports the queue becoming full when it is notified.
+			if (!_output.full && _output.size() >= _output.high_water_mark)
+			{
+				_output.full = true;
+				_channel->unlock_and_wake(lock, _channel->notify_loop());
+			}
+			else
+				_channel->unlock_and_wake(lock, notify_loop ? _channel->notify_loop() : nullptr);
+			return true;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto data = static_cast<const uint8_t*>(blocks[i].data);
+			for (auto size = blocks[i].size; size > 0;)
+			{
+				if (!lock.owns_lock())
+					lock.lock();
+				_channel->changed.wait(lock, [this]{ return _output.closed || _output.size() < _output.capacity; });
+				if (_output.closed)
+					return false;
+				const auto part_size = std::min(size, _output.capacity - _output.size());
+				_output.write(data, part_size);
+				data += part_size;
+				size -= part_size;
+				_channel->active = true;
+				_channel->unlock_and_wake(lock, notify_loop ? _channel->notify_loop() : nullptr);
+			}
+		}
+		return true;
+	}
+
+	bool InprocessConnection::send_file(int file, uint64_t offset, size_t size)
+	{
+		// There is no kernel to transfer the data, so the file is read into memory.
+		std::vector<uint8_t> data(size);
+		for (size_t read_size = 0; read_size < size;)
+		{
+			const auto result = ::pread(file, data.data() + read_size, size - read_size, static_cast<off_t>(offset + read_size));
+			if (result == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			if (result == 0)
+				return false;
+			read_size += static_cast<size_t>(result);
+		}
+		return send(data.data(), data.size());
+	}
+
+	size_t InprocessConnection::pending_bytes() const
+	{
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		return _output.size();
+	}
+
+	void InprocessConnection::set_idle_timeout(int milliseconds)
+	{
+		if (_side == Side::Client)
+			return;
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		if (const auto loop = _channel->loop.lock())
+			loop->set_idle_timeout(_channel->id, milliseconds);
+	}
+
+	void InprocessConnection::shutdown()
+	{
+		std::unique_lock<std::mutex> lock{_channel->mutex};
+		_output.closed = true;
+		_channel->unlock_and_wake(lock, _side == Side::Client ? _channel->notify_loop() : nullptr);
+	}
+
+	size_t InprocessConnection::receive(void* data, size_t size, bool* disconnected)
+	{
+		std::unique_lock<std::mutex> lock{_channel->mutex};
+		if (_side == Side::Client)
+			_channel->changed.wait(lock, [this]{ return _input.size() > 0 || _input.closed; });
+		const auto received = _input.read(data, size);
+		if (disconnected && _input.closed && !_input.size())
+			*disconnected = true;
+		if (!received)
+			return 0;
+		_channel->active = true;
+		// Blocking senders may be waiting for free space, and nonblocking ones for the output queue to drain.
+		std::shared_ptr<InprocessLoop> notified_loop;
+		if (_input.full && _input.size() <= _input.low_water_mark)
+		{
+			_input.full = false;
+			notified_loop = _channel->notify_loop();
+		}
+		_channel->unlock_and_wake(lock, notified_loop);
+		return received;
+	}
+
+	bool InprocessConnection::is_output_full() const
+	{
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		return _output.full;
+	}
+
+	void InprocessConnection::take_notification()
+	{
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		_channel->notified = false;
+	}
+
+	bool InprocessConnection::take_active()
+	{
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		return std::exchange(_channel->active, false);
+	}
+
+	void InprocessConnection::detach_loop()
+	{
+		std::lock_guard<std::mutex> lock{_channel->mutex};
+		_channel->loop.reset();
+	}
+
+	InprocessLoop::InprocessLoop(size_t buffer_size)
+		: _buffer(buffer_size)
+		, _timers{Clock::now()}
+	{
+	}
+
+	InprocessLoop::~InprocessLoop()
+	{
+		assert(_connections.empty());
+	}
+
+	void InprocessLoop::post(std::shared_ptr<InprocessConnection>&& connection)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_posted.emplace_back(std::move(connection));
+			_woken = true;
+		}
+		_wakeup.notify_one();
+	}
+
+	void InprocessLoop::post(std::function<void()>&& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_tasks.emplace_back(std::move(task));
+			_woken = true;
+		}
+		_wakeup.notify_one();
+	}
+
+	void InprocessLoop::notify(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		_notified.emplace_back(id);
+		_woken = true;
+	}
+
+	void InprocessLoop::schedule(Clock::time_point time, std::function<void()>&& function)
+	{
+		assert(is_current());
+		_timers.schedule(time, std::move(function));
+	}
+
+	void InprocessLoop::set_idle_timeout(uint64_t id, int milliseconds)
+	{
+		const auto set = [this, id, milliseconds]
+		{
+			// The connection may have been closed since the request.
+			const auto i = _connections.find(id);
+			if (i == _connections.end())
+				return;
+			auto& entry = i->second;
+			_timers.cancel(entry.idle_timer);
+			entry.idle_timer = {};
+			entry.idle_timeout = std::chrono::milliseconds{milliseconds};
+			if (milliseconds <= 0)
+				return;
+			entry.last_active = Clock::now();
+			entry.idle_timer = _timers.schedule(entry.last_active + entry.idle_timeout, [this, &entry]{ expire_idle(entry); });
+		};
+		if (is_current())
+			set();
+		else
+			post(set);
+	}
+
+	void InprocessLoop::stop(Clock::time_point deadline)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_stop_requested = true;
+			_stop_deadline = std::min(_stop_deadline, deadline);
+			_woken = true;
+		}
+		_wakeup.notify_one();
+	}
+
+	void InprocessLoop::run(ServerBackend::Callbacks& callbacks)
+	{
+		_callbacks = &callbacks;
+		_thread = std::this_thread::get_id();
+		for (;;)
+		{
+			_now = Clock::now();
+			_timers.run(_now);
+			process_posted();
+			if (_stopping && _connections.empty())
+				break;
+			std::unique_lock<std::mutex> lock{_mutex};
+			const auto timeout = _timers.timeout(Clock::now());
+			if (timeout < 0)
+				_wakeup.wait(lock, [this]{ return _woken; });
+			else
+				_wakeup.wait_for(lock, std::chrono::milliseconds{timeout}, [this]{ return _woken; });
+		}
+	}
+
+	void InprocessLoop::abort_all()
+	{
+		_aborting = true;
+		// The connections are erased once the loop is notified about the aborts.
+		for (const auto& connection : _connections)
+			connection.second.connection->abort();
+	}
+
+	void InprocessLoop::add(std::shared_ptr<InprocessConnection>&& connection)
+	{
+		const auto id = connection->id();
+		auto& entry = _connections.emplace(id, Entry{std::move(connection)}).first->second;
+		entry.last_active = _now;
+		// The connection may already be sending data from the callback.
+		_callbacks->on_connected(entry.connection);
+		if (_aborting)
+			entry.connection->abort();
+		else if (_stopping)
+			entry.connection->shutdown();
+	}
+
+	void InprocessLoop::erase(Entry& entry)
+	{
+		const auto id = entry.connection->id();
+		_timers.cancel(entry.idle_timer);
+		entry.connection->detach_loop();
+		_connections.erase(id);
+	}
+
+	void InprocessLoop::expire_idle(Entry& entry)
+	{
+		entry.idle_timer = {};
+		// Sends made by the server aren't tracked by the loop, so they postpone the expiration
+		// by a full timeout instead of from the time they have been made.
+		if (entry.connection->take_active())
+			entry.last_active = _now;
+		const auto deadline = entry.last_active + entry.idle_timeout;
+		if (deadline > _now)
+		{
+			entry.idle_timer = _timers.schedule(deadline, [this, &entry]{ expire_idle(entry); });
+			return;
+		}
+		// The loop is notified about the abort like about any other disconnection.
+		entry.connection->abort();
+	}
+
+	void InprocessLoop::process(uint64_t id)
+	{
+		// The connection may have been closed since the notification.
+		const auto i = _connections.find(id);
+		if (i == _connections.end())
+			return;
+		auto& entry = i->second;
+		entry.connection->take_notification();
+		entry.last_active = _now;
+		bool disconnected = false;
+		if (_stopping)
+		{
+			// Clients which keep sending data mustn't delay the shutdown, so the data is discarded,
+			// and only one buffer is read per iteration to let the other connections close.
+			_buffer.renew();
+			if (entry.connection->receive(_buffer.data(), _buffer.size(), &disconnected) == _buffer.size())
+				notify(id);
+		}
+		else
+			_callbacks->on_received(entry.connection, _buffer, _batch, disconnected);
+		// The peer may have drained the output before disconnecting.
+		const auto full = entry.connection->is_output_full();
+		if (full != entry.full)
+		{
+			entry.full = full;
+			if (full)
+				_callbacks->on_send_buffer_full(entry.connection);
+			else
+				_callbacks->on_writable(entry.connection);
+		}
+		if (disconnected)
+		{
+			// The batch may contain the data received from the connection.
+			_callbacks->on_received_batch(_batch);
+			_callbacks->on_disconnected(entry.connection);
+			erase(entry);
+		}
+	}
+
+	void InprocessLoop::process_posted()
+	{
+		decltype(_posted) posted;
+		decltype(_tasks) tasks;
+		bool stop_requested = false;
+		auto stop_deadline = Clock::time_point::max();
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			posted.swap(_posted);
+			tasks.swap(_tasks);
+			_processing.swap(_notified);
+			_woken = false;
+			stop_requested = _stop_requested;
+			stop_deadline = _stop_deadline;
+		}
+		// The connections are added before processing their notifications, which can't be posted earlier.
+		for (auto& connection : posted)
+			add(std::move(connection));
+		for (const auto& task : tasks)
+			task();
+		for (const auto id : _processing)
+			process(id);
+		_processing.clear();
+		_callbacks->on_received_batch(_batch);
+		if (stop_requested && !_stopping)
+		{
+			_stopping = true;
+			for (const auto& connection : _connections)
+				connection.second.connection->shutdown();
+		}
+		// The deadline may be moved closer by another stop request.
+		if (stop_deadline < _abort_time && !_aborting)
+		{
+			_abort_time = stop_deadline;
+			_timers.cancel(_abort_timer);
+			_abort_timer = _timers.schedule(_abort_time, [this]{ abort_all(); });
+		}
+	}
+
+	InprocessServer::InprocessServer(const std::string& name, const Server::Options& options)
+		: _name{name}
+		, _socket_options{options.socket}
+		, _send_high_water_mark{options.nonblocking_send ? std::max<size_t>(options.send_high_water_mark, 1) : 0}
+		, _send_low_water_mark{std::min(options.send_low_water_mark, std::max<size_t>(_send_high_water_mark, 1) - 1)}
+		, _connection_pool{create_object_pool<InprocessConnection>()}
+	{
+		const auto threads = SocketServer::thread_count(options);
+		_loops.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			_loops.emplace_back(std::make_shared<InprocessLoop>(std::max<size_t>(options.socket.receive_buffer_size, 1)));
+	}
+
+	InprocessServer::~InprocessServer()
+	{
+		unregister();
+	}
+
+	void InprocessServer::run(Callbacks& callbacks)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(_loops.size() - 1);
+		for (size_t i = 1; i < _loops.size(); ++i)
+			threads.emplace_back([this, i, &callbacks]{ _loops[i]->run(callbacks); });
+		_loops.front()->run(callbacks);
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void InprocessServer::schedule(int milliseconds, std::function<void()>&& function)
+	{
+		// The delay is counted from the call rather than from the time the loop gets the request.
+		const auto time = InprocessLoop::Clock::now() + std::chrono::milliseconds{milliseconds};
+		auto& loop = *_loops[_next_timer_loop];
+		_next_timer_loop = (_next_timer_loop + 1) % _loops.size();
+		loop.post([&loop, time, function = std::move(function)]() mutable { loop.schedule(time, std::move(function)); });
+	}
+
+	void InprocessServer::shutdown(int milliseconds)
+	{
+		// No connections are accepted after the loops are stopped.
+		unregister();
+		const auto deadline = milliseconds < 0 ? InprocessLoop::Clock::time_point::max() : InprocessLoop::Clock::now() + std::chrono::milliseconds{milliseconds};
+		for (const auto& loop : _loops)
+			loop->stop(deadline);
+	}
+
+	std::unique_ptr<ReceivingConnection> InprocessServer::accept(const SocketOptions& client_options)
+	{
+		auto& loop = *_loops[_next_loop];
+		const auto channel = std::make_shared<InprocessChannel>();
+		channel->loop = _loops[_next_loop];
+		_next_loop = (_next_loop + 1) % _loops.size();
+		channel->id = ++_last_id;
+		channel->to_server.capacity = pipe_capacity(client_options);
+		if (_send_high_water_mark)
+		{
+			channel->to_client.high_water_mark = _send_high_water_mark;
+			channel->to_client.low_water_mark = _send_low_water_mark;
+		}
+		else
+			channel->to_client.capacity = pipe_capacity(_socket_options);
+		loop.post(std::allocate_shared<InprocessConnection>(PoolAllocator<InprocessConnection>{_connection_pool}, channel, InprocessConnection::Side::Server, _socket_options.receive_buffer_size));
+		return std::make_unique<InprocessConnection>(channel, InprocessConnection::Side::Client, std::max<size_t>(client_options.receive_buffer_size, 1));
+	}
+
+	void InprocessServer::unregister()
+	{
+		auto& servers = registry();
+		std::lock_guard<std::mutex> lock{servers.mutex};
+		const auto i = servers.servers.find(_name);
+		if (i != servers.servers.end() && i->second == this)
+			servers.servers.erase(i);
+	}
+
+	std::unique_ptr<ReceivingConnection> connect_inprocess(const std::string& name, const SocketOptions& options)
+	{
+		auto& servers = registry();
+		std::lock_guard<std::mutex> lock{servers.mutex};
+		const auto i = servers.servers.find(name);
+		if (i == servers.servers.end())
+			return nullptr;
+		return i->second->accept(options);
+	}
+
+	std::unique_ptr<ServerBackend> create_inprocess_server(const std::string& name, const Server::Options& options)
+	{
+		auto& servers = registry();
+		std::lock_guard<std::mutex> lock{servers.mutex};
+		if (servers.servers.count(name))
+			return nullptr;
+		auto server = std::make_unique<InprocessServer>(name, options);
+		servers.servers.emplace(name, server.get());
+		return server;
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ynet.h>
+
+namespace ynet
+{
+	// Connects to the in-process server with the specified name, returning null if there is none.
+	std::unique_ptr<class ReceivingConnection> connect_inprocess(const std::string& name, const SocketOptions&);
+
+	// Returns null if the name is used by another in-process server.
+	std::unique_ptr<class ServerBackend> create_inprocess_server(const std::string& name, const Server::Options&);
+}
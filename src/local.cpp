@@ -4,10 +4,15 @@
 #include <cstddef>
 #include <cstring>
 
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include "connector.h"
 #include "socket.h"
+#ifdef YNET_IO_URING
+#	include "uring.h"
+#endif
 
 namespace
 {
@@ -47,25 +52,36 @@ namespace
 
 namespace ynet
 {
-	const char LocalAddress[] = "127.0.0.1";
-
-	// All values are arbitrary.
-	const std::size_t LocalBufferSize = 64 * 1024;
-	const int LocalMaxPendingConnections = 16;
+	// Local connections pretend to come from the IPv4 loopback address.
+	const Connection::Endpoint LocalEndpoint{Connection::Endpoint::Family::IPv4, 0, {127, 0, 0, 1}};
 
 	class LocalServer : public SocketServer
 	{
 	public:
-		LocalServer(Socket&& socket): SocketServer{std::move(socket), LocalBufferSize} {}
+		LocalServer(std::vector<Socket>&& sockets, const Server::Options& options): SocketServer{std::move(sockets), options} {}
 		~LocalServer() override = default;
 
 		std::shared_ptr<SocketConnection> accept(int socket, bool& shutdown) override
 		{
 			const auto peer = ::accept(socket, nullptr, nullptr);
 			if (peer != -1)
-				return std::make_shared<SocketConnection>(LocalAddress, Socket(peer), SocketConnection::Side::Server, LocalBufferSize);
+			{
+				Socket peer_socket(peer);
+				// Unlike TCP ones, local sockets don't inherit buffer sizes from the listening socket.
+				if (!set_buffer_sizes(peer, _socket_options))
+					return {};
+				auto connection = std::allocate_shared<SocketConnection>(PoolAllocator<SocketConnection>{_connection_pool}, LocalEndpoint, std::move(peer_socket), SocketConnection::Side::Server, SocketConnection::Transport::Local, _socket_options, _connection_pool);
+				// Shared memory rings don't preserve message boundaries.
+				if (_socket_options.shared_memory_size > 0 && !_socket_options.seqpacket && !connection->enable_shared_memory(_socket_options.shared_memory_size))
+					return {};
+				return connection;
+			}
 			switch (errno)
 			{
+			case EAGAIN:
+		#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+		#endif
 			case ECONNABORTED:
 				return {};
 			case EINVAL:
@@ -77,23 +93,53 @@ namespace ynet
 		};
 	};
 
-	std::unique_ptr<ConnectionImpl> create_local_connection(const std::string& name)
+#ifdef YNET_IO_URING
+	class LocalUringServer : public UringServer
+	{
+	public:
+		LocalUringServer(std::vector<Socket>&& sockets, const Server::Options& options): UringServer{std::move(sockets), SocketConnection::Transport::Local, options} {}
+		~LocalUringServer() override = default;
+
+		bool peer_endpoint(int, Connection::Endpoint& endpoint) override
+		{
+			endpoint = LocalEndpoint;
+			return true;
+		}
+	};
+#endif
+
+	std::unique_ptr<Connector> create_local_connector(const std::string& name, const SocketOptions& options)
 	{
 		const auto sockaddr = ::make_local_sockaddr(name);
-		Socket socket{sockaddr.first.sun_family, SOCK_STREAM, 0};
-		if (::connect(socket.get(), reinterpret_cast<const ::sockaddr*>(&sockaddr.first), sockaddr.second) == -1)
-			return {};
-		return std::make_unique<SocketConnection>(LocalAddress, std::move(socket), SocketConnection::Side::Client, LocalBufferSize);
+		Connector::Target target{{}, static_cast<socklen_t>(sockaddr.second), LocalEndpoint};
+		std::memcpy(&target.sockaddr, &sockaddr.first, sizeof sockaddr.first);
+		std::vector<Connector::Target> targets;
+		targets.emplace_back(std::move(target));
+		return std::make_unique<Connector>(std::move(targets), SocketConnection::Transport::Local, options);
 	}
 
-	std::unique_ptr<ServerBackend> create_local_server(const std::string& name)
+	std::unique_ptr<ServerBackend> create_local_server(const std::string& name, const Server::Options& options)
 	{
 		const auto sockaddr = ::make_local_sockaddr(name);
-		Socket socket{sockaddr.first.sun_family, SOCK_STREAM, 0};
-		if (::bind(socket.get(), reinterpret_cast<const ::sockaddr*>(&sockaddr.first), sockaddr.second) == -1)
+		std::vector<Socket> sockets;
+		sockets.emplace_back(sockaddr.first.sun_family, options.socket.seqpacket ? SOCK_SEQPACKET : SOCK_STREAM, 0);
+		const auto socket = sockets.back().get();
+		if (::bind(socket, reinterpret_cast<const ::sockaddr*>(&sockaddr.first), sockaddr.second) == -1)
+			return {};
+		if (::listen(socket, options.listen_backlog) == -1)
 			return {};
-		if (::listen(socket.get(), LocalMaxPendingConnections) == -1)
+		// SO_REUSEPORT doesn't apply to local sockets, so all threads accept from the same socket,
+		// which should be nonblocking for the threads that lose the race for a connection.
+		if (options.reuse_port && ::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL) | O_NONBLOCK) == -1)
 			return {};
-		return std::make_unique<LocalServer>(std::move(socket));
+#ifdef YNET_IO_URING
+		// The io_uring backend receives from the sockets directly, so it can't receive through shared memory,
+		// its receives don't carry control messages, so it can't receive descriptors,
+		// and it merges the sent data, so it can't preserve message boundaries.
+		const auto uring_compatible = !options.socket.shared_memory_size && !options.socket.max_received_descriptors && !options.socket.seqpacket;
+		if (options.io_uring && uring_compatible && UringServer::is_supported())
+			return std::make_unique<LocalUringServer>(std::move(sockets), options);
+#endif
+		return std::make_unique<LocalServer>(std::move(sockets), options);
 	}
 }
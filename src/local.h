@@ -1,10 +1,9 @@
 #pragma once
 
-#include <memory>
-#include <string>
+#include <ynet.h>
 
 namespace ynet
 {
-	std::unique_ptr<class ConnectionImpl> create_local_connection(const std::string& name);
-	std::unique_ptr<class ServerBackend> create_local_server(const std::string& name);
+	std::unique_ptr<class Connector> create_local_connector(const std::string& name, const SocketOptions&);
+	std::unique_ptr<class ServerBackend> create_local_server(const std::string& name, const Server::Options&);
 }
@@ -0,0 +1,420 @@
+#include "loop.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include "socket.h"
+
+namespace
+{
+	// Distinguishes watches from connection entries in poller events.
+	constexpr uintptr_t WatchTag = 1;
+}
+
+namespace ynet
+{
+	void EventLoop::Handler::on_zerocopy_completed(const std::shared_ptr<SocketConnection>&, const std::shared_ptr<const void>&)
+	{
+	}
+
+	EventLoop::EventLoop(size_t buffer_size)
+		: _poller{create_poller()}
+		, _buffer(buffer_size)
+		, _timers{Clock::now()}
+	{
+	}
+
+	EventLoop::~EventLoop()
+	{
+		assert(_connections.empty());
+		assert(_watches.empty());
+	}
+
+	void EventLoop::add(std::shared_ptr<SocketConnection>&& connection, Handler& handler)
+	{
+		const auto socket = connection->socket();
+		auto& entry = _connections.emplace(socket, Entry{std::move(connection), &handler}).first->second;
+		_poller->add(socket, Poller::Readable, &entry);
+		entry.shared_memory = entry.connection->uses_shared_memory();
+		entry.connection->attach_loop(*this);
+		// The connection may already be sending data from the callback.
+		handler.on_connected(entry.connection);
+		if (_aborting)
+			entry.connection->abort();
+		else if (_stopping)
+			entry.connection->shutdown();
+	}
+
+	void EventLoop::post(std::shared_ptr<SocketConnection>&& connection, Handler& handler)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_posted.emplace_back(std::move(connection), &handler);
+		}
+		_poller->wake();
+	}
+
+	void EventLoop::post(std::function<void()>&& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_tasks.emplace_back(std::move(task));
+		}
+		_poller->wake();
+	}
+
+	EventLoop::Timer EventLoop::schedule(Clock::time_point time, std::function<void()>&& function)
+	{
+		assert(is_current());
+		return _timers.schedule(time, std::move(function));
+	}
+
+	void EventLoop::cancel(const Timer& timer)
+	{
+		assert(is_current());
+		_timers.cancel(timer);
+	}
+
+	void EventLoop::set_idle_timeout(SocketConnection& connection, int milliseconds)
+	{
+		const auto set = [this, socket = connection.socket(), id = connection.id(), milliseconds]
+		{
+			// The connection may have been closed since the request, and the socket reused by another one.
+			const auto i = _connections.find(socket);
+			if (i == _connections.end() || i->second.connection->id() != id)
+				return;
+			auto& entry = i->second;
+			_timers.cancel(entry.idle_timer);
+			entry.idle_timer = {};
+			entry.idle_timeout = std::chrono::milliseconds{milliseconds};
+			if (milliseconds <= 0)
+				return;
+			entry.last_active = Clock::now();
+			entry.idle_timer = _timers.schedule(entry.last_active + entry.idle_timeout, [this, &entry]{ expire_idle(entry); });
+		};
+		if (is_current())
+			set();
+		else
+			post(set);
+	}
+
+	void EventLoop::defer(std::function<void()>&& function)
+	{
+		assert(is_current());
+		_deferred.emplace_back(std::move(function));
+	}
+
+	void EventLoop::watch(int socket, std::function<void()>&& callback)
+	{
+		assert(is_current());
+		auto& watch = _watches[socket];
+		assert(!watch);
+		watch.reset(new Watch{socket, std::move(callback)});
+		static_assert(alignof(Watch) > WatchTag, "");
+		_poller->add(socket, Poller::Writable, reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(watch.get()) | WatchTag));
+	}
+
+	void EventLoop::unwatch(int socket)
+	{
+		assert(is_current());
+		const auto i = _watches.find(socket);
+		if (i == _watches.end())
+			return;
+		_poller->remove(socket);
+		i->second->callback = nullptr;
+		_unwatched.emplace_back(std::move(i->second));
+		_watches.erase(i);
+	}
+
+	void EventLoop::flush(SocketConnection& connection)
+	{
+		// The request is processed later because the connection is locked
+		// and the loop thread may be in the middle of a callback.
+		if (is_current())
+		{
+			_flushing.emplace_back(connection.socket(), connection.id());
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_flushes.emplace_back(connection.socket(), connection.id());
+		}
+		_poller->wake();
+	}
+
+	void EventLoop::write(std::vector<std::pair<int, uint64_t>>&& connections)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			if (_writes.empty())
+				_writes = std::move(connections);
+			else
+				_writes.insert(_writes.end(), connections.begin(), connections.end());
+		}
+		_poller->wake();
+	}
+
+	void EventLoop::listen(int socket, Listener& listener, bool shared)
+	{
+		assert(!_listener);
+		_listening_socket = socket;
+		_listener = &listener;
+		// The listening socket is registered with the listener pointer address as data.
+		_poller->add(socket, Poller::Readable | (shared ? Poller::Exclusive : 0), &_listener);
+	}
+
+	void EventLoop::stop(Clock::time_point deadline)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_stop_requested = true;
+			_stop_deadline = std::min(_stop_deadline, deadline);
+		}
+		_poller->wake();
+	}
+
+	void EventLoop::run()
+	{
+		_thread = std::this_thread::get_id();
+		for (;;)
+		{
+			process_posted();
+			if (_stopping && _connections.empty() && _watches.empty())
+				break;
+			_poller->wait(_events, _timers.timeout(Clock::now()));
+			_now = Clock::now();
+			for (const auto& event : _events)
+			{
+				// The events of erased connections are reset.
+				if (!event.data)
+					continue;
+				if (event.data == &_listener)
+				{
+					// The listener may stop the loop, so it shouldn't be called after that.
+					if (!_listener)
+						continue;
+					if (event.flags == Poller::Readable)
+						_listener->on_acceptable(*this, _listening_socket);
+					else
+						_listener->on_shut_down();
+					continue;
+				}
+				if (reinterpret_cast<uintptr_t>(event.data) & WatchTag)
+				{
+					const auto watch = reinterpret_cast<Watch*>(reinterpret_cast<uintptr_t>(event.data) & ~WatchTag);
+					if (!watch->callback)
+						continue;
+					const auto callback = std::move(watch->callback);
+					unwatch(watch->socket);
+					callback();
+					continue;
+				}
+				auto& entry = *static_cast<Entry*>(event.data);
+				auto flags = event.flags;
+				// Zero-copy send completions are also reported as errors.
+				if (flags & Poller::Error && !complete_zerocopy(entry))
+					flags |= Poller::Hangup;
+				if (entry.disconnected)
+				{
+					linger(entry, flags & Poller::Hangup);
+					continue;
+				}
+				bool disconnected = flags & Poller::Hangup;
+				if (flags & Poller::Readable)
+				{
+					entry.last_active = _now;
+					entry.handler->on_received(entry.connection, _buffer, disconnected);
+					if (entry.shared_memory && entry.doorbell == -1)
+						register_doorbell(entry);
+				}
+				// Shared memory connections may have free space after any event, as the doorbell is rung
+				// both when the peer has written data and when it has read it.
+				if (!disconnected && (flags & Poller::Writable || (entry.writing && entry.shared_memory)))
+				{
+					entry.last_active = _now;
+					if (entry.connection->flush())
+					{
+						entry.writing = false;
+						if (!entry.shared_memory)
+							_poller->modify(entry.connection->socket(), Poller::Readable, &entry);
+					}
+					report_output(entry);
+				}
+				if (disconnected)
+				{
+					entry.handler->on_disconnected(entry.connection);
+					entry.disconnected = true;
+					linger(entry, flags & Poller::Hangup);
+				}
+			}
+			_unwatched.clear();
+			// The deferred functions may defer more calls.
+			for (size_t i = 0; i < _deferred.size(); ++i)
+			{
+				const auto function = std::move(_deferred[i]);
+				function();
+			}
+			_deferred.clear();
+			_timers.run(_now);
+		}
+	}
+
+	void EventLoop::abort_all()
+	{
+		_aborting = true;
+		// The connections are erased once the loop is notified about the aborts.
+		for (const auto& connection : _connections)
+			connection.second.connection->abort();
+	}
+
+	bool EventLoop::complete_zerocopy(Entry& entry)
+	{
+		const auto result = entry.connection->complete_zerocopy(_released);
+		for (const auto& buffer : _released)
+			if (!entry.disconnected)
+				entry.handler->on_zerocopy_completed(entry.connection, buffer);
+		_released.clear();
+		return result;
+	}
+
+	void EventLoop::erase(Entry& entry)
+	{
+		const auto socket = entry.connection->socket();
+		_timers.cancel(entry.idle_timer);
+		entry.connection->detach_loop();
+		_poller->remove(socket);
+		if (entry.doorbell != -1)
+		{
+			_poller->remove(entry.doorbell);
+			// The doorbell and the socket may both have events in the current batch.
+			for (auto& event : _events)
+				if (event.data == &entry)
+					event.data = nullptr;
+		}
+		_connections.erase(socket);
+	}
+
+	void EventLoop::expire_idle(Entry& entry)
+	{
+		entry.idle_timer = {};
+		// Sends made from other threads aren't tracked by the loop, so they postpone the expiration
+		// by a full timeout instead of from the time they have been made.
+		if (entry.connection->take_sent())
+			entry.last_active = _now;
+		const auto deadline = entry.last_active + entry.idle_timeout;
+		if (deadline > _now)
+		{
+			entry.idle_timer = _timers.schedule(deadline, [this, &entry]{ expire_idle(entry); });
+			return;
+		}
+		// The loop is notified about the abort like about any other disconnection.
+		entry.connection->abort();
+	}
+
+	void EventLoop::linger(Entry& entry, bool hangup)
+	{
+		// The peer may have shut down only its side of the connection, so the queued data is still sent,
+		// and zero-copy buffers are kept until the kernel releases them.
+		if (!hangup)
+		{
+			// Nothing is received anymore, so the doorbell is only rung when the peer frees some space.
+			if (entry.shared_memory)
+				entry.connection->clear_doorbell();
+			const auto flushed = entry.connection->flush();
+			if (!flushed || entry.connection->has_pending_zerocopy())
+			{
+				// Completions are reported as errors, which don't need to be requested.
+				entry.writing = true;
+				_poller->modify(entry.connection->socket(), flushed || entry.shared_memory ? 0 : Poller::Writable, &entry);
+				return;
+			}
+		}
+		erase(entry);
+	}
+
+	void EventLoop::process_posted()
+	{
+		decltype(_posted) posted;
+		decltype(_tasks) tasks;
+		decltype(_writes) writes;
+		bool stop_requested = false;
+		auto stop_deadline = Clock::time_point::max();
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			posted.swap(_posted);
+			tasks.swap(_tasks);
+			writes.swap(_writes);
+			_flushing.insert(_flushing.end(), _flushes.begin(), _flushes.end());
+			_flushes.clear();
+			stop_requested = _stop_requested;
+			stop_deadline = _stop_deadline;
+		}
+		for (auto& connection : posted)
+			add(std::move(connection.first), *connection.second);
+		for (const auto& task : tasks)
+			task();
+		for (const auto& write : writes)
+			start_writing(write.first, write.second, true);
+		// The callbacks may add more requests.
+		for (size_t i = 0; i < _flushing.size(); ++i)
+		{
+			const auto flush = _flushing[i];
+			start_writing(flush.first, flush.second, false);
+		}
+		_flushing.clear();
+		if (stop_requested && !_stopping)
+		{
+			_stopping = true;
+			if (_listener)
+			{
+				_poller->remove(_listening_socket);
+				_listener = nullptr;
+			}
+			for (const auto& connection : _connections)
+				connection.second.connection->shutdown();
+		}
+		// The deadline may be moved closer by another stop request.
+		if (stop_deadline < _abort_time && !_aborting)
+		{
+			_abort_time = stop_deadline;
+			_timers.cancel(_abort_timer);
+			_abort_timer = _timers.schedule(_abort_time, [this]{ abort_all(); });
+		}
+	}
+
+	void EventLoop::register_doorbell(Entry& entry)
+	{
+		entry.doorbell = entry.connection->doorbell();
+		if (entry.doorbell != -1)
+			_poller->add(entry.doorbell, Poller::Readable, &entry);
+	}
+
+	void EventLoop::report_output(Entry& entry)
+	{
+		const auto full = entry.connection->is_output_full();
+		if (full == entry.full || entry.disconnected)
+			return;
+		entry.full = full;
+		if (full)
+			entry.handler->on_send_buffer_full(entry.connection);
+		else
+			entry.handler->on_writable(entry.connection);
+	}
+
+	void EventLoop::start_writing(int socket, uint64_t id, bool write)
+	{
+		// The connection may have been closed since the request, and the socket reused by another one.
+		const auto i = _connections.find(socket);
+		if (i == _connections.end() || i->second.connection->id() != id)
+			return;
+		auto& entry = i->second;
+		// The doorbell may have been rung before the request was processed, so shared memory connections are flushed anyway.
+		if (!entry.writing && !entry.disconnected && !((write || entry.shared_memory) && entry.connection->flush()))
+		{
+			entry.writing = true;
+			if (!entry.shared_memory)
+				_poller->modify(socket, Poller::Readable | Poller::Writable, &entry);
+		}
+		report_output(entry);
+	}
+}
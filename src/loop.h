@@ -0,0 +1,177 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "poller.h"
+#include "pool.h"
+#include "timer.h"
+
+namespace ynet
+{
+	class SocketConnection;
+
+	// Serves a set of socket connections in a single thread.
+	class EventLoop
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// Identifies a scheduled call. Default-constructed timers are inactive.
+		using Timer = TimerWheel::Timer;
+
+		class Handler
+		{
+		public:
+			virtual ~Handler() = default;
+
+			virtual void on_connected(const std::shared_ptr<SocketConnection>&) = 0;
+			virtual void on_received(const std::shared_ptr<SocketConnection>&, ReceiveBuffer&, bool& disconnected) = 0;
+			virtual void on_disconnected(const std::shared_ptr<SocketConnection>&) = 0;
+			virtual void on_send_buffer_full(const std::shared_ptr<SocketConnection>&) = 0;
+			virtual void on_writable(const std::shared_ptr<SocketConnection>&) = 0;
+
+			// Only called for connections using zero-copy sends. The default implementation does nothing.
+			virtual void on_zerocopy_completed(const std::shared_ptr<SocketConnection>&, const std::shared_ptr<const void>&);
+		};
+
+		class Listener
+		{
+		public:
+			virtual ~Listener() = default;
+
+			// Called when the listening socket has a connection to accept.
+			virtual void on_acceptable(EventLoop&, int socket) = 0;
+
+			// Called when the listening socket has been shut down.
+			virtual void on_shut_down() = 0;
+		};
+
+		explicit EventLoop(size_t buffer_size);
+		~EventLoop();
+
+		// Adds a connection to the loop. Must be called from the loop thread.
+		void add(std::shared_ptr<SocketConnection>&&, Handler&);
+
+		// Adds a connection to the loop from any thread.
+		void post(std::shared_ptr<SocketConnection>&&, Handler&);
+
+		// Makes the loop flush the connection output when the connection becomes writable
+		// and report the output queue state changes. May be called from any thread.
+		void flush(SocketConnection&);
+
+		// Makes the loop send the output of the connections at once, waiting for the sockets
+		// to become writable only if they don't accept all the data. May be called from any thread.
+		// The connections are identified by their sockets and ids, and the closed ones are skipped.
+		void write(std::vector<std::pair<int, uint64_t>>&&);
+
+		// Calls the function from the loop thread. May be called from any thread.
+		void post(std::function<void()>&&);
+
+		// Makes the loop abort the connection once it has been idle for the specified time,
+		// starting from now. Zero disables the timeout. May be called from any thread.
+		void set_idle_timeout(SocketConnection&, int milliseconds);
+
+		// Calls the function from the loop thread at the specified time. Must be called from the loop thread.
+		Timer schedule(Clock::time_point, std::function<void()>&&);
+
+		// Cancels a scheduled call. Does nothing if the call has already been made.
+		// Must be called from the loop thread.
+		void cancel(const Timer&);
+
+		// Calls the function once the loop has processed the current batch of events,
+		// before waiting for the next one. Must be called from the loop thread.
+		void defer(std::function<void()>&&);
+
+		// Calls the function from the loop thread once the socket becomes writable or fails,
+		// e.g. when a nonblocking connect completes. Must be called from the loop thread.
+		void watch(int socket, std::function<void()>&&);
+
+		// Stops watching the socket. Must be called from the loop thread before the socket is closed.
+		void unwatch(int socket);
+
+		// Returns true if called from the loop thread.
+		bool is_current() const { return std::this_thread::get_id() == _thread; }
+
+		// Starts waiting for connections on the listening socket.
+		// 'shared' should be true if other loops listen to the same socket.
+		void listen(int socket, Listener&, bool shared);
+
+		// Stops listening and gracefully shuts down all connections, aborting the ones still open at the deadline.
+		// The loop exits when all connections are closed. May be called from any thread.
+		void stop(Clock::time_point deadline = Clock::time_point::max());
+
+		// Returns true if the loop has been stopped. Must be called from the loop thread.
+		bool is_stopping() const { return _stopping; }
+
+		void run();
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<SocketConnection> connection;
+			Handler* handler;
+			bool writing = false;
+			bool full = false; // The output queue was reported as full.
+			bool disconnected = false; // Waiting for the queued data to be sent and zero-copy buffers to be released.
+			Clock::duration idle_timeout{};
+			Clock::time_point last_active; // Last time data was received or the queued data was sent.
+			Timer idle_timer;
+			bool shared_memory = false; // Notified through the doorbell instead of the socket becoming writable.
+			int doorbell = -1; // Registered once the connection has received it from the peer.
+		};
+
+		struct Watch
+		{
+			int socket;
+			std::function<void()> callback;
+		};
+
+		void abort_all();
+		bool complete_zerocopy(Entry&);
+		void erase(Entry&);
+		void expire_idle(Entry&);
+		void linger(Entry&, bool hangup);
+		void process_posted();
+		void register_doorbell(Entry&);
+		void report_output(Entry&);
+		void start_writing(int socket, uint64_t id, bool write);
+
+	private:
+		const std::unique_ptr<Poller> _poller;
+		std::vector<Poller::Event> _events; // The batch being processed.
+		ReceiveBuffer _buffer;
+		std::vector<std::shared_ptr<const void>> _released;
+		// Connections are registered in the poller with pointers to their entries,
+		// which remain valid until the entries are erased.
+		PooledMap<int, Entry> _connections = create_pooled_map<int, Entry>();
+		// Watched sockets are registered with tagged pointers to their watches, and unwatched ones
+		// are kept until the end of the current event batch which may still reference them.
+		std::unordered_map<int, std::unique_ptr<Watch>> _watches;
+		std::vector<std::unique_ptr<Watch>> _unwatched;
+		std::vector<std::function<void()>> _deferred;
+		int _listening_socket = -1;
+		Listener* _listener = nullptr;
+		bool _stopping = false;
+		bool _aborting = false; // The shutdown deadline has expired.
+		Clock::time_point _abort_time = Clock::time_point::max();
+		Timer _abort_timer;
+		std::thread::id _thread;
+		TimerWheel _timers;
+		Clock::time_point _now; // Time the current event batch has been received.
+		std::mutex _mutex;
+		std::vector<std::pair<std::shared_ptr<SocketConnection>, Handler*>> _posted;
+		std::vector<std::function<void()>> _tasks;
+		// Requests identify connections by their sockets and ids (see SocketConnection::id).
+		std::vector<std::pair<int, uint64_t>> _flushes;
+		std::vector<std::pair<int, uint64_t>> _flushing; // Also contains requests from the loop thread.
+		std::vector<std::pair<int, uint64_t>> _writes;
+		bool _stop_requested = false;
+		Clock::time_point _stop_deadline = Clock::time_point::max();
+	};
+}
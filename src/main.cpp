@@ -1,45 +1,152 @@
 #include <ynet.h>
 
+#include "address.h"
 #include "backend.h"
 #include "client.h"
 #include "connection.h"
+#include "connector.h"
+#include "context.h"
+#include "inprocess.h"
 #include "local.h"
+#include "resolver.h"
 #include "server.h"
+#include "socket.h"
 #include "tcp.h"
 
+#include <unistd.h>
+
 // TODO: Add Windows port.
 
 namespace ynet
 {
+	std::unique_ptr<ClientContext> ClientContext::create(const Options& options)
+	{
+		return std::make_unique<ClientContextImpl>(options);
+	}
+
+	std::unique_ptr<Resolver> Resolver::create(const Options& options)
+	{
+		return std::make_unique<ResolverImpl>(options);
+	}
+
 	void Client::Callbacks::on_started()
 	{
 	}
 
+	void Client::Callbacks::on_received_descriptors(const std::shared_ptr<Connection>&, const int* descriptors, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			::close(descriptors[i]);
+	}
+
+	void Client::Callbacks::on_send_buffer_full(const std::shared_ptr<Connection>&)
+	{
+	}
+
+	void Client::Callbacks::on_writable(const std::shared_ptr<Connection>&)
+	{
+	}
+
 	void Client::Callbacks::on_stopped()
 	{
 	}
 
 	std::unique_ptr<Client> Client::create_local(Callbacks& callbacks, const std::string& name, const Options& options)
 	{
-		return std::make_unique<ClientImpl>(callbacks, options, [name]{ return create_local_connection(name); });
+		if (options.context)
+			return std::make_unique<ContextClient>(callbacks, options, [name, options](const std::function<void(const std::shared_ptr<Connector>&)>& callback)
+			{
+				callback(create_local_connector(name, options.socket));
+			});
+		return std::make_unique<ClientImpl>(callbacks, options, [name, options]
+		{
+			return create_local_connector(name, options.socket)->connect(std::chrono::milliseconds(options.connect_timeout));
+		});
+	}
+
+	std::unique_ptr<Client> Client::create_inprocess(Callbacks& callbacks, const std::string& name, const Options& options)
+	{
+		// There is nothing to wait for without sockets, so context threads have no advantage.
+		return std::make_unique<ClientImpl>(callbacks, options, [name, options]{ return connect_inprocess(name, options.socket); });
 	}
 
 	std::unique_ptr<Client> Client::create_tcp(Callbacks& callbacks, const std::string& host, uint16_t port, const Options& options)
 	{
-		return std::make_unique<ClientImpl>(callbacks, options, [host, port]{ return create_tcp_connection(host, port); });
+		if (options.context)
+		{
+			// Context threads must not block on name resolution.
+			auto& resolver = options.resolver ? static_cast<ResolverImpl&>(*options.resolver) : static_cast<ClientContextImpl*>(options.context)->resolver();
+			return std::make_unique<ContextClient>(callbacks, options, [host, port, options, &resolver](const std::function<void(const std::shared_ptr<Connector>&)>& callback)
+			{
+				resolver.resolve(host, port, [options, callback](std::vector<::sockaddr_storage>&& addresses)
+				{
+					callback(create_tcp_connector(addresses, options.socket));
+				});
+			});
+		}
+		return std::make_unique<ClientImpl>(callbacks, options, [host, port, options]
+		{
+			const auto addresses = options.resolver ? static_cast<ResolverImpl*>(options.resolver)->resolve(host, port) : resolve(host, port);
+			return create_tcp_connector(addresses, options.socket)->connect(std::chrono::milliseconds(options.connect_timeout));
+		});
 	}
 
 	void Server::Callbacks::on_started()
 	{
 	}
 
+	void Server::Callbacks::on_received_batch(const Received* received, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			on_received(received[i].connection, received[i].data, received[i].size);
+	}
+
+	void Server::Callbacks::on_received_descriptors(const std::shared_ptr<Connection>&, const int* descriptors, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			::close(descriptors[i]);
+	}
+
+	void Server::Callbacks::on_send_buffer_full(const std::shared_ptr<Connection>&)
+	{
+	}
+
+	void Server::Callbacks::on_writable(const std::shared_ptr<Connection>&)
+	{
+	}
+
+	void Server::Callbacks::on_zerocopy_completed(const std::shared_ptr<Connection>&, const std::shared_ptr<const void>&)
+	{
+	}
+
 	std::unique_ptr<Server> Server::create_local(Callbacks& callbacks, const std::string& name, const Options& options)
 	{
-		return std::make_unique<ServerImpl>(callbacks, options, [name]{ return create_local_server(name); });
+		return std::make_unique<ServerImpl>(callbacks, options, [name, options]{ return create_local_server(name, options); });
+	}
+
+	std::unique_ptr<Server> Server::create_inprocess(Callbacks& callbacks, const std::string& name, const Options& options)
+	{
+		return std::make_unique<ServerImpl>(callbacks, options, [name, options]{ return create_inprocess_server(name, options); });
 	}
 
 	std::unique_ptr<Server> Server::create_tcp(Callbacks& callbacks, uint16_t port, const Options& options)
 	{
-		return std::make_unique<ServerImpl>(callbacks, options, [port]{ return create_tcp_server(port); });
+		return std::make_unique<ServerImpl>(callbacks, options, [port, options]{ return create_tcp_server({}, port, options); });
+	}
+
+	std::unique_ptr<Server> Server::create_tcp_bound(Callbacks& callbacks, const std::string& address, uint16_t port, const Options& options)
+	{
+		return std::make_unique<ServerImpl>(callbacks, options, [address, port, options]{ return create_tcp_server(address, port, options); });
+	}
+
+	size_t Server::broadcast(const std::shared_ptr<Connection>* connections, size_t count, const std::shared_ptr<const void>& data, size_t size)
+	{
+		Broadcast broadcast;
+		size_t sent = 0;
+		for (size_t i = 0; i < count; ++i)
+			if (static_cast<ConnectionImpl*>(connections[i].get())->broadcast(data, size, broadcast))
+				++sent;
+		broadcast.write();
+		return sent;
 	}
 }
@@ -0,0 +1,241 @@
+#include "poller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef YNET_EPOLL
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#endif
+
+namespace
+{
+	class PollPoller : public ynet::Poller
+	{
+	public:
+		PollPoller()
+		{
+			if (::pipe(_wakeup) == -1)
+				throw std::system_error(errno, std::generic_category());
+			for (const auto fd : _wakeup)
+				::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+			// The wakeup pipe always occupies the first slot.
+			_pollfds.emplace_back(::pollfd{_wakeup[0], POLLIN});
+			_data.emplace_back(nullptr);
+		}
+
+		~PollPoller() override
+		{
+			::close(_wakeup[0]);
+			::close(_wakeup[1]);
+		}
+
+		void add(int fd, unsigned flags, void* data) override
+		{
+			const auto inserted = _indices.emplace(fd, _pollfds.size()).second;
+			assert(inserted);
+			_pollfds.emplace_back(::pollfd{fd, to_poll_events(flags)});
+			_data.emplace_back(data);
+		}
+
+		void modify(int fd, unsigned flags, void* data) override
+		{
+			const auto i = _indices.find(fd);
+			assert(i != _indices.end());
+			_pollfds[i->second].events = to_poll_events(flags);
+			_data[i->second] = data;
+		}
+
+		void remove(int fd) override
+		{
+			const auto i = _indices.find(fd);
+			assert(i != _indices.end());
+			const auto index = i->second;
+			_indices.erase(i);
+			if (index != _pollfds.size() - 1)
+			{
+				_pollfds[index] = _pollfds.back();
+				_data[index] = _data.back();
+				_indices[_pollfds[index].fd] = index;
+			}
+			_pollfds.pop_back();
+			_data.pop_back();
+		}
+
+		void wait(std::vector<Event>& events, int timeout) override
+		{
+			events.clear();
+			if (::poll(_pollfds.data(), _pollfds.size(), timeout) == -1)
+			{
+				if (errno == EINTR)
+					return;
+				throw std::system_error(errno, std::generic_category());
+			}
+			if (_pollfds[0].revents)
+			{
+				uint8_t buffer[64];
+				while (::read(_wakeup[0], buffer, sizeof buffer) > 0)
+					;
+			}
+			for (size_t i = 1; i < _pollfds.size(); ++i)
+			{
+				const auto revents = _pollfds[i].revents;
+				if (!revents)
+					continue;
+				unsigned flags = 0;
+				if (revents & POLLIN)
+					flags |= Readable;
+				if (revents & POLLOUT)
+					flags |= Writable;
+				if (revents & (POLLHUP | POLLNVAL))
+					flags |= Hangup;
+				if (revents & POLLERR)
+					flags |= Error;
+				events.emplace_back(Event{_data[i], flags});
+			}
+		}
+
+		void wake() override
+		{
+			const uint8_t byte = 0;
+			// A full pipe means there is a pending wakeup already.
+			static_cast<void>(::write(_wakeup[1], &byte, sizeof byte));
+		}
+
+	private:
+		static short to_poll_events(unsigned flags)
+		{
+			return (flags & Readable ? POLLIN : 0) | (flags & Writable ? POLLOUT : 0);
+		}
+
+	private:
+		int _wakeup[2];
+		std::vector<::pollfd> _pollfds;
+		std::vector<void*> _data;
+		std::unordered_map<int, size_t> _indices;
+	};
+
+#ifdef YNET_EPOLL
+	// Arbitrary.
+	const size_t MaxEpollEvents = 256;
+
+	class EpollPoller : public ynet::Poller
+	{
+	public:
+		EpollPoller()
+			: _epoll{::epoll_create1(EPOLL_CLOEXEC)}
+			, _wakeup{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+		{
+			if (_epoll == -1 || _wakeup == -1)
+			{
+				const auto error = errno;
+				if (_epoll != -1)
+					::close(_epoll);
+				throw std::system_error(error, std::generic_category());
+			}
+			// The wakeup event is the only one registered with the poller address as data.
+			control(EPOLL_CTL_ADD, _wakeup, Readable, this);
+		}
+
+		~EpollPoller() override
+		{
+			::close(_wakeup);
+			::close(_epoll);
+		}
+
+		void add(int fd, unsigned flags, void* data) override
+		{
+			control(EPOLL_CTL_ADD, fd, flags, data);
+			++_size;
+		}
+
+		void modify(int fd, unsigned flags, void* data) override
+		{
+			control(EPOLL_CTL_MOD, fd, flags, data);
+		}
+
+		void remove(int fd) override
+		{
+			control(EPOLL_CTL_DEL, fd, 0, nullptr);
+			--_size;
+		}
+
+		void wait(std::vector<Event>& events, int timeout) override
+		{
+			events.clear();
+			// Unlike poll, epoll doesn't need to scan the whole set,
+			// so the buffer size only limits the number of events per wakeup.
+			_epoll_events.resize(std::min(_size + 1, MaxEpollEvents));
+			const auto count = ::epoll_wait(_epoll, _epoll_events.data(), static_cast<int>(_epoll_events.size()), timeout);
+			if (count == -1)
+			{
+				if (errno == EINTR)
+					return;
+				throw std::system_error(errno, std::generic_category());
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				if (_epoll_events[i].data.ptr == this)
+				{
+					uint64_t value = 0;
+					static_cast<void>(::read(_wakeup, &value, sizeof value));
+					continue;
+				}
+				const auto epoll_events = _epoll_events[i].events;
+				unsigned flags = 0;
+				if (epoll_events & EPOLLIN)
+					flags |= Readable;
+				if (epoll_events & EPOLLOUT)
+					flags |= Writable;
+				if (epoll_events & EPOLLHUP)
+					flags |= Hangup;
+				if (epoll_events & EPOLLERR)
+					flags |= Error;
+				events.emplace_back(Event{_epoll_events[i].data.ptr, flags});
+			}
+		}
+
+		void wake() override
+		{
+			const uint64_t value = 1;
+			static_cast<void>(::write(_wakeup, &value, sizeof value));
+		}
+
+	private:
+		void control(int operation, int fd, unsigned flags, void* data)
+		{
+			::epoll_event event = {};
+			event.events = (flags & Readable ? EPOLLIN : 0) | (flags & Writable ? EPOLLOUT : 0) | (flags & Exclusive ? EPOLLEXCLUSIVE : 0);
+			event.data.ptr = data;
+			if (::epoll_ctl(_epoll, operation, fd, &event) == -1)
+				throw std::system_error(errno, std::generic_category());
+		}
+
+	private:
+		const int _epoll;
+		const int _wakeup;
+		size_t _size = 0;
+		std::vector<::epoll_event> _epoll_events;
+	};
+#endif
+}
+
+namespace ynet
+{
+	std::unique_ptr<Poller> create_poller()
+	{
+#ifdef YNET_EPOLL
+		return std::make_unique<EpollPoller>();
+#else
+		return std::make_unique<PollPoller>();
+#endif
+	}
+}
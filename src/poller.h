@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace ynet
+{
+	// Waits for IO readiness of a persistent set of file descriptors.
+	class Poller
+	{
+	public:
+		enum : unsigned
+		{
+			Readable = 1 << 0,
+			Writable = 1 << 1,
+			Hangup = 1 << 2,
+			Exclusive = 1 << 3, // Avoids waking all pollers waiting for the same file. May not be modified.
+			Error = 1 << 4, // Socket errors and error queue messages. Reported regardless of the requested flags.
+		};
+
+		struct Event
+		{
+			void* data;
+			unsigned flags;
+		};
+
+		virtual ~Poller() = default;
+
+		// 'data' is reported back with every event for the file descriptor.
+		// Hangups and errors are reported regardless of the flags.
+		virtual void add(int fd, unsigned flags, void* data) = 0;
+		virtual void modify(int fd, unsigned flags, void* data) = 0;
+		virtual void remove(int fd) = 0;
+
+		// Replaces the contents of 'events' with the events that have occurred.
+		// A negative timeout means infinite wait.
+		virtual void wait(std::vector<Event>& events, int timeout) = 0;
+
+		// Interrupts an ongoing or the next wait. May be called from any thread.
+		virtual void wake() = 0;
+	};
+
+	// Creates an epoll-based poller if available, or a poll-based one otherwise.
+	std::unique_ptr<Poller> create_poller();
+}
@@ -0,0 +1,41 @@
+#include "pool.h"
+
+#include <algorithm>
+
+namespace ynet
+{
+	constexpr size_t BufferPool::MaxSlabSize;
+
+	std::shared_ptr<BufferPool> BufferPool::create(size_t buffer_size)
+	{
+		return std::make_shared<BufferPool>(std::max<size_t>(buffer_size, 1));
+	}
+
+	std::shared_ptr<uint8_t> BufferPool::acquire()
+	{
+		return {static_cast<uint8_t*>(allocate()), [pool = shared_from_this()](uint8_t* buffer){ pool->deallocate(buffer); }};
+	}
+
+	void* BufferPool::allocate()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_free.empty())
+		{
+			const auto count = _next_slab_buffers;
+			_slabs.emplace_back(new uint8_t[count * _buffer_size]);
+			_free.reserve(_free.size() + count);
+			for (size_t i = count; i > 0; --i)
+				_free.emplace_back(_slabs.back().get() + (i - 1) * _buffer_size);
+			_next_slab_buffers = std::max<size_t>(std::min(2 * count, MaxSlabSize / _buffer_size), 1);
+		}
+		const auto buffer = _free.back();
+		_free.pop_back();
+		return buffer;
+	}
+
+	void BufferPool::deallocate(void* buffer)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free.emplace_back(static_cast<uint8_t*>(buffer));
+	}
+}
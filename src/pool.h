@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ynet
+{
+	// Fixed-size buffers allocated in slabs and reused when released, possibly from other threads.
+	// Each slab is twice as large as the previous one, up to MaxSlabSize.
+	class BufferPool : public std::enable_shared_from_this<BufferPool>
+	{
+	public:
+		static constexpr size_t MaxSlabSize = 1024 * 1024;
+
+		static std::shared_ptr<BufferPool> create(size_t buffer_size);
+
+		// Returns a free buffer, which is returned to the pool when released.
+		// The pool is kept alive until all its buffers are released.
+		std::shared_ptr<uint8_t> acquire();
+
+		// Returns a free buffer, which must be returned to the pool using 'deallocate'.
+		// Buffers are aligned for any type if the buffer size is a multiple of alignof(std::max_align_t).
+		void* allocate();
+		void deallocate(void*);
+
+		size_t buffer_size() const { return _buffer_size; }
+
+		// Use create instead, the pool must be owned by a shared pointer.
+		explicit BufferPool(size_t buffer_size) : _buffer_size(buffer_size) {}
+
+	private:
+		const size_t _buffer_size;
+		std::mutex _mutex;
+		std::vector<std::unique_ptr<uint8_t[]>> _slabs;
+		size_t _next_slab_buffers = 1;
+		std::vector<uint8_t*> _free;
+	};
+
+	// Allocator for std::allocate_shared and containers, which takes the memory from the pool
+	// if the requested size fits a buffer, and from the global allocator otherwise or if there is no pool.
+	// The pool is kept alive until all the allocator copies are destroyed.
+	template <typename T>
+	class PoolAllocator
+	{
+	public:
+		using value_type = T;
+
+		explicit PoolAllocator(const std::shared_ptr<BufferPool>& pool) noexcept : _pool{pool} {}
+
+		template <typename U>
+		PoolAllocator(const PoolAllocator<U>& other) noexcept : _pool{other._pool} {}
+
+		T* allocate(size_t count)
+		{
+			static_assert(alignof(T) <= alignof(std::max_align_t), "Pool buffers may be underaligned");
+			if (_pool && count * sizeof(T) <= _pool->buffer_size())
+				return static_cast<T*>(_pool->allocate());
+			return std::allocator<T>{}.allocate(count);
+		}
+
+		void deallocate(T* pointer, size_t count)
+		{
+			if (_pool && count * sizeof(T) <= _pool->buffer_size())
+				_pool->deallocate(pointer);
+			else
+				std::allocator<T>{}.deallocate(pointer, count);
+		}
+
+		template <typename U>
+		bool operator==(const PoolAllocator<U>& other) const noexcept { return _pool == other._pool; }
+
+		template <typename U>
+		bool operator!=(const PoolAllocator<U>& other) const noexcept { return _pool != other._pool; }
+
+	private:
+		template <typename>
+		friend class PoolAllocator;
+
+		std::shared_ptr<BufferPool> _pool;
+	};
+
+	// Creates a pool for objects created with std::allocate_shared, leaving room for the shared pointer control block.
+	// The buffers also fit the blocks allocated by std::deque, so the objects may use the pool for their queues.
+	template <typename T>
+	std::shared_ptr<BufferPool> create_object_pool()
+	{
+		constexpr size_t ControlBlockSize = 64;
+		constexpr size_t DequeBlockSize = 512;
+		constexpr auto alignment = alignof(std::max_align_t);
+		return BufferPool::create((std::max(sizeof(T) + ControlBlockSize, DequeBlockSize) + alignment - 1) / alignment * alignment);
+	}
+
+	// Unordered map allocating its nodes from a pool.
+	template <typename Key, typename Value>
+	using PooledMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, PoolAllocator<std::pair<const Key, Value>>>;
+
+	template <typename Key, typename Value>
+	PooledMap<Key, Value> create_pooled_map()
+	{
+		// Besides the value, a node contains the next node pointer and possibly the cached hash.
+		constexpr auto alignment = alignof(std::max_align_t);
+		constexpr auto node_size = (sizeof(std::pair<const Key, Value>) + sizeof(void*) + sizeof(size_t) + alignment - 1) / alignment * alignment;
+		return PooledMap<Key, Value>{PoolAllocator<std::pair<const Key, Value>>{BufferPool::create(node_size)}};
+	}
+
+	// Buffer a loop receives data into (see Connection::retain_received).
+	// While the received data is retained, the following data is received into the rest of the buffer,
+	// and the buffer is replaced with another one from the pool when the free space runs low.
+	class ReceiveBuffer
+	{
+	public:
+		explicit ReceiveBuffer(size_t size) : _pool(BufferPool::create(size)), _buffer(_pool->acquire()) {}
+
+		// Free part of the buffer to receive data into.
+		uint8_t* data() const { return _buffer.get() + _used; }
+		size_t size() const { return _pool->buffer_size() - _used; }
+
+		// Returns true if the data is in the buffer.
+		bool contains(const void* data) const { return data >= _buffer.get() && data < _buffer.get() + _pool->buffer_size(); }
+
+		// Returns a reference which keeps the current buffer from being reused.
+		const std::shared_ptr<uint8_t>& retain() const { return _buffer; }
+
+		// Prepares the free part of the buffer, which should be at least 'min_size' bytes if possible,
+		// e.g. for a message not to be truncated. Must be called before receiving data into it.
+		void renew(size_t min_size = 0)
+		{
+			// The count may only decrease concurrently, so at worst the buffer is replaced needlessly.
+			if (_buffer.use_count() == 1)
+				_used = 0;
+			else if (size() < std::max(_pool->buffer_size() / 2, min_size))
+			{
+				_buffer = _pool->acquire();
+				_used = 0;
+			}
+		}
+
+		// Marks the received data as used, so that it isn't overwritten while the buffer is retained.
+		void consume(size_t size) { _used += size; }
+
+	private:
+		const std::shared_ptr<BufferPool> _pool;
+		std::shared_ptr<uint8_t> _buffer;
+		size_t _used = 0;
+	};
+}
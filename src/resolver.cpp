@@ -0,0 +1,126 @@
+#include "resolver.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "address.h"
+
+namespace
+{
+	std::vector<::sockaddr_storage> with_port(std::vector<::sockaddr_storage> addresses, uint16_t port)
+	{
+		for (auto& address : addresses)
+			ynet::set_port(address, port);
+		return addresses;
+	}
+}
+
+namespace ynet
+{
+	ResolverImpl::ResolverImpl(const Options& options)
+		: _ttl(std::max(options.ttl, 0))
+		, _negative_ttl(std::max(options.negative_ttl, 0))
+		, _hosts_file(options.hosts_file)
+	{
+	}
+
+	ResolverImpl::~ResolverImpl()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			// The clients wait for their requests to complete, so there should be none left.
+			assert(_requests.empty());
+			_stopping = true;
+		}
+		_condition.notify_one();
+		if (_thread.joinable())
+			_thread.join();
+	}
+
+	std::vector<::sockaddr_storage> ResolverImpl::resolve(const std::string& host, uint16_t port)
+	{
+		std::vector<::sockaddr_storage> addresses;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (find_cached(host, addresses))
+				return with_port(std::move(addresses), port);
+		}
+		addresses = lookup(host);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			store(host, addresses);
+		}
+		return with_port(std::move(addresses), port);
+	}
+
+	void ResolverImpl::resolve(const std::string& host, uint16_t port, Callback&& callback)
+	{
+		std::vector<::sockaddr_storage> addresses;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!find_cached(host, addresses))
+			{
+				auto& requests = _requests[host];
+				// The name may be being looked up already, in which case the new request gets the same result.
+				if (requests.empty())
+					_queue.emplace_back(host);
+				requests.push_back({port, std::move(callback)});
+				if (!_thread.joinable())
+					_thread = std::thread([this]{ run(); });
+				_condition.notify_one();
+				return;
+			}
+		}
+		callback(with_port(std::move(addresses), port));
+	}
+
+	bool ResolverImpl::find_cached(const std::string& host, std::vector<::sockaddr_storage>& addresses)
+	{
+		const auto i = _cache.find(host);
+		if (i == _cache.end())
+			return false;
+		if (i->second.expiration <= Clock::now())
+		{
+			_cache.erase(i);
+			return false;
+		}
+		addresses = i->second.addresses;
+		return true;
+	}
+
+	std::vector<::sockaddr_storage> ResolverImpl::lookup(const std::string& host) const
+	{
+		return _hosts_file.empty() ? ynet::resolve(host, 0) : resolve_from_file(_hosts_file, host, 0);
+	}
+
+	void ResolverImpl::run()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;)
+		{
+			_condition.wait(lock, [this]{ return _stopping || !_queue.empty(); });
+			if (_queue.empty())
+				break;
+			const auto host = std::move(_queue.front());
+			_queue.pop_front();
+			lock.unlock();
+			const auto addresses = lookup(host);
+			lock.lock();
+			store(host, addresses);
+			const auto i = _requests.find(host);
+			const auto requests = std::move(i->second);
+			_requests.erase(i);
+			lock.unlock();
+			for (const auto& request : requests)
+				request.callback(with_port(addresses, request.port));
+			lock.lock();
+		}
+	}
+
+	void ResolverImpl::store(const std::string& host, const std::vector<::sockaddr_storage>& addresses)
+	{
+		const auto ttl = addresses.empty() ? _negative_ttl : _ttl;
+		if (ttl.count() > 0)
+			_cache[host] = {addresses, Clock::now() + ttl};
+	}
+}
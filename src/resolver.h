@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <ynet.h>
+
+namespace ynet
+{
+	class ResolverImpl : public Resolver
+	{
+	public:
+		using Callback = std::function<void(std::vector<::sockaddr_storage>&&)>;
+
+		explicit ResolverImpl(const Options&);
+		~ResolverImpl() override;
+
+		// Resolves the host name in the calling thread unless the result is cached.
+		std::vector<::sockaddr_storage> resolve(const std::string& host, uint16_t port);
+
+		// Resolves the host name in the resolver thread unless the result is cached,
+		// in which case the callback is called immediately.
+		// Concurrent requests for the same name are served by a single lookup.
+		void resolve(const std::string& host, uint16_t port, Callback&&);
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct CacheEntry
+		{
+			std::vector<::sockaddr_storage> addresses;
+			Clock::time_point expiration;
+		};
+
+		struct Request
+		{
+			uint16_t port;
+			Callback callback;
+		};
+
+		bool find_cached(const std::string& host, std::vector<::sockaddr_storage>&);
+		std::vector<::sockaddr_storage> lookup(const std::string& host) const;
+		void run();
+		void store(const std::string& host, const std::vector<::sockaddr_storage>&);
+
+	private:
+		const std::chrono::milliseconds _ttl;
+		const std::chrono::milliseconds _negative_ttl;
+		const std::string _hosts_file;
+		std::mutex _mutex;
+		std::unordered_map<std::string, CacheEntry> _cache;
+		std::unordered_map<std::string, std::vector<Request>> _requests;
+		std::deque<std::string> _queue;
+		bool _stopping = false;
+		std::condition_variable _condition;
+		std::thread _thread; // Started on the first asynchronous request.
+	};
+}
@@ -31,6 +31,15 @@ namespace ynet
 		_thread.join();
 	}
 
+	bool ServerImpl::schedule(int milliseconds, std::function<void()>&& function)
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		if (!_backend)
+			return false;
+		_backend->schedule(milliseconds, std::move(function));
+		return true;
+	}
+
 	void ServerImpl::run()
 	{
 		std::unique_ptr<ServerBackend> backend;
@@ -59,7 +68,10 @@ namespace ynet
 				return;
 		}
 		_callbacks.on_started();
-		ServerBackend::Callbacks backend_callbacks{_callbacks};
+		ServerBackend::Callbacks backend_callbacks{_callbacks, _options};
 		backend->run(backend_callbacks);
+		// The backend may still be being shut down from another thread.
+		std::lock_guard<std::mutex> lock{_mutex};
+		_backend = nullptr;
 	}
 }
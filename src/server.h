@@ -1,6 +1,7 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
 #include <thread>
 
 #include <ynet.h>
@@ -15,6 +16,8 @@ namespace ynet
 		ServerImpl(Callbacks&, const Options&, const std::function<std::unique_ptr<ServerBackend>()>& factory);
 		~ServerImpl() override;
 
+		bool schedule(int milliseconds, std::function<void()>&&) override;
+
 	private:
 		void run();
 
@@ -0,0 +1,204 @@
+#include "shm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	// The header occupies a whole page, so the data is page-aligned.
+	const size_t HeaderSize = 4096;
+
+	// The ring can't be shrunk (which would make the peer crash accessing it) or resized otherwise.
+	const int RingSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+	bool is_valid_capacity(size_t capacity)
+	{
+		return capacity >= HeaderSize && !(capacity & (capacity - 1));
+	}
+
+	long futex(std::atomic<uint32_t>& word, int operation, uint32_t value, const ::timespec* timeout)
+	{
+		static_assert(sizeof word == sizeof(uint32_t), "");
+		// The word is shared between processes, so the operation can't be FUTEX_PRIVATE_FLAG.
+		return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), operation, value, timeout, nullptr, 0);
+	}
+}
+
+namespace ynet
+{
+	// Each side modifies its own cache line, which the other side only reads
+	// except when it announces or stops waiting.
+	struct SharedRing::Header
+	{
+		alignas(64) std::atomic<uint64_t> head; // Total size of the data written.
+		std::atomic<uint32_t> reader_waiting;
+		alignas(64) std::atomic<uint64_t> tail; // Total size of the data read.
+		std::atomic<uint32_t> writer_waiting; // One of the waiters.
+	};
+
+	std::unique_ptr<SharedRing> SharedRing::create(size_t capacity, int& file)
+	{
+		static_assert(sizeof(Header) <= HeaderSize, "");
+		static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Shared atomics must be lock-free");
+		capacity = std::max(capacity, HeaderSize);
+		if (capacity & (capacity - 1))
+			capacity = size_t{1} << (64 - __builtin_clzll(capacity));
+		file = ::memfd_create("ynet", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (file == -1)
+			throw std::system_error(errno, std::generic_category());
+		const auto size = HeaderSize + capacity;
+		void* memory = MAP_FAILED;
+		if (::ftruncate(file, static_cast<off_t>(size)) == -1
+			|| ::fcntl(file, F_ADD_SEALS, RingSeals) == -1
+			|| (memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)) == MAP_FAILED)
+		{
+			const auto error = errno;
+			::close(file);
+			file = -1;
+			throw std::system_error(error, std::generic_category());
+		}
+		new (memory) Header{};
+		return std::unique_ptr<SharedRing>{new SharedRing{memory, capacity}};
+	}
+
+	std::unique_ptr<SharedRing> SharedRing::open(int file)
+	{
+		struct ::stat file_stat;
+		const auto valid = ::fstat(file, &file_stat) == 0
+			&& static_cast<uint64_t>(file_stat.st_size) > HeaderSize
+			&& is_valid_capacity(static_cast<size_t>(file_stat.st_size) - HeaderSize)
+			&& (::fcntl(file, F_GET_SEALS) & RingSeals) == RingSeals;
+		void* memory = MAP_FAILED;
+		if (valid)
+			memory = ::mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		::close(file);
+		if (memory == MAP_FAILED)
+			return {};
+		return std::unique_ptr<SharedRing>{new SharedRing{memory, static_cast<size_t>(file_stat.st_size) - HeaderSize}};
+	}
+
+	SharedRing::SharedRing(void* memory, size_t capacity)
+		: _header{static_cast<Header*>(memory)}
+		, _data{static_cast<uint8_t*>(memory) + HeaderSize}
+		, _capacity{capacity}
+		, _mask{capacity - 1}
+	{
+	}
+
+	SharedRing::~SharedRing()
+	{
+		::munmap(_header, HeaderSize + _capacity);
+	}
+
+	size_t SharedRing::write(const ::iovec* iov, size_t count)
+	{
+		const auto head = _header->head.load(std::memory_order_relaxed);
+		const auto free_size = _capacity - std::min<uint64_t>(head - _header->tail.load(std::memory_order_acquire), _capacity);
+		size_t written = 0;
+		for (size_t i = 0; i < count && written < free_size; ++i)
+		{
+			const auto size = std::min(iov[i].iov_len, free_size - written);
+			const auto offset = static_cast<size_t>(head + written) & _mask;
+			const auto first_part = std::min(size, _capacity - offset);
+			std::memcpy(_data + offset, iov[i].iov_base, first_part);
+			std::memcpy(_data, static_cast<const uint8_t*>(iov[i].iov_base) + first_part, size - first_part);
+			written += size;
+		}
+		if (written > 0)
+			_header->head.store(head + written, std::memory_order_release);
+		return written;
+	}
+
+	std::pair<void*, size_t> SharedRing::free_space() const
+	{
+		const auto head = _header->head.load(std::memory_order_relaxed);
+		const auto free_size = _capacity - std::min<uint64_t>(head - _header->tail.load(std::memory_order_acquire), _capacity);
+		const auto offset = static_cast<size_t>(head) & _mask;
+		return {_data + offset, std::min(free_size, _capacity - offset)};
+	}
+
+	void SharedRing::commit(size_t size)
+	{
+		_header->head.store(_header->head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+	}
+
+	bool SharedRing::take_reader_waiting()
+	{
+		// Either the writer sees the flag, or the reader sees the data written before the fence.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return _header->reader_waiting.load(std::memory_order_relaxed) && _header->reader_waiting.exchange(0, std::memory_order_relaxed);
+	}
+
+	bool SharedRing::wait_for_space(Waiter waiter)
+	{
+		_header->writer_waiting.store(waiter, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (_header->head.load(std::memory_order_relaxed) - _header->tail.load(std::memory_order_acquire) >= _capacity)
+			return false;
+		// The reader may still wake the writer, which is harmless.
+		_header->writer_waiting.store(None, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool SharedRing::sleep(int milliseconds)
+	{
+		const ::timespec timeout{milliseconds / 1000, milliseconds % 1000 * 1000000L};
+		// The call returns immediately if the reader has already reset the flag.
+		return futex(_header->writer_waiting, FUTEX_WAIT, Futex, &timeout) == 0 || errno != ETIMEDOUT;
+	}
+
+	size_t SharedRing::read(void* data, size_t size)
+	{
+		const auto tail = _header->tail.load(std::memory_order_relaxed);
+		// The peer may corrupt the header, which mustn't make the reader access anything outside the ring.
+		const auto available = std::min<uint64_t>(_header->head.load(std::memory_order_acquire) - tail, _capacity);
+		if (!available)
+			return 0;
+		size = std::min<size_t>(size, available);
+		const auto offset = static_cast<size_t>(tail) & _mask;
+		const auto first_part = std::min(size, _capacity - offset);
+		std::memcpy(data, _data + offset, first_part);
+		std::memcpy(static_cast<uint8_t*>(data) + first_part, _data, size - first_part);
+		_header->tail.store(tail + size, std::memory_order_release);
+		return size;
+	}
+
+	bool SharedRing::wait_for_data()
+	{
+		_header->reader_waiting.store(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (_header->head.load(std::memory_order_relaxed) == _header->tail.load(std::memory_order_relaxed))
+			return false;
+		// The writer may still ring the doorbell, which is harmless.
+		_header->reader_waiting.store(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool SharedRing::take_writer_waiting()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!_header->writer_waiting.load(std::memory_order_relaxed))
+			return false;
+		switch (_header->writer_waiting.exchange(None, std::memory_order_relaxed))
+		{
+		case Doorbell:
+			return true;
+		case Futex:
+			futex(_header->writer_waiting, FUTEX_WAKE, 1, nullptr);
+			return false;
+		default:
+			return false;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <sys/uio.h>
+
+namespace ynet
+{
+	// Single-producer single-consumer byte ring in memory shared between processes.
+	// The writer and the reader don't make any system calls unless they have to wait for each other,
+	// and they only need to wake each other when the other side has announced that it is waiting.
+	class SharedRing
+	{
+	public:
+		// The ways a writer may wait for free space.
+		enum Waiter : uint32_t
+		{
+			None = 0,
+			Doorbell = 1, // The reader should ring the writer's doorbell.
+			Futex = 2, // The writer sleeps on the futex, and the reader wakes it directly.
+		};
+
+		// Creates a ring with at least the specified capacity in a new memory file.
+		// The file should be passed to the reader, who opens it, and closed by the caller.
+		static std::unique_ptr<SharedRing> create(size_t capacity, int& file);
+
+		// Maps the ring created by the peer, taking the ownership of the file.
+		// Returns null if the file doesn't contain a valid ring.
+		static std::unique_ptr<SharedRing> open(int file);
+
+		~SharedRing();
+
+		// Writer side.
+
+		// Copies as much of the data as fits into the ring. Returns the size of the copied data.
+		size_t write(const ::iovec*, size_t count);
+
+		// Returns the contiguous free part of the ring, which becomes readable after 'commit'.
+		std::pair<void*, size_t> free_space() const;
+		void commit(size_t size);
+
+		// Returns true if the reader has been waiting for data, resetting the flag.
+		// The writer should ring the reader's doorbell in this case.
+		bool take_reader_waiting();
+
+		// Announces that the writer is waiting for free space. Returns true if there is some space already,
+		// in which case the writer shouldn't wait.
+		bool wait_for_space(Waiter);
+
+		// Sleeps until the reader frees some space after 'wait_for_space(Futex)' returned false.
+		// Returns false if the timeout has expired.
+		bool sleep(int milliseconds);
+
+		// Reader side.
+
+		// Copies up to 'size' bytes from the ring. Returns the size of the copied data.
+		size_t read(void* data, size_t size);
+
+		// Announces that the reader is waiting for data. Returns true if there is some data already,
+		// in which case the reader shouldn't wait.
+		bool wait_for_data();
+
+		// Wakes the writer if it has been waiting for free space.
+		// Returns true if the writer's doorbell should be rung.
+		bool take_writer_waiting();
+
+		SharedRing(const SharedRing&) = delete;
+		SharedRing& operator=(const SharedRing&) = delete;
+
+	private:
+		struct Header;
+
+		SharedRing(void* memory, size_t capacity);
+
+	private:
+		Header* const _header;
+		uint8_t* const _data;
+		const size_t _capacity;
+		const size_t _mask;
+	};
+}
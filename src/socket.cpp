@@ -1,15 +1,181 @@
 #include "socket.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <unordered_map>
-#include <vector>
+#include <csignal>
+#include <cstring>
+#include <thread>
 
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#ifdef YNET_ZEROCOPY
+#	include <ctime> // Required by linux/errqueue.h.
+#	include <linux/errqueue.h>
+#endif
+
+namespace
+{
+	// Maximum number of blocks sent with a single call.
+	const size_t MaxSendBlocks = 64;
+
+	// Interval at which blocking sends waiting for a shared memory peer to read the data
+	// check whether the peer has disconnected.
+	const int SharedMemoryPeerCheckInterval = 100;
+
+	// Calls a function writing to a socket with SIGPIPE blocked, discarding the signal if the function raises it.
+	// Needed for sendfile and splice which have no MSG_NOSIGNAL equivalent.
+	template <typename Function>
+	ssize_t call_without_sigpipe(Function&& function)
+	{
+		::sigset_t sigpipe;
+		::sigemptyset(&sigpipe);
+		::sigaddset(&sigpipe, SIGPIPE);
+		::sigset_t pending;
+		::sigpending(&pending);
+		const bool was_pending = ::sigismember(&pending, SIGPIPE);
+		::sigset_t old_mask;
+		::pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+		const auto result = function();
+		const auto error = errno;
+		if (result == -1 && error == EPIPE && !was_pending)
+		{
+			const ::timespec timeout = {};
+			while (::sigtimedwait(&sigpipe, nullptr, &timeout) == -1 && errno == EINTR)
+				;
+		}
+		::pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+		errno = error;
+		return result;
+	}
+
+	void ring(int doorbell)
+	{
+		const uint64_t value = 1;
+		// The write may only fail if the counter overflows, in which case the doorbell is already readable.
+		static_cast<void>(::write(doorbell, &value, sizeof value));
+	}
+
+	// Control message buffer for the files of a shared memory handshake.
+	union HandshakeControl
+	{
+		char buffer[CMSG_SPACE(2 * sizeof(int))];
+		::cmsghdr align;
+	};
+
+	// Control message buffer for the descriptors sent with a single block.
+	union DescriptorControl
+	{
+		char buffer[CMSG_SPACE(ynet::MaxSentDescriptors * sizeof(int))];
+		::cmsghdr align;
+	};
+
+	void attach_descriptors(::msghdr& message, DescriptorControl& control, const int* descriptors, size_t count)
+	{
+		assert(count > 0 && count <= ynet::MaxSentDescriptors);
+		message.msg_control = control.buffer;
+		message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+		const auto cmsg = CMSG_FIRSTHDR(&message);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+		::memcpy(CMSG_DATA(cmsg), descriptors, count * sizeof(int));
+	}
+
+	// Appends the descriptors received with the message, which become owned by the caller.
+	void take_descriptors(const ::msghdr& message, std::vector<int>& descriptors)
+	{
+		for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(const_cast<::msghdr*>(&message), cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+			for (size_t i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i)
+			{
+				int descriptor = -1;
+				::memcpy(&descriptor, CMSG_DATA(cmsg) + i * sizeof descriptor, sizeof descriptor);
+				descriptors.emplace_back(descriptor);
+			}
+		}
+	}
+}
+
 namespace ynet
 {
+	// Position in a sequence of blocks being sent.
+	class BlockCursor
+	{
+	public:
+		BlockCursor(const Connection::Block* blocks, size_t count)
+			: _blocks(blocks)
+			, _count(count)
+		{
+			advance(0); // Skips leading empty blocks.
+		}
+
+		bool empty() const { return _count == 0; }
+
+		// Returns the remaining data of the current block.
+		const void* data() const { return static_cast<const uint8_t*>(_blocks->data) + _offset; }
+
+		// Returns the total size of the remaining data.
+		size_t size() const
+		{
+			size_t size = 0;
+			for (size_t i = 0; i < _count; ++i)
+				size += _blocks[i].size;
+			return size - _offset;
+		}
+
+		void advance(size_t size)
+		{
+			while (_count > 0 && size >= _blocks->size - _offset)
+			{
+				size -= _blocks->size - _offset;
+				_offset = 0;
+				++_blocks;
+				--_count;
+			}
+			_offset += size;
+		}
+
+		// Appends the remaining data to the buffer.
+		void append_to(std::vector<uint8_t>& buffer) const
+		{
+			for (size_t i = 0; i < _count; ++i)
+			{
+				const auto data = static_cast<const uint8_t*>(_blocks[i].data);
+				buffer.insert(buffer.end(), data + (i ? 0 : _offset), data + _blocks[i].size);
+			}
+		}
+
+		size_t fill(::iovec* iov, size_t max_count) const
+		{
+			const auto count = std::min(_count, max_count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const auto offset = i ? 0 : _offset;
+				iov[i].iov_base = const_cast<uint8_t*>(static_cast<const uint8_t*>(_blocks[i].data) + offset);
+				iov[i].iov_len = _blocks[i].size - offset;
+			}
+			return count;
+		}
+
+	private:
+		const Connection::Block* _blocks;
+		size_t _count;
+		size_t _offset = 0; // In the first block.
+	};
+
 	Socket::Socket(int socket)
 		: _socket(socket)
 	{
@@ -35,46 +201,158 @@ namespace ynet
 			::close(_socket);
 	}
 
-	SocketConnection::SocketConnection(std::string&& address, Socket&& socket, Side side, size_t receive_buffer_size)
-		: ConnectionImpl(std::move(address))
+	SocketConnection::SocketConnection(const Endpoint& endpoint, Socket&& socket, Side side, Transport transport, const SocketOptions& options, const std::shared_ptr<BufferPool>& pool)
+		: ReceivingConnection(endpoint)
 		, _socket(std::move(socket))
-		, _side(side)
-		, _receive_buffer_size(receive_buffer_size)
+		, _id(make_connection_id())
+		, _transport(transport)
+		, _receive_buffer_size(std::max<size_t>(options.receive_buffer_size, 1))
+		, _descriptor_control(transport == Transport::Local && options.max_received_descriptors > 0
+			? (CMSG_SPACE(std::min(options.max_received_descriptors, MaxSentDescriptors) * sizeof(int)) + sizeof(::cmsghdr) - 1) / sizeof(::cmsghdr)
+			: 0)
+		, _quickack(transport == Transport::Tcp && options.tcp_quickack)
+		, _messages(transport == Transport::Local && options.seqpacket)
+		, _nonblocking_receive(side == Side::Server)
+		, _output(PoolAllocator<OutputSegment>{pool})
+		, _zerocopy_pending(PoolAllocator<std::pair<uint32_t, std::shared_ptr<const void>>>{pool})
 	{
 	}
 
+	SocketConnection::~SocketConnection()
+	{
+		clear_output();
+		if (_doorbell != -1)
+			::close(_doorbell);
+		if (_peer_doorbell != -1)
+			::close(_peer_doorbell);
+	}
+
 	void SocketConnection::abort()
 	{
 		std::lock_guard<std::mutex> lock(_mutex);
 		if (_state != State::Closed)
 		{
-			::shutdown(_socket.get(), _state == State::Closing ? SHUT_RD : SHUT_RDWR);
+			::shutdown(_socket.get(), _state == State::Closing && !_shutdown_pending ? SHUT_RD : SHUT_RDWR);
 			_state = State::Closed;
+			clear_output();
 		}
 	}
 
+	size_t SocketConnection::pending_bytes() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _output_size;
+	}
+
+	void SocketConnection::set_idle_timeout(int milliseconds)
+	{
+		// The loop can't detach the connection and be destroyed while the connection is locked.
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_serving_loop)
+			_serving_loop->set_idle_timeout(*this, milliseconds);
+	}
+
 	void SocketConnection::shutdown()
 	{
 		std::lock_guard<std::mutex> lock(_mutex);
 		if (_state == State::Open)
 		{
 			_state = State::Closing;
-			::shutdown(_socket.get(), SHUT_WR);
+			// Queued data is sent before the shutdown.
+			if (_output.empty())
+				::shutdown(_socket.get(), SHUT_WR);
+			else
+				_shutdown_pending = true;
 		}
 	}
 
 	bool SocketConnection::send(const void* data, size_t size)
+	{
+		const Block block{data, size};
+		return send(&block, 1);
+	}
+
+	bool SocketConnection::send(const Block* blocks, size_t count)
+	{
+		if (_messages && count > MaxSendBlocks)
+		{
+			// A message must be sent with a single call.
+			std::vector<uint8_t> message;
+			BlockCursor(blocks, count).append_to(message);
+			const Block block{message.data(), message.size()};
+			return send(&block, 1);
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_state != State::Open)
+			return false;
+		_sent = true;
+		BlockCursor cursor(blocks, count);
+		return _loop ? send_nonblocking(cursor, nullptr) : send_blocking(cursor);
+	}
+
+	bool SocketConnection::send_zerocopy(const std::shared_ptr<const void>& data, size_t size)
 	{
 		std::lock_guard<std::mutex> lock(_mutex);
 		if (_state != State::Open)
 			return false;
-		for (size_t offset = 0; offset < size; )
+		_sent = true;
+		const Block block{data.get(), size};
+		BlockCursor cursor(&block, 1);
+		return _loop ? send_nonblocking(cursor, &data) : send_blocking(cursor);
+	}
+
+	bool SocketConnection::send_file(int file, uint64_t offset, size_t size)
+	{
+		struct ::stat file_stat;
+		if (::fstat(file, &file_stat) == -1)
+			throw std::system_error(errno, std::generic_category());
+		if (static_cast<uint64_t>(file_stat.st_size) < offset || static_cast<uint64_t>(file_stat.st_size) - offset < size)
+			return false;
+		if (_messages)
 		{
-			const auto sent_size = ::send(_socket.get(), static_cast<const uint8_t*>(data) + offset, size - offset, MSG_NOSIGNAL);
-			if (sent_size == -1)
+			// Splicing would split the file part into several messages, so it is read and sent as a single one.
+			std::vector<uint8_t> data(size);
+			for (size_t read_size = 0; read_size < size;)
 			{
+				const auto result = ::pread(file, data.data() + read_size, size - read_size, static_cast<off_t>(offset + read_size));
+				if (result == -1)
+				{
+					if (errno == EINTR)
+						continue;
+					throw std::system_error(errno, std::generic_category());
+				}
+				if (!result)
+					return false;
+				read_size += static_cast<size_t>(result);
+			}
+			return send(data.data(), data.size());
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_state != State::Open)
+			return false;
+		if (!size)
+			return true;
+		_sent = true;
+		if (!_loop)
+		{
+			while (size > 0)
+			{
+				const auto sent_size = send_file_some(file, offset, size);
+				if (sent_size > 0)
+				{
+					offset += static_cast<size_t>(sent_size);
+					size -= static_cast<size_t>(sent_size);
+					continue;
+				}
+				if (!sent_size)
+				{
+					close_truncated();
+					return false;
+				}
 				switch (errno)
 				{
+				case EINTR:
+					continue;
 				case ECONNRESET:
 				case EPIPE:
 					_state = State::Closed;
@@ -83,22 +361,313 @@ namespace ynet
 					throw std::system_error(errno, std::generic_category());
 				}
 			}
-			else
+			return true;
+		}
+		const auto queued_size = _output_size;
+		if (queued_size >= _high_water_mark)
+			return false;
+		OutputSegment segment;
+		segment.file = ::fcntl(file, F_DUPFD_CLOEXEC, 0);
+		if (segment.file == -1)
+			throw std::system_error(errno, std::generic_category());
+		segment.file_offset = offset;
+		segment.buffer_size = size;
+		_output.emplace_back(std::move(segment));
+		_output_size += size;
+		if (!queued_size && write_output())
+			return _state != State::Closed;
+		request_flush(queued_size);
+		return true;
+	}
+
+	bool SocketConnection::send_descriptors(const void* data, size_t size, const int* descriptors, size_t count)
+	{
+		// Descriptors can't be passed through shared memory, and there must be a byte to attach them to.
+		if (_transport != Transport::Local || _output_ring || !size || count > MaxSentDescriptors)
+			return false;
+		if (!count)
+			return send(data, size);
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_state != State::Open)
+			return false;
+		_sent = true;
+		const Block block{data, size};
+		BlockCursor cursor(&block, 1);
+		if (!_loop)
+		{
+			for (;;)
 			{
-				// This should mean the connection was broken during a blocking send.
-				// However, there is no guarantee that this has really happened,
-				// so we should try to send the remaining part of the buffer.
-				offset += static_cast<size_t>(sent_size);
+				const auto sent_size = send_some(cursor, MSG_NOSIGNAL, descriptors, count);
+				if (sent_size != -1)
+				{
+					cursor.advance(static_cast<size_t>(sent_size));
+					break;
+				}
+				switch (errno)
+				{
+				case EINTR:
+					continue;
+				case EMSGSIZE:
+					return false;
+				case ECONNRESET:
+				case EPIPE:
+					_state = State::Closed;
+					return false;
+				default:
+					throw std::system_error(errno, std::generic_category());
+				}
+			}
+			return send_blocking(cursor);
+		}
+		const auto queued_size = _output_size;
+		if (queued_size >= _high_water_mark)
+			return false;
+		if (!queued_size)
+		{
+			for (;;)
+			{
+				const auto sent_size = send_some(cursor, MSG_DONTWAIT | MSG_NOSIGNAL, descriptors, count);
+				if (sent_size != -1)
+				{
+					// The rest of the data is sent without the descriptors.
+					cursor.advance(static_cast<size_t>(sent_size));
+					return send_nonblocking(cursor, nullptr);
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				switch (errno)
+				{
+				case EINTR:
+					continue;
+				case EMSGSIZE:
+					return false;
+				case ECONNRESET:
+				case EPIPE:
+					_state = State::Closed;
+					return false;
+				default:
+					throw std::system_error(errno, std::generic_category());
+				}
 			}
 		}
+		// The queued segment starts with the block, so the descriptors are sent with its first byte.
+		OutputSegment segment;
+		segment.descriptors.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto descriptor = ::fcntl(descriptors[i], F_DUPFD_CLOEXEC, 0);
+			if (descriptor == -1)
+			{
+				const auto error = errno;
+				close_descriptors(segment);
+				throw std::system_error(error, std::generic_category());
+			}
+			segment.descriptors.emplace_back(descriptor);
+		}
+		cursor.append_to(segment.copy);
+		_output.emplace_back(std::move(segment));
+		_output_size += size;
+		request_flush(queued_size);
 		return true;
 	}
 
+	bool SocketConnection::broadcast(const std::shared_ptr<const void>& data, size_t size, Broadcast& broadcast)
+	{
+		if (!_loop)
+			return send_zerocopy(data, size);
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_state != State::Open)
+			return false;
+		const auto queued_size = _output_size;
+		if (queued_size >= _high_water_mark)
+			return false;
+		_sent = true;
+		// The data is only queued, and the loop sends it together with the data of the other connections.
+		const Block block{data.get(), size};
+		append_output(BlockCursor(&block, 1), &data);
+		if (queued_size || _output_size >= _high_water_mark)
+			request_flush(queued_size);
+		else if (_output_size > 0)
+			broadcast.add(*_loop, *this);
+		return true;
+	}
+
+	void SocketConnection::enable_output_queue(EventLoop& loop, size_t high_water_mark, size_t low_water_mark, bool zerocopy)
+	{
+		_loop = &loop;
+		_high_water_mark = high_water_mark;
+		_low_water_mark = low_water_mark;
+		// Unlike sendmsg, sendfile and splice have no flag to make a single call nonblocking.
+		const auto flags = ::fcntl(_socket.get(), F_GETFL);
+		if (flags == -1 || ::fcntl(_socket.get(), F_SETFL, flags | O_NONBLOCK) == -1)
+			throw std::system_error(errno, std::generic_category());
+#ifdef YNET_ZEROCOPY
+		const int enable = 1;
+		// Not all sockets support zero-copy sends, e.g. local ones don't.
+		_zerocopy = zerocopy && ::setsockopt(_socket.get(), SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof enable) == 0;
+#else
+		static_cast<void>(zerocopy);
+#endif
+	}
+
+	bool SocketConnection::enable_shared_memory(size_t size)
+	{
+		int file = -1;
+		_output_ring = SharedRing::create(size, file);
+		// Each side rings its own doorbell, so it doesn't depend on receiving the peer's one.
+		_peer_doorbell = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (_peer_doorbell == -1)
+		{
+			const auto error = errno;
+			::close(file);
+			throw std::system_error(error, std::generic_category());
+		}
+		// The handshake is a single byte carrying the ring file and the doorbell for the peer to wait for.
+		const int files[] = {file, _peer_doorbell};
+		char byte = 0;
+		::iovec iov = {&byte, 1};
+		DescriptorControl control;
+		::msghdr message = {};
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		attach_descriptors(message, control, files, 2);
+		ssize_t sent_size = 0;
+		while ((sent_size = ::sendmsg(_socket.get(), &message, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+			;
+		const auto error = errno;
+		::close(file);
+		if (sent_size == 1)
+			return true;
+		if (error == ECONNRESET || error == EPIPE)
+			return false;
+		throw std::system_error(error, std::generic_category());
+	}
+
+	void SocketConnection::clear_doorbell()
+	{
+		if (_doorbell == -1)
+			return;
+		uint64_t value = 0;
+		static_cast<void>(::read(_doorbell, &value, sizeof value));
+	}
+
+	void SocketConnection::attach_loop(EventLoop& loop)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_serving_loop = &loop;
+	}
+
+	void SocketConnection::detach_loop()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_serving_loop = nullptr;
+	}
+
+	bool SocketConnection::take_sent()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const auto sent = _sent;
+		_sent = false;
+		return sent;
+	}
+
+	bool SocketConnection::flush()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return write_output();
+	}
+
+	bool SocketConnection::is_output_full() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _output_full;
+	}
+
+	bool SocketConnection::complete_zerocopy(std::vector<std::shared_ptr<const void>>& released)
+	{
+#ifdef YNET_ZEROCOPY
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_zerocopy)
+			return false;
+		bool completed = false;
+		for (;;)
+		{
+			union
+			{
+				char buffer[CMSG_SPACE(sizeof(::sock_extended_err) + sizeof(::sockaddr_storage))];
+				::cmsghdr align;
+			} control;
+			::msghdr message = {};
+			message.msg_control = control.buffer;
+			message.msg_controllen = sizeof control.buffer;
+			if (::recvmsg(_socket.get(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				throw std::system_error(errno, std::generic_category());
+			}
+			for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+			{
+				if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+					continue;
+				::sock_extended_err error;
+				::memcpy(&error, CMSG_DATA(cmsg), sizeof error);
+				if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+					return false;
+				// TCP completions arrive in order, each one covering an inclusive range of send calls.
+				_zerocopy_completed = error.ee_data + 1;
+				completed = true;
+			}
+		}
+		while (!_zerocopy_pending.empty() && static_cast<int32_t>(_zerocopy_completed - _zerocopy_pending.front().first) >= 0)
+		{
+			released.emplace_back(std::move(_zerocopy_pending.front().second));
+			_zerocopy_pending.pop_front();
+		}
+		if (completed)
+			return true;
+		// The error wasn't caused by a completion, so the socket must have failed.
+		int error = 0;
+		auto error_size = static_cast<socklen_t>(sizeof error);
+		return ::getsockopt(_socket.get(), SOL_SOCKET, SO_ERROR, &error, &error_size) == 0 && !error;
+#else
+		static_cast<void>(released);
+		return false;
+#endif
+	}
+
+	bool SocketConnection::has_pending_zerocopy() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return !_zerocopy_pending.empty();
+	}
+
 	size_t SocketConnection::receive(void* data, size_t size, bool* disconnected)
 	{
 		assert(size > 0);
-		const bool nonblocking = _side == Side::Server;
-		const auto received_size = ::recv(_socket.get(), data, size, nonblocking ? MSG_DONTWAIT : 0);
+		if (_output_ring)
+			return receive_shared(data, size, disconnected);
+		const bool nonblocking = _nonblocking_receive;
+		ssize_t received_size = 0;
+		::msghdr message = {};
+		::iovec iov = {data, size};
+		if (_descriptor_control.empty() && !_messages)
+			received_size = ::recv(_socket.get(), data, size, nonblocking ? MSG_DONTWAIT : 0);
+		else
+		{
+			// The kernel returns the descriptors with the data containing the byte they have been attached to,
+			// and doesn't read past the end of that send, so the descriptors of different sends are never returned together.
+			message.msg_iov = &iov;
+			message.msg_iovlen = 1;
+			if (!_descriptor_control.empty())
+			{
+				message.msg_control = _descriptor_control.data();
+				message.msg_controllen = _descriptor_control.size() * sizeof(::cmsghdr);
+			}
+			received_size = ::recvmsg(_socket.get(), &message, (nonblocking ? MSG_DONTWAIT : 0) | MSG_CMSG_CLOEXEC);
+		}
 		if (received_size == -1)
 		{
 			switch (errno)
@@ -129,80 +698,732 @@ namespace ynet
 				*disconnected = true;
 			return 0;
 		}
+		if (_quickack)
+			enable_quickack(_socket.get());
+		// The descriptors which don't fit into the control buffer are closed by the kernel.
+		if (message.msg_controllen > 0)
+			take_descriptors(message, _received_descriptors);
+		if (message.msg_flags & MSG_TRUNC)
+		{
+			// The rest of the message has been discarded, so the connection can't be used anymore.
+			discard_descriptors();
+			abort();
+			if (disconnected)
+				*disconnected = true;
+			return 0;
+		}
+		return received_size;
+	}
+
+	void SocketConnection::append_output(const BlockCursor& cursor, const std::shared_ptr<const void>* buffer)
+	{
+		const auto size = cursor.size();
+		if (!size)
+			return;
+		if (buffer)
+		{
+			OutputSegment segment;
+			segment.buffer = *buffer;
+			segment.buffer_size = static_cast<const uint8_t*>(cursor.data()) - static_cast<const uint8_t*>(buffer->get()) + size;
+			segment.offset = segment.buffer_size - size;
+			segment.zerocopy = _zerocopy;
+			_output.emplace_back(std::move(segment));
+		}
 		else
-			return received_size;
+		{
+			// Copied data is merged to reduce the number of segments, unless each segment is a separate message.
+			if (_messages || _output.empty() || _output.back().buffer || _output.back().file != -1)
+				_output.emplace_back();
+			cursor.append_to(_output.back().copy);
+		}
+		_output_size += size;
 	}
 
-	void SocketServer::run(Callbacks& callbacks)
+	void SocketConnection::clear_output()
 	{
-		std::vector<uint8_t> receive_buffer(_buffer_size);
-		std::unordered_map<int, std::shared_ptr<SocketConnection>> connections;
-		for (bool stopping = false; !stopping || !connections.empty(); )
+		// The kernel may still reference zero-copy buffers, so they are kept until released.
+		for (auto& segment : _output)
+		{
+			if (segment.file != -1)
+				::close(segment.file);
+			close_descriptors(segment);
+		}
+		_output.clear();
+		_output_size = 0;
+		// The pipe may contain the data of a discarded file segment.
+		if (_pipe[0] != -1)
 		{
-			std::vector<::pollfd> pollfds;
-			pollfds.reserve(connections.size() + 1);
-			for (const auto& connection : connections)
-				pollfds.emplace_back(::pollfd{connection.first, POLLIN});
-			if (!stopping)
-				pollfds.emplace_back(::pollfd{_socket.get(), POLLIN});
-			auto count = ::poll(pollfds.data(), pollfds.size(), -1);
-			assert(count > 0);
-			bool do_accept = false;
-			bool do_stop = false;
-			if (!stopping)
+			::close(_pipe[0]);
+			::close(_pipe[1]);
+			_pipe[0] = _pipe[1] = -1;
+			_pipe_size = 0;
+		}
+	}
+
+	void SocketConnection::close_descriptors(OutputSegment& segment)
+	{
+		for (const auto descriptor : segment.descriptors)
+			::close(descriptor);
+		segment.descriptors.clear();
+	}
+
+	void SocketConnection::close_truncated()
+	{
+		// The peer may have received a part of the file, so the connection can't be used anymore.
+		::shutdown(_socket.get(), SHUT_RDWR);
+		_state = State::Closed;
+		clear_output();
+	}
+
+	void SocketConnection::consume_output(size_t size)
+	{
+		_output_size -= size;
+		while (size > 0)
+		{
+			auto& segment = _output.front();
+			const auto consumed = std::min(size, segment.size() - segment.offset);
+			segment.offset += consumed;
+			size -= consumed;
+			if (segment.offset < segment.size())
+				break;
+			if (segment.zerocopy)
+				_zerocopy_pending.emplace_back(_zerocopy_sends, std::move(segment.buffer));
+			if (segment.file != -1)
+				::close(segment.file);
+			_output.pop_front();
+		}
+	}
+
+	bool SocketConnection::send_blocking(BlockCursor& cursor)
+	{
+		while (!cursor.empty())
+		{
+			const auto sent_size = send_some(cursor, MSG_NOSIGNAL);
+			if (sent_size == -1)
 			{
-				const auto revents = pollfds.back().revents;
-				pollfds.pop_back();
-				if (revents)
+				switch (errno)
 				{
-					--count;
-					if (revents == POLLIN)
-						do_accept = true;
-					else
-						do_stop = true;
+				case EMSGSIZE:
+					// The message doesn't fit into the kernel send buffer (see SocketOptions::seqpacket).
+					return false;
+				case ECONNRESET:
+				case EPIPE:
+					_state = State::Closed;
+					return false;
+				default:
+					throw std::system_error(errno, std::generic_category());
 				}
 			}
-			for (const auto& pollfd : pollfds)
+			else
+			{
+				// This should mean the connection was broken during a blocking send.
+				// However, there is no guarantee that this has really happened,
+				// so we should try to send the remaining part of the buffer.
+				cursor.advance(static_cast<size_t>(sent_size));
+			}
+		}
+		return true;
+	}
+
+	bool SocketConnection::send_nonblocking(BlockCursor& cursor, const std::shared_ptr<const void>* buffer)
+	{
+		const auto queued_size = _output_size;
+		if (queued_size >= _high_water_mark)
+			return false;
+		if (!queued_size)
+		{
+			if (buffer && _zerocopy)
+			{
+				// Zero-copy sends are tracked in the queue.
+				append_output(cursor, buffer);
+				if (write_output())
+					return _state != State::Closed;
+			}
+			else
+			{
+				while (!cursor.empty())
+				{
+					const auto sent_size = send_some(cursor, MSG_DONTWAIT | MSG_NOSIGNAL);
+					if (sent_size != -1)
+					{
+						cursor.advance(static_cast<size_t>(sent_size));
+						continue;
+					}
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+						break;
+					switch (errno)
+					{
+					case EINTR:
+						continue;
+					case EMSGSIZE:
+						return false;
+					case ECONNRESET:
+					case EPIPE:
+						_state = State::Closed;
+						return false;
+					default:
+						throw std::system_error(errno, std::generic_category());
+					}
+				}
+				if (cursor.empty())
+					return true;
+				append_output(cursor, buffer);
+			}
+		}
+		else
+			append_output(cursor, buffer);
+		request_flush(queued_size);
+		return true;
+	}
+
+	void SocketConnection::notify_reader()
+	{
+		if (_output_ring->take_reader_waiting())
+			ring(_peer_doorbell);
+	}
+
+	bool SocketConnection::receive_handshake(bool& closed)
+	{
+		char byte = 0;
+		::iovec iov = {&byte, 1};
+		HandshakeControl control;
+		::msghdr message = {};
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control.buffer;
+		message.msg_controllen = sizeof control.buffer;
+		ssize_t received_size = 0;
+		while ((received_size = ::recvmsg(_socket.get(), &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+			;
+		if (received_size == -1)
+		{
+			switch (errno)
+			{
+			case EAGAIN:
+		#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+		#endif
+				return false;
+			case ECONNRESET:
+			case EPIPE:
+				closed = true;
+				return false;
+			default:
+				throw std::system_error(errno, std::generic_category());
+			}
+		}
+		// The received files must be closed even if the message is unexpected.
+		std::vector<int> files;
+		take_descriptors(message, files);
+		// Anything but a single handshake means that the peer doesn't use shared memory or has disconnected.
+		const auto valid = received_size == 1 && !_input_ring && files.size() == 2 && !(message.msg_flags & MSG_CTRUNC);
+		if (valid)
+			_input_ring = SharedRing::open(files[0]);
+		if (!_input_ring || !valid)
+		{
+			// The ring file is closed by the attempt to open it.
+			for (size_t i = valid ? 1 : 0; i < files.size(); ++i)
+				::close(files[i]);
+			closed = true;
+			return false;
+		}
+		_doorbell = files[1];
+		return true;
+	}
+
+	size_t SocketConnection::receive_shared(void* data, size_t size, bool* disconnected)
+	{
+		for (;;)
+		{
+			if (_input_ring)
+			{
+				size_t received_size = 0;
+				while (received_size < size)
+				{
+					const auto read_size = _input_ring->read(static_cast<uint8_t*>(data) + received_size, size - received_size);
+					if (read_size > 0)
+					{
+						received_size += read_size;
+						continue;
+					}
+					// The doorbell is reset before announcing the wait, so it is rung only for the data written after that.
+					clear_doorbell();
+					if (!_input_ring->wait_for_data())
+						break;
+				}
+				if (received_size > 0)
+				{
+					if (_input_ring->take_writer_waiting())
+						ring(_peer_doorbell);
+					return received_size;
+				}
+			}
+			if (_peer_closed)
 			{
-				if (!pollfd.revents)
-					continue;
-				const auto i = connections.find(pollfd.fd);
-				assert(i != connections.end());
-				bool disconnected = pollfd.revents & (POLLHUP | POLLERR | POLLNVAL);
-				if (pollfd.revents & POLLIN)
-					callbacks.on_received(i->second, receive_buffer.data(), receive_buffer.size(), disconnected);
 				if (disconnected)
+					*disconnected = true;
+				return 0;
+			}
+			// The socket is read only when the ring is empty, which may be caused by the handshake
+			// not having been received yet, or by the peer having disconnected.
+			bool closed = false;
+			if (receive_handshake(closed))
+				continue;
+			if (closed)
+			{
+				// The data written before the disconnection is still to be read from the ring.
+				_peer_closed = true;
+				continue;
+			}
+			if (_nonblocking_receive)
+				return 0;
+			::pollfd fds[] = {{_socket.get(), POLLIN, 0}, {_doorbell, POLLIN, 0}};
+			if (::poll(fds, 2, -1) == -1 && errno != EINTR)
+				throw std::system_error(errno, std::generic_category());
+		}
+	}
+
+	void SocketConnection::request_flush(size_t queued_size)
+	{
+		// The loop reports the queue becoming full in addition to flushing it.
+		const auto became_full = !_output_full && _output_size >= _high_water_mark;
+		if (became_full)
+			_output_full = true;
+		if (!queued_size || became_full)
+			_loop->flush(*this);
+	}
+
+	ssize_t SocketConnection::send_file_some(int file, uint64_t offset, size_t size)
+	{
+		if (_output_ring)
+		{
+			for (;;)
+			{
+				const auto space = _output_ring->free_space();
+				if (space.second > 0)
+				{
+					const auto read_size = ::pread(file, space.first, std::min(size, space.second), static_cast<off_t>(offset));
+					if (read_size > 0)
+					{
+						_output_ring->commit(static_cast<size_t>(read_size));
+						notify_reader();
+					}
+					return read_size;
+				}
+				if (!wait_for_output_space())
+					return -1;
+			}
+		}
+		if (_transport == Transport::Tcp)
+		{
+			auto file_offset = static_cast<off_t>(offset);
+			return call_without_sigpipe([&]{ return ::sendfile(_socket.get(), file, &file_offset, size); });
+		}
+		// Local sockets can't be the target of sendfile, but splicing through a pipe also avoids copying.
+		if (_pipe[0] == -1 && ::pipe2(_pipe, O_CLOEXEC) == -1)
+			throw std::system_error(errno, std::generic_category());
+		if (!_pipe_size)
+		{
+			auto file_offset = static_cast<loff_t>(offset);
+			const auto spliced_size = ::splice(file, &file_offset, _pipe[1], nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (spliced_size <= 0)
+				return spliced_size;
+			_pipe_size = static_cast<size_t>(spliced_size);
+		}
+		const auto sent_size = call_without_sigpipe([this]{ return ::splice(_pipe[0], nullptr, _socket.get(), nullptr, _pipe_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK); });
+		if (sent_size > 0)
+			_pipe_size -= static_cast<size_t>(sent_size);
+		return sent_size;
+	}
+
+	ssize_t SocketConnection::send_some(const BlockCursor& cursor, int flags, const int* descriptors, size_t descriptor_count)
+	{
+		::iovec iov[MaxSendBlocks];
+		::msghdr message = {};
+		message.msg_iov = iov;
+		message.msg_iovlen = cursor.fill(iov, MaxSendBlocks);
+		DescriptorControl control;
+		if (descriptor_count > 0)
+			attach_descriptors(message, control, descriptors, descriptor_count);
+		return send_message(message, flags);
+	}
+
+	ssize_t SocketConnection::send_message(const ::msghdr& message, int flags)
+	{
+		if (!_output_ring)
+			return ::sendmsg(_socket.get(), &message, flags);
+		for (;;)
+		{
+			const auto size = _output_ring->write(message.msg_iov, message.msg_iovlen);
+			if (size > 0)
+			{
+				notify_reader();
+				return static_cast<ssize_t>(size);
+			}
+			if (!wait_for_output_space())
+				return -1;
+		}
+	}
+
+	bool SocketConnection::wait_for_output_space()
+	{
+		if (_loop)
+		{
+			// The loop flushes the queued data when the peer rings the doorbell.
+			if (_output_ring->wait_for_space(SharedRing::Doorbell))
+				return true;
+			errno = EAGAIN;
+			return false;
+		}
+		while (!_output_ring->wait_for_space(SharedRing::Futex))
+		{
+			// The peer may have disconnected without reading the data.
+			if (_output_ring->sleep(SharedMemoryPeerCheckInterval))
+				continue;
+			::pollfd fd = {_socket.get(), 0, 0};
+			if (::poll(&fd, 1, 0) == 1 && fd.revents & (POLLHUP | POLLERR))
+			{
+				errno = EPIPE;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool SocketConnection::write_output()
+	{
+		while (!_output.empty())
+		{
+			// Zero-copy segments are sent separately from the copied ones,
+			// which may be modified as soon as the call returns.
+			const auto zerocopy = _output.front().zerocopy;
+			ssize_t sent_size = 0;
+			if (_output.front().file != -1)
+			{
+				const auto& front = _output.front();
+				sent_size = send_file_some(front.file, front.file_offset + front.offset, front.size() - front.offset);
+				if (!sent_size)
 				{
-					callbacks.on_disconnected(i->second);
-					connections.erase(i);
+					close_truncated();
+					return true;
 				}
 			}
-			if (do_accept)
+			else
 			{
-				assert(!do_stop);
-				const auto& connection = accept(_socket.get(), do_stop);
-				if (connection)
+				::iovec iov[MaxSendBlocks];
+				::msghdr message = {};
+				message.msg_iov = iov;
+				// Descriptors are attached to the first byte of the message, so a segment with descriptors starts a new one.
+				DescriptorControl control;
+				auto& front = _output.front();
+				if (!front.descriptors.empty())
+					attach_descriptors(message, control, front.descriptors.data(), front.descriptors.size());
+				for (const auto& segment : _output)
 				{
-					callbacks.on_connected(connection);
-					connections.emplace(connection->socket(), connection);
+					if (message.msg_iovlen == MaxSendBlocks || segment.zerocopy != zerocopy || segment.file != -1 || (message.msg_iovlen > 0 && (_messages || !segment.descriptors.empty())))
+						break;
+					iov[message.msg_iovlen].iov_base = const_cast<uint8_t*>(segment.data() + segment.offset);
+					iov[message.msg_iovlen].iov_len = segment.size() - segment.offset;
+					++message.msg_iovlen;
 				}
+				auto flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#ifdef YNET_ZEROCOPY
+				if (zerocopy)
+					flags |= MSG_ZEROCOPY;
+#endif
+				sent_size = send_message(message, flags);
+				// The peer has received its own copies of the descriptors.
+				if (sent_size > 0)
+					close_descriptors(front);
 			}
-			if (do_stop)
+			if (sent_size == -1)
 			{
-				stopping = true;
-				for (const auto& connection : connections)
-					connection.second->shutdown();
+				switch (errno)
+				{
+				case EAGAIN:
+			#if EWOULDBLOCK != EAGAIN
+				case EWOULDBLOCK:
+			#endif
+				{
+					// Moving the remaining data is cheaper than keeping the whole segment
+					// when most of it has been sent.
+					auto& front = _output.front();
+					if (!front.copy.empty() && front.offset > front.copy.size() / 2)
+					{
+						front.copy.erase(front.copy.begin(), front.copy.begin() + front.offset);
+						front.offset = 0;
+					}
+					if (_output_size <= _low_water_mark)
+						_output_full = false;
+					return false;
+				}
+				case EINTR:
+					continue;
+				case ENOBUFS:
+				{
+					// The kernel can't track more zero-copy sends, so the data is copied.
+					if (!zerocopy)
+						throw std::system_error(errno, std::generic_category());
+					auto& front = _output.front();
+					front.zerocopy = false;
+					// The part sent earlier may still be referenced by the kernel.
+					if (front.offset > 0)
+						_zerocopy_pending.emplace_back(_zerocopy_sends, front.buffer);
+					continue;
+				}
+				case EMSGSIZE:
+					// The queued message can't be sent, and the following ones can't be sent before it.
+				case ECONNRESET:
+				case EPIPE:
+					_state = State::Closed;
+					clear_output();
+					return true;
+				default:
+					throw std::system_error(errno, std::generic_category());
+				}
 			}
+			if (zerocopy)
+				++_zerocopy_sends;
+			consume_output(static_cast<size_t>(sent_size));
+		}
+		_output_full = false;
+		if (_shutdown_pending)
+		{
+			_shutdown_pending = false;
+			::shutdown(_socket.get(), SHUT_WR);
+		}
+		return true;
+	}
+
+	void Broadcast::add(EventLoop& loop, const SocketConnection& connection)
+	{
+		// There are few loops, so a linear search is fine.
+		auto i = std::find_if(_loops.begin(), _loops.end(), [&loop](const auto& entry){ return entry.first == &loop; });
+		if (i == _loops.end())
+			i = _loops.emplace(_loops.end(), &loop, std::vector<std::pair<int, uint64_t>>());
+		i->second.emplace_back(connection.socket(), connection.id());
+	}
+
+	void Broadcast::write()
+	{
+		for (auto& entry : _loops)
+			entry.first->write(std::move(entry.second));
+		_loops.clear();
+	}
+
+	uint64_t make_connection_id()
+	{
+		static std::atomic<uint64_t> last_id{0};
+		return ++last_id;
+	}
+
+	bool set_buffer_sizes(int socket, const SocketOptions& options)
+	{
+		if (options.kernel_send_buffer_size > 0 && ::setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &options.kernel_send_buffer_size, sizeof options.kernel_send_buffer_size) == -1)
+			return false;
+		if (options.kernel_receive_buffer_size > 0 && ::setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &options.kernel_receive_buffer_size, sizeof options.kernel_receive_buffer_size) == -1)
+			return false;
+		return true;
+	}
+
+	bool set_tcp_options(int socket, const SocketOptions& options)
+	{
+		const int enable = 1;
+		if (options.tcp_nodelay && ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof enable) == -1)
+			return false;
+		if (options.keepalive)
+		{
+			if (::setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof enable) == -1)
+				return false;
+			if (options.keepalive_idle > 0 && ::setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &options.keepalive_idle, sizeof options.keepalive_idle) == -1)
+				return false;
+			if (options.keepalive_interval > 0 && ::setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &options.keepalive_interval, sizeof options.keepalive_interval) == -1)
+				return false;
+			if (options.keepalive_count > 0 && ::setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &options.keepalive_count, sizeof options.keepalive_count) == -1)
+				return false;
+		}
+		return true;
+	}
+
+	void enable_quickack(int socket)
+	{
+		const int enable = 1;
+		// Failing to change the acknowledgement mode isn't worth failing the connection.
+		static_cast<void>(::setsockopt(socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof enable));
+	}
+
+	// Serves the connections of one of the server threads, batching the data received by them if requested.
+	class SocketServer::Thread
+		: public EventLoop::Handler
+		, public EventLoop::Listener
+	{
+	public:
+		Thread(SocketServer& server, size_t buffer_size) : _server{server}, _loop{buffer_size} {}
+
+		EventLoop& loop() { return _loop; }
+
+	private:
+		void on_connected(const std::shared_ptr<SocketConnection>&) override;
+		void on_received(const std::shared_ptr<SocketConnection>&, ReceiveBuffer&, bool& disconnected) override;
+		void on_disconnected(const std::shared_ptr<SocketConnection>&) override;
+		void on_send_buffer_full(const std::shared_ptr<SocketConnection>&) override;
+		void on_writable(const std::shared_ptr<SocketConnection>&) override;
+		void on_zerocopy_completed(const std::shared_ptr<SocketConnection>&, const std::shared_ptr<const void>&) override;
+		void on_acceptable(EventLoop&, int socket) override;
+		void on_shut_down() override;
+
+	private:
+		SocketServer& _server;
+		EventLoop _loop;
+		Batch _batch;
+	};
+
+	void SocketServer::Thread::on_connected(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_server._callbacks->on_connected(connection);
+	}
+
+	void SocketServer::Thread::on_received(const std::shared_ptr<SocketConnection>& connection, ReceiveBuffer& buffer, bool& disconnected)
+	{
+		if (_loop.is_stopping())
+		{
+			// Clients which keep sending data mustn't delay the shutdown, so the data is discarded,
+			// and only one read is made per event to let the other connections close.
+			buffer.renew();
+			connection->receive(buffer.data(), buffer.size(), &disconnected);
+			connection->discard_descriptors();
+			return;
 		}
-		assert(connections.empty());
+		const auto batched = !_batch.empty();
+		_server._callbacks->on_received(connection, buffer, _batch, disconnected);
+		if (!batched && !_batch.empty())
+			_loop.defer([this]{ _server._callbacks->on_received_batch(_batch); });
+	}
+
+	void SocketServer::Thread::on_disconnected(const std::shared_ptr<SocketConnection>& connection)
+	{
+		// The batch may contain the data received from the connection.
+		_server._callbacks->on_received_batch(_batch);
+		_server._callbacks->on_disconnected(connection);
+	}
+
+	void SocketServer::Thread::on_send_buffer_full(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_server._callbacks->on_send_buffer_full(connection);
+	}
+
+	void SocketServer::Thread::on_writable(const std::shared_ptr<SocketConnection>& connection)
+	{
+		_server._callbacks->on_writable(connection);
+	}
+
+	void SocketServer::Thread::on_zerocopy_completed(const std::shared_ptr<SocketConnection>& connection, const std::shared_ptr<const void>& data)
+	{
+		_server._callbacks->on_zerocopy_completed(connection, data);
+	}
+
+	void SocketServer::Thread::on_acceptable(EventLoop&, int socket)
+	{
+		_server.on_acceptable(*this, socket);
+	}
+
+	void SocketServer::Thread::on_shut_down()
+	{
+		_server.on_shut_down();
+	}
+
+	SocketServer::SocketServer(std::vector<Socket>&& sockets, const Server::Options& options)
+		: _socket_options{options.socket}
+		, _connection_pool{create_object_pool<SocketConnection>()}
+		, _sockets{std::move(sockets)}
+		, _accept_in_all_threads{options.reuse_port}
+		, _nonblocking_send{options.nonblocking_send}
+		, _send_high_water_mark{std::max<size_t>(options.send_high_water_mark, 1)}
+		, _send_low_water_mark{std::min(options.send_low_water_mark, _send_high_water_mark - 1)}
+		, _zerocopy_send{options.zerocopy_send}
+	{
+		const auto threads = thread_count(options);
+		assert(_sockets.size() == 1 || (_sockets.size() == threads && _accept_in_all_threads));
+		_threads.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			_threads.emplace_back(std::make_unique<Thread>(*this, std::max<size_t>(options.socket.receive_buffer_size, 1)));
+	}
+
+	SocketServer::~SocketServer() = default;
+
+	void SocketServer::run(Callbacks& callbacks)
+	{
+		_callbacks = &callbacks;
+		if (_accept_in_all_threads)
+		{
+			for (size_t i = 0; i < _threads.size(); ++i)
+				_threads[i]->loop().listen(_sockets[i % _sockets.size()].get(), *_threads[i], _sockets.size() == 1);
+		}
+		else
+		{
+			// The first loop distributes accepted connections among all loops.
+			_threads.front()->loop().listen(_sockets.front().get(), *_threads.front(), false);
+		}
+		std::vector<std::thread> threads;
+		threads.reserve(_threads.size() - 1);
+		for (size_t i = 1; i < _threads.size(); ++i)
+			threads.emplace_back([this, i]{ _threads[i]->loop().run(); });
+		_threads.front()->loop().run();
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void SocketServer::schedule(int milliseconds, std::function<void()>&& function)
+	{
+		// The delay is counted from the call rather than from the time the loop gets the request.
+		const auto time = EventLoop::Clock::now() + std::chrono::milliseconds{milliseconds};
+		auto& loop = _threads[_next_timer_thread]->loop();
+		_next_timer_thread = (_next_timer_thread + 1) % _threads.size();
+		loop.post([&loop, time, function = std::move(function)]() mutable { loop.schedule(time, std::move(function)); });
 	}
 
 	void SocketServer::shutdown(int milliseconds)
 	{
-		::shutdown(_socket.get(), SHUT_RD);
-		// TODO: Limit the time for the server to shut down.
-		// The current implementation hangs if a client is constantly sending us data
-		// and doesn't check whether the server has gracefully closed the connection,
-		// or doesn't reply to a graceful shutdown request anything at all.
+		// All loops share the deadline, which is counted from the shutdown request.
+		const auto deadline = milliseconds < 0 ? EventLoop::Clock::time_point::max() : EventLoop::Clock::now() + std::chrono::milliseconds{milliseconds};
+		// Shutting down a listening socket doesn't necessarily wake all threads waiting for it,
+		// so the loops should be stopped explicitly.
+		for (const auto& thread : _threads)
+			thread->loop().stop(deadline);
+		for (const auto& socket : _sockets)
+			::shutdown(socket.get(), SHUT_RD);
+	}
+
+	unsigned SocketServer::thread_count(const Server::Options& options)
+	{
+		return options.io_threads > 0 ? options.io_threads : std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	void SocketServer::on_acceptable(Thread& thread, int socket)
+	{
+		bool shutdown = false;
+		auto connection = accept(socket, shutdown);
+		if (shutdown)
+		{
+			on_shut_down();
+			return;
+		}
+		if (!connection)
+			return;
+		auto& target = _accept_in_all_threads ? thread : *_threads[_next_thread];
+		if (!_accept_in_all_threads)
+			_next_thread = (_next_thread + 1) % _threads.size();
+		if (_nonblocking_send)
+			connection->enable_output_queue(target.loop(), _send_high_water_mark, _send_low_water_mark, _zerocopy_send);
+		if (&target == &thread)
+			target.loop().add(std::move(connection), target);
+		else
+			target.loop().post(std::move(connection), target);
+	}
+
+	void SocketServer::on_shut_down()
+	{
+		for (const auto& thread : _threads)
+			thread->loop().stop();
 	}
 }
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <deque>
 #include <mutex>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/types.h>
 
 #include "backend.h"
 #include "connection.h"
+#include "loop.h"
+#include "pool.h"
+#include "shm.h"
 
 namespace ynet
 {
@@ -26,7 +34,9 @@ namespace ynet
 		int _socket;
 	};
 
-	class SocketConnection : public ConnectionImpl
+	class BlockCursor;
+
+	class SocketConnection : public ReceivingConnection
 	{
 	public:
 		enum class Side
@@ -42,39 +52,207 @@ namespace ynet
 			Closed,
 		};
 
-		SocketConnection(std::string&& address, Socket&& socket, Side side, size_t receive_buffer_size);
-		~SocketConnection() override = default;
+		enum class Transport
+		{
+			Tcp,
+			Local,
+		};
+
+		// The output queues of the connection are allocated from the pool, if any.
+		SocketConnection(const Endpoint&, Socket&& socket, Side side, Transport transport, const SocketOptions&, const std::shared_ptr<BufferPool>& = {});
+		~SocketConnection() override;
 
 		void abort() override;
 		bool send(const void* data, size_t size) override;
+		bool send(const Block* blocks, size_t count) override;
+		bool send_zerocopy(const std::shared_ptr<const void>& data, size_t size) override;
+		bool send_file(int file, uint64_t offset, size_t size) override;
+		bool send_descriptors(const void* data, size_t size, const int* descriptors, size_t count) override;
+		size_t pending_bytes() const override;
+		void set_idle_timeout(int milliseconds) override;
 		void shutdown() override;
 
+		bool broadcast(const std::shared_ptr<const void>& data, size_t size, Broadcast&) override;
 		size_t receive(void* data, size_t size, bool* disconnected) override;
 		size_t receive_buffer_size() const override { return _receive_buffer_size; }
+		size_t min_receive_size() const override { return _messages ? _receive_buffer_size : 0; }
 
 		int socket() const { return _socket.get(); }
 
+		// Identifies the connection in requests to the loop, unlike the socket and the address,
+		// which may be reused by another connection by the time the request is processed.
+		uint64_t id() const { return _id; }
+
+		// Makes the connection send its data through a shared memory ring, sending the ring to the peer,
+		// and receive the data through the ring the peer sends. Must be called before the connection is used.
+		// Returns false if the peer has disconnected.
+		bool enable_shared_memory(size_t size);
+
+		bool uses_shared_memory() const { return static_cast<bool>(_output_ring); }
+
+		// Returns the file descriptor which becomes readable when the peer of a shared memory connection
+		// has written data or freed space to send more, or -1 if the peer's ring hasn't been received yet.
+		// The peer's ring is received by 'receive', after which the doorbell should be checked.
+		int doorbell() const { return _doorbell; }
+
+		// Resets the doorbell, which is otherwise reset only by receiving.
+		void clear_doorbell();
+
+		// Makes receiving nonblocking, which is required for client connections served by a loop.
+		// Must be called before the connection is used.
+		void enable_nonblocking_receive() { _nonblocking_receive = true; }
+
+		// Makes sends nonblocking, queueing the data the socket doesn't accept immediately
+		// for the loop to send when the socket becomes writable. Must be called before the connection is used.
+		// Zero-copy sends are enabled if requested and supported by the socket.
+		void enable_output_queue(EventLoop&, size_t high_water_mark, size_t low_water_mark, bool zerocopy);
+
+		// Makes the connection apply idle timeouts using the loop serving it, until the loop erases it.
+		void attach_loop(EventLoop&);
+		void detach_loop();
+
+		// Returns true if any data has been sent since the previous call.
+		bool take_sent();
+
+		// Sends the queued data. Returns true if there is no more data to send.
+		bool flush();
+
+		// Returns true if the queue has reached the high water mark and hasn't drained to the low one since.
+		bool is_output_full() const;
+
+		// Reads zero-copy send completions, appending the buffers released by the kernel.
+		// Returns false if the socket has failed or doesn't use zero-copy sends.
+		bool complete_zerocopy(std::vector<std::shared_ptr<const void>>& released);
+
+		// Returns true if the kernel may still reference some of the zero-copy buffers.
+		bool has_pending_zerocopy() const;
+
 	private:
-		std::mutex _mutex;
+		struct OutputSegment
+		{
+			std::vector<uint8_t> copy; // Segment data unless it references a buffer or a file.
+			std::shared_ptr<const void> buffer;
+			size_t buffer_size = 0; // Also the size of the file part.
+			int file = -1; // Duplicated file descriptor owned by the connection.
+			uint64_t file_offset = 0;
+			size_t offset = 0; // Size of the data already sent.
+			bool zerocopy = false;
+			std::vector<int> descriptors; // Duplicated descriptors to attach to the first byte of a copied segment.
+
+			const uint8_t* data() const { return buffer ? static_cast<const uint8_t*>(buffer.get()) : copy.data(); }
+			size_t size() const { return buffer || file != -1 ? buffer_size : copy.size(); }
+		};
+
+		void append_output(const BlockCursor&, const std::shared_ptr<const void>* buffer);
+		void clear_output();
+		void close_descriptors(OutputSegment&);
+		void close_truncated();
+		void consume_output(size_t size);
+		bool send_blocking(BlockCursor&);
+		ssize_t send_file_some(int file, uint64_t offset, size_t size);
+		bool send_nonblocking(BlockCursor&, const std::shared_ptr<const void>* buffer);
+		void notify_reader();
+		bool receive_handshake(bool& closed);
+		size_t receive_shared(void* data, size_t size, bool* disconnected);
+		void request_flush(size_t queued_size);
+		ssize_t send_message(const ::msghdr&, int flags);
+		ssize_t send_some(const BlockCursor&, int flags, const int* descriptors = nullptr, size_t descriptor_count = 0);
+		bool wait_for_output_space();
+		bool write_output();
+
+	private:
+		mutable std::mutex _mutex;
 		const Socket _socket;
-		const Side _side;
+		const uint64_t _id;
+		const Transport _transport;
 		const size_t _receive_buffer_size;
+		std::vector<::cmsghdr> _descriptor_control; // Control message buffer to receive descriptors into, if enabled.
+		const bool _quickack;
+		const bool _messages; // Each send is a separate message (see SocketOptions::seqpacket).
+		bool _nonblocking_receive;
 		State _state = State::Open;
+		EventLoop* _loop = nullptr; // Only set if the output is queued.
+		EventLoop* _serving_loop = nullptr;
+		bool _sent = false;
+		size_t _high_water_mark = 0;
+		size_t _low_water_mark = 0;
+		std::deque<OutputSegment, PoolAllocator<OutputSegment>> _output;
+		size_t _output_size = 0;
+		bool _output_full = false;
+		bool _zerocopy = false;
+		uint32_t _zerocopy_sends = 0; // Number of zero-copy send calls, which the kernel uses as completion identifiers.
+		uint32_t _zerocopy_completed = 0;
+		std::deque<std::pair<uint32_t, std::shared_ptr<const void>>, PoolAllocator<std::pair<uint32_t, std::shared_ptr<const void>>>> _zerocopy_pending; // Buffers with the number of sends to complete.
+		bool _shutdown_pending = false;
+		int _pipe[2] = {-1, -1}; // Local sockets receive file data spliced through a pipe.
+		size_t _pipe_size = 0; // Size of the data in the pipe.
+		std::unique_ptr<SharedRing> _output_ring; // Replaces the socket for sending if shared memory is enabled.
+		std::unique_ptr<SharedRing> _input_ring; // Received from the peer with the first message.
+		int _doorbell = -1; // Eventfd rung by the peer, received with its ring.
+		int _peer_doorbell = -1; // Eventfd sent to the peer with the output ring.
+		bool _peer_closed = false;
+	};
+
+	// Connections which have queued a broadcast buffer, grouped by the loops serving them.
+	class Broadcast
+	{
+	public:
+		void add(EventLoop&, const SocketConnection&);
+
+		// Makes each loop send the queued data.
+		void write();
+
+	private:
+		std::vector<std::pair<EventLoop*, std::vector<std::pair<int, uint64_t>>>> _loops;
 	};
 
+	// Returns a new connection id (see SocketConnection::id). May be called from any thread.
+	uint64_t make_connection_id();
+
+	// Sets the kernel buffer sizes (SO_SNDBUF and SO_RCVBUF) requested by the options.
+	bool set_buffer_sizes(int socket, const SocketOptions&);
+
+	// Sets the TCP options except TCP_QUICKACK, which should be reenabled after every receive.
+	bool set_tcp_options(int socket, const SocketOptions&);
+
+	// Makes the socket acknowledge received data immediately until the kernel switches back to delayed acknowledgements.
+	void enable_quickack(int socket);
+
 	class SocketServer : public ServerBackend
 	{
 	public:
-		SocketServer(Socket&& socket, size_t buffer_size) : _socket(std::move(socket)), _buffer_size(buffer_size) {}
-		~SocketServer() override = default;
+		// There should be either a single listening socket or one for each thread.
+		SocketServer(std::vector<Socket>&& sockets, const Server::Options&);
+		~SocketServer() override;
 
 		void run(Callbacks& callbacks) final;
+		void schedule(int milliseconds, std::function<void()>&&) final;
 		void shutdown(int milliseconds) final;
 
 		virtual std::shared_ptr<SocketConnection> accept(int socket, bool& shutdown) = 0;
 
+		static unsigned thread_count(const Server::Options&);
+
+	protected:
+		const SocketOptions _socket_options;
+		const std::shared_ptr<BufferPool> _connection_pool; // Accepted connections are allocated from it.
+
 	private:
-		const Socket _socket;
-		const size_t _buffer_size;
+		class Thread;
+
+		void on_acceptable(Thread&, int socket);
+		void on_shut_down();
+
+	private:
+		const std::vector<Socket> _sockets;
+		const bool _accept_in_all_threads;
+		const bool _nonblocking_send;
+		const size_t _send_high_water_mark;
+		const size_t _send_low_water_mark;
+		const bool _zerocopy_send;
+		Callbacks* _callbacks = nullptr;
+		std::vector<std::unique_ptr<Thread>> _threads;
+		size_t _next_thread = 0;
+		size_t _next_timer_thread = 0;
 	};
 }
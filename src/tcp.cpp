@@ -2,21 +2,30 @@
 
 #include <cassert>
 
+#include <fcntl.h>
 #include <netinet/in.h>
 
 #include "address.h"
+#include "connector.h"
 #include "socket.h"
+#ifdef YNET_IO_URING
+#	include "uring.h"
+#endif
 
-namespace ynet
+namespace
 {
-	// All values are arbitrary.
-	const size_t TcpBufferSize = 64 * 1024;
-	const int TcpMaxPendingConnections = 16;
+	socklen_t sockaddr_size(const ::sockaddr_storage& sockaddr)
+	{
+		return static_cast<socklen_t>(sockaddr.ss_family == AF_INET6 ? sizeof(::sockaddr_in6) : sizeof(::sockaddr_in));
+	}
+}
 
+namespace ynet
+{
 	class TcpServer : public SocketServer
 	{
 	public:
-		TcpServer(Socket&& socket) : SocketServer{std::move(socket), TcpBufferSize} {}
+		TcpServer(std::vector<Socket>&& sockets, const Server::Options& options) : SocketServer{std::move(sockets), options} {}
 		~TcpServer() override = default;
 
 		std::shared_ptr<SocketConnection> accept(int socket, bool& shutdown) override
@@ -25,9 +34,13 @@ namespace ynet
 			auto sockaddr_size = static_cast<socklen_t>(sizeof sockaddr);
 			const auto peer = ::accept(socket, reinterpret_cast<::sockaddr*>(&sockaddr), &sockaddr_size);
 			if (peer != -1)
-				return std::make_shared<SocketConnection>(to_string(sockaddr), Socket(peer), SocketConnection::Side::Server, TcpBufferSize);
+				return std::allocate_shared<SocketConnection>(PoolAllocator<SocketConnection>{_connection_pool}, to_endpoint(sockaddr), Socket(peer), SocketConnection::Side::Server, SocketConnection::Transport::Tcp, _socket_options, _connection_pool);
 			switch (errno)
 			{
+			case EAGAIN:
+		#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+		#endif
 			case ECONNABORTED:
 				return {};
 			default:
@@ -36,28 +49,91 @@ namespace ynet
 		};
 	};
 
-	std::unique_ptr<ConnectionImpl> create_tcp_connection(const std::string& host, std::uint16_t port)
+#ifdef YNET_IO_URING
+	class TcpUringServer : public UringServer
 	{
-		for (const auto& sockaddr : resolve(host, port))
+	public:
+		TcpUringServer(std::vector<Socket>&& sockets, const Server::Options& options) : UringServer{std::move(sockets), SocketConnection::Transport::Tcp, options} {}
+		~TcpUringServer() override = default;
+
+		bool peer_endpoint(int socket, Connection::Endpoint& endpoint) override
 		{
-			Socket socket{sockaddr.ss_family, SOCK_STREAM, IPPROTO_TCP};
-			if (-1 != ::connect(socket.get(), reinterpret_cast<const ::sockaddr*>(&sockaddr), sizeof sockaddr))
-				return std::make_unique<SocketConnection>(to_string(sockaddr), std::move(socket), SocketConnection::Side::Client, TcpBufferSize);
+			::sockaddr_storage sockaddr = {};
+			auto sockaddr_size = static_cast<socklen_t>(sizeof sockaddr);
+			// The peer may have reset the connection right after it has been accepted.
+			if (::getpeername(socket, reinterpret_cast<::sockaddr*>(&sockaddr), &sockaddr_size) == -1)
+				return false;
+			endpoint = to_endpoint(sockaddr);
+			return true;
 		}
-		return {};
+	};
+#endif
+
+	std::unique_ptr<Connector> create_tcp_connector(const std::vector<::sockaddr_storage>& addresses, const SocketOptions& options)
+	{
+		std::vector<Connector::Target> targets;
+		for (const auto& sockaddr : addresses)
+			targets.push_back({sockaddr, ::sockaddr_size(sockaddr), to_endpoint(sockaddr)});
+		return std::make_unique<Connector>(std::move(targets), SocketConnection::Transport::Tcp, options);
 	}
 
-	std::unique_ptr<ServerBackend> create_tcp_server(std::uint16_t port)
+	std::unique_ptr<ServerBackend> create_tcp_server(const std::string& address, std::uint16_t port, const Server::Options& options)
 	{
 		::sockaddr_storage sockaddr = {};
-		// TODO: Add (optional) IPv6 support.
-		sockaddr.ss_family = AF_INET;
-		reinterpret_cast<::sockaddr_in&>(sockaddr).sin_port = ::htons(port);
-		Socket socket{sockaddr.ss_family, SOCK_STREAM, IPPROTO_TCP};
-		if (::bind(socket.get(), reinterpret_cast<const ::sockaddr*>(&sockaddr), sizeof sockaddr) == -1)
-			return {};
-		if (::listen(socket.get(), TcpMaxPendingConnections) == -1)
+		// An empty address makes a dual-stack socket accepting IPv4 connections too.
+		auto dual_stack = address.empty();
+		if (dual_stack)
+		{
+			sockaddr.ss_family = AF_INET6;
+			set_port(sockaddr, port);
+		}
+		else if (!parse_address(address, port, sockaddr))
 			return {};
-		return std::make_unique<TcpServer>(std::move(socket));
+		// With SO_REUSEPORT, the kernel distributes incoming connections among the sockets
+		// bound to the same port, so each thread can accept its own connections.
+		const auto socket_count = options.reuse_port ? SocketServer::thread_count(options) : 1;
+		std::vector<Socket> sockets;
+		sockets.reserve(socket_count);
+		for (unsigned i = 0; i < socket_count; ++i)
+		{
+			auto socket = ::socket(sockaddr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+			if (socket == -1 && errno == EAFNOSUPPORT && dual_stack)
+			{
+				// IPv6 is disabled, so only IPv4 connections can be accepted anyway.
+				dual_stack = false;
+				sockaddr = {};
+				sockaddr.ss_family = AF_INET;
+				set_port(sockaddr, port);
+				socket = ::socket(sockaddr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+			}
+			if (socket == -1)
+				return {};
+			sockets.emplace_back(socket);
+			const int enable = 1;
+			// Allow restarting the server while its previous connections are in TIME_WAIT.
+			if (::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof enable) == -1)
+				return {};
+			if (options.reuse_port && ::setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof enable) == -1)
+				return {};
+			// Accepted sockets inherit these options, and the receive buffer size
+			// must be known before a connection is established to scale the TCP window.
+			if (!set_buffer_sizes(socket, options.socket) || !set_tcp_options(socket, options.socket))
+				return {};
+			// The system default for IPV6_V6ONLY is configurable, so it is always set explicitly.
+			const int v6only = dual_stack ? 0 : 1;
+			if (sockaddr.ss_family == AF_INET6 && ::setsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof v6only) == -1)
+				return {};
+			if (::bind(socket, reinterpret_cast<const ::sockaddr*>(&sockaddr), ::sockaddr_size(sockaddr)) == -1)
+				return {};
+			if (::listen(socket, options.listen_backlog) == -1)
+				return {};
+			if (::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL) | O_NONBLOCK) == -1)
+				return {};
+		}
+#ifdef YNET_IO_URING
+		if (options.io_uring && UringServer::is_supported())
+			return std::make_unique<TcpUringServer>(std::move(sockets), options);
+#endif
+		return std::make_unique<TcpServer>(std::move(sockets), options);
 	}
 }
@@ -1,10 +1,13 @@
 #pragma once
 
-#include <memory>
-#include <string>
+#include <vector>
+
+#include <ynet.h>
+
+struct sockaddr_storage;
 
 namespace ynet
 {
-	std::unique_ptr<class ConnectionImpl> create_tcp_connection(const std::string& host, std::uint16_t port);
-	std::unique_ptr<class ServerBackend> create_tcp_server(std::uint16_t port);
+	std::unique_ptr<class Connector> create_tcp_connector(const std::vector<::sockaddr_storage>&, const SocketOptions&);
+	std::unique_ptr<class ServerBackend> create_tcp_server(const std::string& address, std::uint16_t port, const Server::Options&);
 }
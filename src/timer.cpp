@@ -0,0 +1,167 @@
+#include "timer.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+	template <typename Duration>
+	uint64_t to_ticks(Duration duration)
+	{
+		return duration > Duration::zero() ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()) : 0;
+	}
+}
+
+namespace ynet
+{
+	TimerWheel::TimerWheel(Clock::time_point origin)
+		: _origin{origin}
+	{
+		for (auto& list : _lists)
+			list = None;
+	}
+
+	TimerWheel::Timer TimerWheel::schedule(Clock::time_point time, std::function<void()>&& function)
+	{
+		auto index = _free;
+		if (index != None)
+			_free = _nodes[index].next;
+		else
+		{
+			index = static_cast<uint32_t>(_nodes.size());
+			_nodes.emplace_back();
+		}
+		auto& node = _nodes[index];
+		// Rounding up prevents calling the function before the specified time.
+		node.expiry = to_ticks(time - _origin + std::chrono::milliseconds{1} - Clock::duration{1});
+		node.function = std::move(function);
+		insert(index);
+		++_active;
+		return {index, node.generation};
+	}
+
+	void TimerWheel::cancel(const Timer& timer)
+	{
+		if (!timer || timer.index >= _nodes.size())
+			return;
+		const auto& node = _nodes[timer.index];
+		if (node.generation == timer.generation && node.list != None)
+			release(unlink(timer.index));
+	}
+
+	void TimerWheel::run(Clock::time_point now)
+	{
+		const auto target = to_ticks(now - _origin);
+		for (;;)
+		{
+			// Slots matching the current tick contain timers which are either due
+			// or should be moved to the lower levels.
+			for (auto level = Levels; level-- > 0;)
+			{
+				const auto slot = static_cast<uint32_t>((_tick >> (level * LevelBits)) & (Slots - 1));
+				if (!(_occupied[level] & (uint64_t{1} << slot)))
+					continue;
+				const auto list = level * Slots + slot;
+				while (_lists[list] != None)
+					insert(unlink(_lists[list]));
+			}
+			while (_lists[ExpiredList] != None)
+			{
+				const auto index = unlink(_lists[ExpiredList]);
+				const auto function = std::move(_nodes[index].function);
+				release(index);
+				function();
+			}
+			if (_tick >= target)
+				break;
+			_tick = std::min(next_tick(), target);
+		}
+	}
+
+	int TimerWheel::timeout(Clock::time_point now) const
+	{
+		if (_lists[ExpiredList] != None)
+			return 0;
+		if (!_active)
+			return -1;
+		const auto next = next_tick();
+		const auto elapsed = to_ticks(now - _origin);
+		if (next <= elapsed)
+			return 0;
+		if (next - elapsed >= INT_MAX)
+			return INT_MAX;
+		const auto remaining = _origin + std::chrono::milliseconds{next} - now;
+		// Rounding up prevents waking up just before the time and waiting again with zero timeout.
+		return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(remaining + std::chrono::milliseconds{1} - Clock::duration{1}).count());
+	}
+
+	void TimerWheel::insert(uint32_t index)
+	{
+		const auto expiry = _nodes[index].expiry;
+		if (expiry <= _tick)
+		{
+			link(index, ExpiredList);
+			return;
+		}
+		// The level is determined by the most significant bit in which the expiry differs from the current tick,
+		// so each level only contains timers expiring before its next slot of the next level.
+		const auto level = static_cast<uint32_t>(63 - __builtin_clzll(expiry ^ _tick)) / LevelBits;
+		link(index, level * Slots + static_cast<uint32_t>((expiry >> (level * LevelBits)) & (Slots - 1)));
+	}
+
+	void TimerWheel::link(uint32_t index, uint32_t list)
+	{
+		auto& node = _nodes[index];
+		node.list = list;
+		node.previous = None;
+		node.next = _lists[list];
+		if (node.next != None)
+			_nodes[node.next].previous = index;
+		_lists[list] = index;
+		if (list != ExpiredList)
+			_occupied[list / Slots] |= uint64_t{1} << (list % Slots);
+	}
+
+	uint64_t TimerWheel::next_tick() const
+	{
+		// Lower levels expire before the next slot of higher levels.
+		for (uint32_t level = 0; level < Levels; ++level)
+		{
+			if (!_occupied[level])
+				continue;
+			const auto shift = level * LevelBits;
+			const auto base = shift + LevelBits < 64 ? _tick >> (shift + LevelBits) << (shift + LevelBits) : 0;
+			return base | static_cast<uint64_t>(__builtin_ctzll(_occupied[level])) << shift;
+		}
+		return UINT64_MAX;
+	}
+
+	void TimerWheel::release(uint32_t index)
+	{
+		auto& node = _nodes[index];
+		node.function = nullptr;
+		// Invalidates the identifiers of the released timer.
+		if (!++node.generation)
+			node.generation = 1;
+		node.next = _free;
+		_free = index;
+		--_active;
+	}
+
+	uint32_t TimerWheel::unlink(uint32_t index)
+	{
+		auto& node = _nodes[index];
+		if (node.previous != None)
+			_nodes[node.previous].next = node.next;
+		else
+		{
+			_lists[node.list] = node.next;
+			if (node.next == None && node.list != ExpiredList)
+				_occupied[node.list / Slots] &= ~(uint64_t{1} << (node.list % Slots));
+		}
+		if (node.next != None)
+			_nodes[node.next].previous = node.previous;
+		node.list = None;
+		return index;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace ynet
+{
+	// Hierarchical timer wheel with millisecond resolution.
+	// Scheduling and cancelling take constant time regardless of the number of timers,
+	// so it is affordable to keep a timer per connection.
+	class TimerWheel
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// Identifies a scheduled call. Default-constructed timers are inactive.
+		struct Timer
+		{
+			uint32_t index = 0;
+			uint32_t generation = 0;
+
+			explicit operator bool() const { return generation != 0; }
+		};
+
+		explicit TimerWheel(Clock::time_point origin);
+
+		// Schedules the function to be called by the first 'run' at or after the specified time.
+		Timer schedule(Clock::time_point, std::function<void()>&&);
+
+		// Cancels a scheduled call. Does nothing if the call has already been made or cancelled.
+		void cancel(const Timer&);
+
+		// Calls the functions scheduled up to the specified time.
+		// The called functions may schedule and cancel other calls.
+		void run(Clock::time_point now);
+
+		// Returns the number of milliseconds 'run' may be postponed for without delaying any calls,
+		// or -1 if there are no scheduled calls.
+		int timeout(Clock::time_point now) const;
+
+	private:
+		static constexpr unsigned LevelBits = 6;
+		static constexpr unsigned Slots = 1u << LevelBits;
+		static constexpr unsigned Levels = (64 + LevelBits - 1) / LevelBits;
+		static constexpr uint32_t ExpiredList = Levels * Slots; // Calls to be made by the current 'run'.
+		static constexpr uint32_t None = UINT32_MAX;
+
+		struct Node
+		{
+			uint64_t expiry = 0; // In ticks since the origin.
+			std::function<void()> function;
+			uint32_t list = None;
+			uint32_t previous = None;
+			uint32_t next = None;
+			uint32_t generation = 1;
+		};
+
+		void insert(uint32_t index);
+		void link(uint32_t index, uint32_t list);
+		uint64_t next_tick() const;
+		void release(uint32_t index);
+		uint32_t unlink(uint32_t index);
+
+	private:
+		const Clock::time_point _origin;
+		uint64_t _tick = 0; // Time of the last 'run' in ticks since the origin.
+		std::vector<Node> _nodes;
+		uint32_t _free = None;
+		size_t _active = 0;
+		uint32_t _lists[Levels * Slots + 1];
+		uint64_t _occupied[Levels] = {}; // Nonempty slot bitmaps.
+	};
+}
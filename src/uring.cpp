@@ -0,0 +1,1123 @@
+#include "uring.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	// All values are arbitrary.
+	const unsigned UringEntries = 256;
+	const unsigned UringBufferCount = 64; // Must be a power of two.
+	const size_t UringMaxQueuedSize = 1024 * 1024;
+	const uint16_t UringBufferGroup = 0;
+
+	// Completion data values that don't point to connection entries.
+	enum : uint64_t
+	{
+		AcceptData = 1,
+		WakeupData = 2,
+		CancelData = 3,
+	};
+
+	// Connection entry operations encoded in the lower bits of completion data.
+	enum : uint64_t
+	{
+		ReceiveOperation = 0,
+		SendOperation = 1,
+		OperationMask = 7,
+	};
+
+	class Ring
+	{
+	public:
+		explicit Ring(unsigned entries)
+		{
+			try
+			{
+				::io_uring_params params = {};
+				// Completions are only processed when the loop asks for them,
+				// so there is no need to interrupt the thread to run completion work.
+				params.flags = IORING_SETUP_COOP_TASKRUN;
+				_ring = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+				if (_ring == -1)
+					throw std::system_error(errno, std::generic_category());
+				_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+				const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+				if (single_mmap)
+					_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+				_sq_ring = map(_sq_ring_size, IORING_OFF_SQ_RING);
+				_cq_ring = single_mmap ? _sq_ring : map(_cq_ring_size, IORING_OFF_CQ_RING);
+				_sqes_size = params.sq_entries * sizeof(::io_uring_sqe);
+				_sqes = static_cast<::io_uring_sqe*>(map(_sqes_size, IORING_OFF_SQES));
+				const auto sq_ring = static_cast<uint8_t*>(_sq_ring);
+				_sq_head = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+				_sq_tail = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+				_sq_mask = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+				_sq_entries = params.sq_entries;
+				_sq_local_tail = *_sq_tail;
+				// Submission queue entries are always used in order.
+				const auto sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+				for (unsigned i = 0; i < _sq_entries; ++i)
+					sq_array[i] = i;
+				const auto cq_ring = static_cast<uint8_t*>(_cq_ring);
+				_cq_head = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+				_cq_tail = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+				_cq_mask = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+				_cqes = reinterpret_cast<::io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+			}
+			catch (...)
+			{
+				release();
+				throw;
+			}
+		}
+
+		~Ring()
+		{
+			release();
+		}
+
+		// Returns a cleared submission queue entry which is submitted with the next 'submit' call.
+		::io_uring_sqe& push()
+		{
+			while (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries)
+				submit(0);
+			auto& sqe = _sqes[_sq_local_tail++ & _sq_mask];
+			std::memset(&sqe, 0, sizeof sqe);
+			return sqe;
+		}
+
+		bool has_completions() const
+		{
+			return *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+		}
+
+		// Submits all pushed entries and waits for the specified number of completions,
+		// but no longer than the specified number of milliseconds unless the timeout is negative.
+		void submit(unsigned min_completions, int timeout = -1)
+		{
+			__atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+			const auto pending = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+			if (!pending && !min_completions)
+				return;
+			unsigned flags = min_completions ? IORING_ENTER_GETEVENTS : 0;
+			::__kernel_timespec timespec = {};
+			::io_uring_getevents_arg argument = {};
+			if (min_completions && timeout >= 0)
+			{
+				// Extended arguments (Linux 5.11) are supported by all kernels providing the features we use.
+				timespec.tv_sec = timeout / 1000;
+				timespec.tv_nsec = timeout % 1000 * 1000000ll;
+				argument.ts = reinterpret_cast<uint64_t>(&timespec);
+				flags |= IORING_ENTER_EXT_ARG;
+			}
+			const auto extended = flags & IORING_ENTER_EXT_ARG;
+			if (::syscall(__NR_io_uring_enter, _ring, pending, min_completions, flags, extended ? &argument : nullptr, extended ? sizeof argument : 0) == -1)
+			{
+				switch (errno)
+				{
+				case EINTR:
+				case EAGAIN:
+				case EBUSY:
+				case ETIME:
+					return;
+				default:
+					throw std::system_error(errno, std::generic_category());
+				}
+			}
+		}
+
+		// Calls the function for every available completion.
+		// The function may consume completions too.
+		template <typename Function>
+		void complete(Function&& function)
+		{
+			while (has_completions())
+			{
+				const auto head = *_cq_head;
+				const auto cqe = _cqes[head & _cq_mask];
+				__atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+				function(cqe);
+			}
+		}
+
+		bool register_resource(unsigned opcode, void* argument, unsigned count)
+		{
+			return ::syscall(__NR_io_uring_register, _ring, opcode, argument, count) != -1;
+		}
+
+	private:
+		void* map(size_t size, off_t offset)
+		{
+			const auto memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, offset);
+			if (memory == MAP_FAILED)
+				throw std::system_error(errno, std::generic_category());
+			return memory;
+		}
+
+		void release()
+		{
+			if (_sqes)
+				::munmap(_sqes, _sqes_size);
+			if (_cq_ring && _cq_ring != _sq_ring)
+				::munmap(_cq_ring, _cq_ring_size);
+			if (_sq_ring)
+				::munmap(_sq_ring, _sq_ring_size);
+			if (_ring != -1)
+				::close(_ring);
+		}
+
+	private:
+		int _ring = -1;
+		void* _sq_ring = nullptr;
+		size_t _sq_ring_size = 0;
+		void* _cq_ring = nullptr;
+		size_t _cq_ring_size = 0;
+		::io_uring_sqe* _sqes = nullptr;
+		size_t _sqes_size = 0;
+		unsigned* _sq_head = nullptr;
+		unsigned* _sq_tail = nullptr;
+		unsigned _sq_mask = 0;
+		unsigned _sq_entries = 0;
+		unsigned _sq_local_tail = 0;
+		unsigned* _cq_head = nullptr;
+		unsigned* _cq_tail = nullptr;
+		unsigned _cq_mask = 0;
+		::io_uring_cqe* _cqes = nullptr;
+	};
+
+	// Receive buffers the kernel picks from when the data arrives.
+	class BufferRing
+	{
+	public:
+		BufferRing(Ring& ring, unsigned count, size_t size)
+			: _ring{ring}
+			, _size{size}
+			, _mask{static_cast<uint16_t>(count - 1)}
+			, _storage(count * size)
+			, _memory_size{count * sizeof(::io_uring_buf)}
+		{
+			assert(count > 0 && count <= 32768 && !(count & (count - 1)));
+			// The ring memory must be page-aligned.
+			const auto memory = ::mmap(nullptr, _memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+				throw std::system_error(errno, std::generic_category());
+			// The ring tail overlaps the first buffer. Note that 'io_uring_buf_ring::bufs'
+			// can't be used because its empty struct trick for C flexible arrays shifts it in C++.
+			_buffers = static_cast<::io_uring_buf*>(memory);
+			_tail = &static_cast<::io_uring_buf_ring*>(memory)->tail;
+			::io_uring_buf_reg registration = {};
+			registration.ring_addr = reinterpret_cast<uint64_t>(memory);
+			registration.ring_entries = count;
+			registration.bgid = UringBufferGroup;
+			if (!_ring.register_resource(IORING_REGISTER_PBUF_RING, &registration, 1))
+			{
+				const auto error = errno;
+				::munmap(_buffers, _memory_size);
+				throw std::system_error(error, std::generic_category());
+			}
+			for (unsigned i = 0; i < count; ++i)
+				recycle(static_cast<uint16_t>(i));
+		}
+
+		~BufferRing()
+		{
+			::io_uring_buf_reg registration = {};
+			registration.bgid = UringBufferGroup;
+			_ring.register_resource(IORING_UNREGISTER_PBUF_RING, &registration, 1);
+			::munmap(_buffers, _memory_size);
+		}
+
+		uint8_t* data(uint16_t id)
+		{
+			return &_storage[id * _size];
+		}
+
+		// Gives the buffer back to the kernel.
+		void recycle(uint16_t id)
+		{
+			// The buffers are filled field by field not to overwrite the tail.
+			auto& buffer = _buffers[_local_tail & _mask];
+			buffer.addr = reinterpret_cast<uint64_t>(data(id));
+			buffer.len = static_cast<uint32_t>(_size);
+			buffer.bid = id;
+			__atomic_store_n(_tail, ++_local_tail, __ATOMIC_RELEASE);
+		}
+
+	private:
+		Ring& _ring;
+		const size_t _size;
+		const uint16_t _mask;
+		std::vector<uint8_t> _storage;
+		const size_t _memory_size;
+		::io_uring_buf* _buffers = nullptr;
+		uint16_t* _tail = nullptr;
+		uint16_t _local_tail = 0;
+	};
+
+	bool probe_uring()
+	{
+		try
+		{
+			Ring ring{1};
+			std::vector<uint8_t> buffer(sizeof(::io_uring_probe) + 256 * sizeof(::io_uring_probe_op));
+			const auto probe = reinterpret_cast<::io_uring_probe*>(buffer.data());
+			if (!ring.register_resource(IORING_REGISTER_PROBE, probe, 256))
+				return false;
+			// There is no way to detect multishot receive support (Linux 6.0)
+			// other than by the presence of the zero-copy send operation introduced in the same version.
+			for (const auto operation : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC})
+				if (operation > probe->last_op || !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED))
+					return false;
+			BufferRing buffers{ring, 1, 1};
+			return true;
+		}
+		catch (const std::system_error&)
+		{
+			return false;
+		}
+	}
+}
+
+namespace ynet
+{
+	// The received data is passed to the callbacks directly from the loop buffers,
+	// so the connection has nothing to receive itself.
+	class UringConnection : public ConnectionImpl
+	{
+	public:
+		// A nonzero high water mark makes sends nonblocking.
+		UringConnection(const Endpoint& endpoint, Socket&& socket, UringLoop& loop, size_t high_water_mark, size_t low_water_mark)
+			: ConnectionImpl{endpoint}
+			, _socket{std::move(socket)}
+			, _id{make_connection_id()}
+			, _loop{loop}
+			, _high_water_mark{high_water_mark}
+			, _low_water_mark{low_water_mark}
+		{
+		}
+
+		~UringConnection() override = default;
+
+		void abort() override;
+		bool send(const void* data, size_t size) override;
+		bool send(const Block* blocks, size_t count) override;
+		bool send_zerocopy(const std::shared_ptr<const void>& data, size_t size) override { return send(data.get(), size); }
+		bool send_file(int file, uint64_t offset, size_t size) override;
+		bool send_descriptors(const void*, size_t, const int*, size_t) override { return false; } // The output is sent without control messages.
+		size_t pending_bytes() const override;
+		void set_idle_timeout(int milliseconds) override;
+		void shutdown() override;
+
+		int socket() const { return _socket.get(); }
+
+		// Identifies the connection in requests to the loop (see SocketConnection::id).
+		uint64_t id() const { return _id; }
+
+	private:
+		friend UringLoop;
+
+		enum class State
+		{
+			Open,
+			Closing,
+			Closed,
+		};
+
+		mutable std::mutex _mutex;
+		std::condition_variable _sent_event;
+		const Socket _socket;
+		const uint64_t _id;
+		UringLoop& _loop;
+		const size_t _high_water_mark;
+		const size_t _low_water_mark;
+		State _state = State::Open;
+		bool _shutdown_pending = false; // Write shutdown waits for all data to be sent.
+		bool _flush_requested = false;
+		bool _output_full = false; // Reached the high water mark and hasn't drained to the low one since.
+		std::vector<uint8_t> _output; // Data waiting to be submitted.
+		std::vector<uint8_t> _sending; // Data being sent by the kernel.
+		size_t _sending_offset = 0;
+		uint64_t _queued_bytes = 0;
+		uint64_t _sent_bytes = 0;
+	};
+
+	// Serves a set of connections in a single thread using its own ring.
+	class UringLoop
+	{
+	public:
+		UringLoop(UringServer&, size_t buffer_size);
+		~UringLoop();
+
+		// Adds a connection to the loop. Must be called from the loop thread.
+		void add(std::shared_ptr<UringConnection>&&);
+
+		// Adds a connection to the loop from any thread.
+		void post(std::shared_ptr<UringConnection>&&);
+
+		// Requests the queued connection data to be submitted. May be called from any thread.
+		void flush(UringConnection&);
+
+		// Calls the function from the loop thread. May be called from any thread.
+		void post(std::function<void()>&&);
+
+		// Calls the function from the loop thread at the specified time. Must be called from the loop thread.
+		void schedule(TimerWheel::Clock::time_point, std::function<void()>&&);
+
+		// Makes the loop abort the connection once it has been idle for the specified time,
+		// starting from now. Zero disables the timeout. May be called from any thread.
+		void set_idle_timeout(UringConnection&, int milliseconds);
+
+		// Starts accepting connections on the listening socket.
+		void listen(int socket);
+
+		// Stops listening and gracefully shuts down all connections, aborting the ones still open at the deadline.
+		// May be called from any thread.
+		void stop(TimerWheel::Clock::time_point deadline = TimerWheel::Clock::time_point::max());
+
+		void run(ServerBackend::Callbacks&);
+
+		bool is_current() const { return std::this_thread::get_id() == _thread; }
+
+		// Returns true if called from any loop thread of the server.
+		bool is_server_thread() const;
+
+		// Waits until all queued connection data is sent, postponing all other completions.
+		// Must be called from the loop thread.
+		void wait_sent(UringConnection&);
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<UringConnection> connection;
+			bool receiving = false;
+			bool sending = false;
+			bool disconnected = false;
+			bool aborted = false;
+			bool full = false; // The output queue was reported as full.
+			TimerWheel::Clock::duration idle_timeout{};
+			TimerWheel::Clock::time_point last_active; // Last time data was received or sent.
+			TimerWheel::Timer idle_timer;
+		};
+
+		void abort(Entry&);
+		void abort_all();
+		void expire_idle(Entry&);
+		void process_posted();
+		void on_completed(const ::io_uring_cqe&);
+		void on_accept_completed(const ::io_uring_cqe&);
+		void on_disconnected(Entry&);
+		void on_receive_completed(Entry&, const ::io_uring_cqe&);
+		void on_send_completed(Entry&, const ::io_uring_cqe&);
+		void report_output(Entry&);
+		void start_accept();
+		void start_receive(Entry&);
+		bool start_send(Entry&);
+		void start_wakeup();
+		void try_erase(Entry&);
+		void wake();
+
+	private:
+		UringServer& _server;
+		Ring _ring;
+		BufferRing _buffers;
+		const int _wakeup;
+		uint64_t _wakeup_value = 0;
+		ServerBackend::Callbacks* _callbacks = nullptr;
+		ServerBackend::Batch _batch; // The batched data is copied from the ring buffers.
+		std::thread::id _thread;
+		// Ring operations refer to connection entries, which remain valid until the entries are erased.
+		PooledMap<int, Entry> _connections = create_pooled_map<int, Entry>();
+		std::vector<::io_uring_cqe> _postponed;
+		TimerWheel _timers;
+		TimerWheel::Clock::time_point _now; // Time the current completion batch has been received.
+		int _listening_socket = -1;
+		bool _accepting = false;
+		bool _stopping = false;
+		bool _aborting = false; // The shutdown deadline has expired.
+		TimerWheel::Clock::time_point _abort_time = TimerWheel::Clock::time_point::max();
+		TimerWheel::Timer _abort_timer;
+		std::mutex _mutex;
+		std::vector<std::shared_ptr<UringConnection>> _posted;
+		std::vector<std::function<void()>> _tasks;
+		std::vector<std::pair<int, uint64_t>> _flushes; // Sockets and ids of the connections.
+		std::vector<std::pair<int, uint64_t>> _flushing;
+		bool _stop_requested = false;
+		TimerWheel::Clock::time_point _stop_deadline = TimerWheel::Clock::time_point::max();
+	};
+
+	void UringConnection::abort()
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		if (_state != State::Closed)
+		{
+			::shutdown(_socket.get(), SHUT_RDWR);
+			_state = State::Closed;
+			_output.clear();
+			_sent_event.notify_all();
+		}
+	}
+
+	bool UringConnection::send(const void* data, size_t size)
+	{
+		const Block block{data, size};
+		return send(&block, 1);
+	}
+
+	bool UringConnection::send(const Block* blocks, size_t count)
+	{
+		std::unique_lock<std::mutex> lock{_mutex};
+		if (_state != State::Open)
+			return false;
+		if (_high_water_mark && _queued_bytes - _sent_bytes >= _high_water_mark)
+			return false;
+		// Other loop threads can't wait for the loop, which may be waiting for them in turn,
+		// so their data is only queued, and the sends fail if the loop doesn't keep up.
+		const auto from_other_loop = !_high_water_mark && !_loop.is_current() && _loop.is_server_thread();
+		if (from_other_loop && _queued_bytes - _sent_bytes > UringMaxQueuedSize)
+			return false;
+		// The blocks are gathered into the output buffer, so there is no need for vectored sends.
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto data = static_cast<const uint8_t*>(blocks[i].data);
+			_output.insert(_output.end(), data, data + blocks[i].size);
+			_queued_bytes += blocks[i].size;
+		}
+		// The loop reports the queue becoming full when processing the flush request.
+		const auto became_full = _high_water_mark && !_output_full && _queued_bytes - _sent_bytes >= _high_water_mark;
+		if (became_full)
+			_output_full = true;
+		if (!_flush_requested || became_full)
+		{
+			_flush_requested = true;
+			_loop.flush(*this);
+		}
+		if (_high_water_mark || from_other_loop)
+			return true;
+		const auto queued_bytes = _queued_bytes;
+		// The loop thread can't wait for itself, so the data it sends is submitted
+		// in a single batch with other ring operations after the callback returns,
+		// unless there is too much data queued already.
+		if (_loop.is_current())
+		{
+			if (queued_bytes - _sent_bytes > UringMaxQueuedSize)
+			{
+				lock.unlock();
+				_loop.wait_sent(*this);
+				lock.lock();
+			}
+			return _state != State::Closed;
+		}
+		_sent_event.wait(lock, [this, queued_bytes]{ return _sent_bytes >= queued_bytes || _state == State::Closed; });
+		return _sent_bytes >= queued_bytes;
+	}
+
+	bool UringConnection::send_file(int file, uint64_t offset, size_t size)
+	{
+		// The file is read into the output buffer, which is simpler than chaining splice operations.
+		std::vector<uint8_t> data(size);
+		for (size_t read_size = 0; read_size < size;)
+		{
+			const auto result = ::pread(file, data.data() + read_size, size - read_size, static_cast<off_t>(offset + read_size));
+			if (result == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				throw std::system_error(errno, std::generic_category());
+			}
+			if (!result)
+				return false;
+			read_size += static_cast<size_t>(result);
+		}
+		return send(data.data(), data.size());
+	}
+
+	size_t UringConnection::pending_bytes() const
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		return static_cast<size_t>(_queued_bytes - _sent_bytes);
+	}
+
+	void UringConnection::set_idle_timeout(int milliseconds)
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		// Closed connections may outlive the loop.
+		if (_state != State::Closed)
+			_loop.set_idle_timeout(*this, milliseconds);
+	}
+
+	void UringConnection::shutdown()
+	{
+		std::lock_guard<std::mutex> lock{_mutex};
+		if (_state == State::Open)
+		{
+			_state = State::Closing;
+			if (_output.empty() && _sending.empty())
+				::shutdown(_socket.get(), SHUT_WR);
+			else
+				_shutdown_pending = true;
+		}
+	}
+
+	UringLoop::UringLoop(UringServer& server, size_t buffer_size)
+		: _server{server}
+		, _ring{UringEntries}
+		, _buffers{_ring, UringBufferCount, buffer_size}
+		, _wakeup{::eventfd(0, EFD_CLOEXEC)}
+		, _timers{TimerWheel::Clock::now()}
+	{
+		if (_wakeup == -1)
+			throw std::system_error(errno, std::generic_category());
+	}
+
+	UringLoop::~UringLoop()
+	{
+		assert(_connections.empty());
+		::close(_wakeup);
+	}
+
+	void UringLoop::add(std::shared_ptr<UringConnection>&& connection)
+	{
+		const auto socket = connection->socket();
+		auto& entry = _connections.emplace(socket, Entry{std::move(connection)}).first->second;
+		// The connection may already be sending data from the callback.
+		_callbacks->on_connected(entry.connection);
+		start_receive(entry);
+		if (_aborting)
+			abort(entry);
+		else if (_stopping)
+			entry.connection->shutdown();
+	}
+
+	void UringLoop::post(std::shared_ptr<UringConnection>&& connection)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_posted.emplace_back(std::move(connection));
+		}
+		wake();
+	}
+
+	void UringLoop::flush(UringConnection& connection)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_flushes.emplace_back(connection.socket(), connection.id());
+		}
+		if (!is_current())
+			wake();
+	}
+
+	void UringLoop::post(std::function<void()>&& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_tasks.emplace_back(std::move(task));
+		}
+		wake();
+	}
+
+	void UringLoop::schedule(TimerWheel::Clock::time_point time, std::function<void()>&& function)
+	{
+		assert(is_current());
+		_timers.schedule(time, std::move(function));
+	}
+
+	void UringLoop::set_idle_timeout(UringConnection& connection, int milliseconds)
+	{
+		const auto set = [this, socket = connection.socket(), id = connection.id(), milliseconds]
+		{
+			// The connection may have been closed since the request, and the socket reused by another one.
+			const auto i = _connections.find(socket);
+			if (i == _connections.end() || i->second.connection->id() != id)
+				return;
+			auto& entry = i->second;
+			_timers.cancel(entry.idle_timer);
+			entry.idle_timer = {};
+			entry.idle_timeout = std::chrono::milliseconds{milliseconds};
+			if (milliseconds <= 0)
+				return;
+			entry.last_active = TimerWheel::Clock::now();
+			entry.idle_timer = _timers.schedule(entry.last_active + entry.idle_timeout, [this, &entry]{ expire_idle(entry); });
+		};
+		if (is_current())
+			set();
+		else
+			post(set);
+	}
+
+	void UringLoop::listen(int socket)
+	{
+		assert(_listening_socket == -1);
+		_listening_socket = socket;
+	}
+
+	void UringLoop::stop(TimerWheel::Clock::time_point deadline)
+	{
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			_stop_requested = true;
+			_stop_deadline = std::min(_stop_deadline, deadline);
+		}
+		wake();
+	}
+
+	void UringLoop::run(ServerBackend::Callbacks& callbacks)
+	{
+		_callbacks = &callbacks;
+		_thread = std::this_thread::get_id();
+		start_wakeup();
+		if (_listening_socket != -1)
+			start_accept();
+		std::vector<::io_uring_cqe> postponed;
+		for (;;)
+		{
+			process_posted();
+			if (_stopping && _connections.empty() && !_accepting)
+				break;
+			// All operations started during the previous iteration are submitted with a single call.
+			const auto timeout = _timers.timeout(TimerWheel::Clock::now());
+			_ring.submit(_ring.has_completions() || !_postponed.empty() || !timeout ? 0 : 1, timeout);
+			_now = TimerWheel::Clock::now();
+			postponed.swap(_postponed);
+			for (const auto& cqe : postponed)
+				on_completed(cqe);
+			postponed.clear();
+			_ring.complete([this](const ::io_uring_cqe& cqe){ on_completed(cqe); });
+			_callbacks->on_received_batch(_batch);
+			_timers.run(_now);
+		}
+	}
+
+	bool UringLoop::is_server_thread() const
+	{
+		return std::any_of(_server._loops.begin(), _server._loops.end(), [](const auto& loop){ return loop->is_current(); });
+	}
+
+	void UringLoop::wait_sent(UringConnection& connection)
+	{
+		const auto i = _connections.find(connection.socket());
+		if (i == _connections.end() || i->second.connection.get() != &connection)
+			return;
+		auto& entry = i->second;
+		// A disconnected entry may be erased by a send completion.
+		if (entry.disconnected)
+			return;
+		{
+			std::lock_guard<std::mutex> lock{connection._mutex};
+			if (!entry.sending)
+				start_send(entry);
+		}
+		const auto send_data = reinterpret_cast<uint64_t>(&entry) | SendOperation;
+		while (entry.sending)
+		{
+			_ring.submit(_ring.has_completions() ? 0 : 1);
+			_ring.complete([this, &entry, send_data](const ::io_uring_cqe& cqe)
+			{
+				if (cqe.user_data == send_data)
+					on_send_completed(entry, cqe);
+				else
+					_postponed.emplace_back(cqe);
+			});
+		}
+	}
+
+	void UringLoop::abort(Entry& entry)
+	{
+		entry.aborted = true;
+		entry.connection->abort();
+		// A multishot receive may keep waiting after the socket is shut down,
+		// and the connection is only erased once its receive operation completes.
+		if (entry.receiving)
+		{
+			auto& sqe = _ring.push();
+			sqe.opcode = IORING_OP_ASYNC_CANCEL;
+			sqe.addr = reinterpret_cast<uint64_t>(&entry) | ReceiveOperation;
+			sqe.user_data = CancelData;
+		}
+	}
+
+	void UringLoop::abort_all()
+	{
+		_aborting = true;
+		for (auto& connection : _connections)
+			abort(connection.second);
+	}
+
+	void UringLoop::expire_idle(Entry& entry)
+	{
+		entry.idle_timer = {};
+		const auto deadline = entry.last_active + entry.idle_timeout;
+		if (deadline > _now)
+			entry.idle_timer = _timers.schedule(deadline, [this, &entry]{ expire_idle(entry); });
+		else
+			abort(entry);
+	}
+
+	void UringLoop::process_posted()
+	{
+		decltype(_posted) posted;
+		decltype(_tasks) tasks;
+		bool stop_requested = false;
+		auto stop_deadline = TimerWheel::Clock::time_point::max();
+		{
+			std::lock_guard<std::mutex> lock{_mutex};
+			posted.swap(_posted);
+			tasks.swap(_tasks);
+			_flushing.swap(_flushes);
+			stop_requested = _stop_requested;
+			stop_deadline = _stop_deadline;
+		}
+		for (auto& connection : posted)
+			add(std::move(connection));
+		for (const auto& task : tasks)
+			task();
+		for (const auto& flush : _flushing)
+		{
+			// The connection may have been closed since the request, and the socket reused by another one.
+			const auto i = _connections.find(flush.first);
+			if (i == _connections.end() || i->second.connection->id() != flush.second)
+				continue;
+			auto& entry = i->second;
+			{
+				std::lock_guard<std::mutex> lock{entry.connection->_mutex};
+				entry.connection->_flush_requested = false;
+				if (!entry.sending)
+					start_send(entry);
+			}
+			report_output(entry);
+		}
+		_flushing.clear();
+		if (stop_requested && !_stopping)
+		{
+			_stopping = true;
+			if (_accepting)
+			{
+				auto& sqe = _ring.push();
+				sqe.opcode = IORING_OP_ASYNC_CANCEL;
+				sqe.addr = AcceptData;
+				sqe.user_data = CancelData;
+			}
+			for (const auto& connection : _connections)
+				connection.second.connection->shutdown();
+		}
+		// The deadline may be moved closer by another stop request.
+		if (stop_deadline < _abort_time && !_aborting)
+		{
+			_abort_time = stop_deadline;
+			_timers.cancel(_abort_timer);
+			_abort_timer = _timers.schedule(_abort_time, [this]{ abort_all(); });
+		}
+	}
+
+	void UringLoop::on_completed(const ::io_uring_cqe& cqe)
+	{
+		switch (cqe.user_data)
+		{
+		case AcceptData:
+			on_accept_completed(cqe);
+			break;
+		case WakeupData:
+			start_wakeup();
+			break;
+		case CancelData:
+			break;
+		default:
+			auto& entry = *reinterpret_cast<Entry*>(cqe.user_data & ~OperationMask);
+			if ((cqe.user_data & OperationMask) == SendOperation)
+				on_send_completed(entry, cqe);
+			else
+				on_receive_completed(entry, cqe);
+		}
+	}
+
+	void UringLoop::on_accept_completed(const ::io_uring_cqe& cqe)
+	{
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			_accepting = false;
+		if (cqe.res >= 0)
+			_server.on_accepted(*this, Socket{cqe.res});
+		else
+		{
+			switch (-cqe.res)
+			{
+			case ECANCELED:
+				return;
+			case EAGAIN:
+			case ECONNABORTED:
+			case EINTR:
+				break;
+			default:
+				_server.on_shut_down();
+				return;
+			}
+		}
+		if (!_accepting && !_stopping)
+			start_accept();
+	}
+
+	void UringLoop::on_disconnected(Entry& entry)
+	{
+		entry.disconnected = true;
+		// The batch may contain the data received from the connection.
+		_callbacks->on_received_batch(_batch);
+		_callbacks->on_disconnected(entry.connection);
+		try_erase(entry);
+	}
+
+	void UringLoop::on_receive_completed(Entry& entry, const ::io_uring_cqe& cqe)
+	{
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			entry.receiving = false;
+		if (cqe.res > 0)
+		{
+			entry.last_active = _now;
+			const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			// Clients which keep sending data mustn't delay the shutdown, so the data is discarded.
+			if (!_stopping)
+				_callbacks->on_received(entry.connection, _buffers.data(id), static_cast<size_t>(cqe.res), _batch);
+			_buffers.recycle(id);
+			if (_server._quickack)
+				enable_quickack(entry.connection->socket());
+		}
+		else if (cqe.res != -ENOBUFS)
+		{
+			on_disconnected(entry);
+			return;
+		}
+		if (entry.receiving)
+			return;
+		// Receiving also stops when the loop runs out of buffers.
+		if (entry.aborted)
+			on_disconnected(entry);
+		else
+			start_receive(entry);
+	}
+
+	void UringLoop::on_send_completed(Entry& entry, const ::io_uring_cqe& cqe)
+	{
+		entry.sending = false;
+		{
+			auto& connection = *entry.connection;
+			std::lock_guard<std::mutex> lock{connection._mutex};
+			if (cqe.res < 0)
+			{
+				// The connection is broken, and the receiving side will find it out too.
+				connection._state = UringConnection::State::Closed;
+				connection._output.clear();
+				connection._sending.clear();
+			}
+			else
+			{
+				entry.last_active = _now;
+				connection._sending_offset += static_cast<size_t>(cqe.res);
+				connection._sent_bytes += static_cast<uint64_t>(cqe.res);
+				if (connection._queued_bytes - connection._sent_bytes <= connection._low_water_mark)
+					connection._output_full = false;
+				if (connection._sending_offset == connection._sending.size())
+					connection._sending.clear();
+				if (!start_send(entry) && connection._shutdown_pending && connection._state != UringConnection::State::Closed)
+				{
+					connection._shutdown_pending = false;
+					::shutdown(connection.socket(), SHUT_WR);
+				}
+			}
+			connection._sent_event.notify_all();
+		}
+		report_output(entry);
+		try_erase(entry);
+	}
+
+	void UringLoop::report_output(Entry& entry)
+	{
+		bool full = false;
+		{
+			std::lock_guard<std::mutex> lock{entry.connection->_mutex};
+			full = entry.connection->_output_full;
+		}
+		if (full == entry.full || entry.disconnected)
+			return;
+		entry.full = full;
+		if (full)
+			_callbacks->on_send_buffer_full(entry.connection);
+		else
+			_callbacks->on_writable(entry.connection);
+	}
+
+	void UringLoop::start_accept()
+	{
+		auto& sqe = _ring.push();
+		sqe.opcode = IORING_OP_ACCEPT;
+		sqe.fd = _listening_socket;
+		sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe.user_data = AcceptData;
+		_accepting = true;
+	}
+
+	void UringLoop::start_receive(Entry& entry)
+	{
+		auto& sqe = _ring.push();
+		sqe.opcode = IORING_OP_RECV;
+		sqe.fd = entry.connection->socket();
+		sqe.flags = IOSQE_BUFFER_SELECT;
+		sqe.buf_group = UringBufferGroup;
+		sqe.ioprio = IORING_RECV_MULTISHOT;
+		sqe.user_data = reinterpret_cast<uint64_t>(&entry) | ReceiveOperation;
+		entry.receiving = true;
+	}
+
+	bool UringLoop::start_send(Entry& entry)
+	{
+		// The connection mutex must be locked.
+		auto& connection = *entry.connection;
+		if (connection._state == UringConnection::State::Closed)
+			return false;
+		if (connection._sending.empty())
+		{
+			if (connection._output.empty())
+				return false;
+			connection._output.swap(connection._sending);
+			connection._sending_offset = 0;
+		}
+		auto& sqe = _ring.push();
+		sqe.opcode = IORING_OP_SEND;
+		sqe.fd = connection.socket();
+		sqe.addr = reinterpret_cast<uint64_t>(connection._sending.data() + connection._sending_offset);
+		sqe.len = static_cast<uint32_t>(std::min<size_t>(connection._sending.size() - connection._sending_offset, std::numeric_limits<uint32_t>::max()));
+		sqe.msg_flags = MSG_NOSIGNAL;
+		sqe.user_data = reinterpret_cast<uint64_t>(&entry) | SendOperation;
+		entry.sending = true;
+		return true;
+	}
+
+	void UringLoop::start_wakeup()
+	{
+		auto& sqe = _ring.push();
+		sqe.opcode = IORING_OP_READ;
+		sqe.fd = _wakeup;
+		sqe.addr = reinterpret_cast<uint64_t>(&_wakeup_value);
+		sqe.len = sizeof _wakeup_value;
+		sqe.user_data = WakeupData;
+	}
+
+	void UringLoop::try_erase(Entry& entry)
+	{
+		if (!entry.disconnected || entry.sending)
+			return;
+		const auto socket = entry.connection->socket();
+		{
+			std::lock_guard<std::mutex> lock{entry.connection->_mutex};
+			// The peer may have shut down only its side of the connection, so the queued data is still sent.
+			if (start_send(entry))
+				return;
+			entry.connection->_state = UringConnection::State::Closed;
+			entry.connection->_sent_event.notify_all();
+		}
+		_timers.cancel(entry.idle_timer);
+		_connections.erase(socket);
+	}
+
+	void UringLoop::wake()
+	{
+		const uint64_t value = 1;
+		static_cast<void>(::write(_wakeup, &value, sizeof value));
+	}
+
+	UringServer::UringServer(std::vector<Socket>&& sockets, SocketConnection::Transport transport, const Server::Options& options)
+		: _sockets{std::move(sockets)}
+		, _transport{transport}
+		, _socket_options{options.socket}
+		, _quickack{transport == SocketConnection::Transport::Tcp && options.socket.tcp_quickack}
+		, _accept_in_all_threads{options.reuse_port}
+		, _send_high_water_mark{options.nonblocking_send ? std::max<size_t>(options.send_high_water_mark, 1) : 0}
+		, _send_low_water_mark{_send_high_water_mark ? std::min(options.send_low_water_mark, _send_high_water_mark - 1) : 0}
+		, _connection_pool{create_object_pool<UringConnection>()}
+	{
+		const auto threads = SocketServer::thread_count(options);
+		assert(_sockets.size() == 1 || (_sockets.size() == threads && _accept_in_all_threads));
+		_loops.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			_loops.emplace_back(std::make_unique<UringLoop>(*this, std::max<size_t>(options.socket.receive_buffer_size, 1)));
+	}
+
+	UringServer::~UringServer() = default;
+
+	void UringServer::run(Callbacks& callbacks)
+	{
+		if (_accept_in_all_threads)
+		{
+			for (size_t i = 0; i < _loops.size(); ++i)
+				_loops[i]->listen(_sockets[i % _sockets.size()].get());
+		}
+		else
+			_loops.front()->listen(_sockets.front().get());
+		std::vector<std::thread> threads;
+		threads.reserve(_loops.size() - 1);
+		for (size_t i = 1; i < _loops.size(); ++i)
+			threads.emplace_back([this, i, &callbacks]{ _loops[i]->run(callbacks); });
+		_loops.front()->run(callbacks);
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void UringServer::schedule(int milliseconds, std::function<void()>&& function)
+	{
+		// The delay is counted from the call rather than from the time the loop gets the request.
+		const auto time = TimerWheel::Clock::now() + std::chrono::milliseconds{milliseconds};
+		auto& loop = *_loops[_next_timer_loop];
+		_next_timer_loop = (_next_timer_loop + 1) % _loops.size();
+		loop.post([&loop, time, function = std::move(function)]() mutable { loop.schedule(time, std::move(function)); });
+	}
+
+	void UringServer::shutdown(int milliseconds)
+	{
+		// All loops share the deadline, which is counted from the shutdown request.
+		const auto deadline = milliseconds < 0 ? TimerWheel::Clock::time_point::max() : TimerWheel::Clock::now() + std::chrono::milliseconds{milliseconds};
+		for (const auto& loop : _loops)
+			loop->stop(deadline);
+		for (const auto& socket : _sockets)
+			::shutdown(socket.get(), SHUT_RD);
+	}
+
+	bool UringServer::is_supported()
+	{
+		static const bool supported = ::probe_uring();
+		return supported;
+	}
+
+	void UringServer::on_accepted(UringLoop& loop, Socket&& socket)
+	{
+		// Unlike TCP ones, local sockets don't inherit buffer sizes from the listening socket.
+		if (_transport == SocketConnection::Transport::Local && !set_buffer_sizes(socket.get(), _socket_options))
+			return;
+		Connection::Endpoint endpoint;
+		if (!peer_endpoint(socket.get(), endpoint))
+			return;
+		auto& target = _accept_in_all_threads ? loop : *_loops[_next_loop];
+		if (!_accept_in_all_threads)
+			_next_loop = (_next_loop + 1) % _loops.size();
+		auto connection = std::allocate_shared<UringConnection>(PoolAllocator<UringConnection>{_connection_pool}, endpoint, std::move(socket), target, _send_high_water_mark, _send_low_water_mark);
+		if (&target == &loop)
+			target.add(std::move(connection));
+		else
+			target.post(std::move(connection));
+	}
+
+	void UringServer::on_shut_down()
+	{
+		for (const auto& loop : _loops)
+			loop->stop();
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "socket.h"
+
+namespace ynet
+{
+	class UringLoop;
+
+	// Serves connections using io_uring instead of readiness notifications,
+	// receiving into kernel-selected buffers and submitting sends in batches.
+	class UringServer : public ServerBackend
+	{
+	public:
+		// There should be either a single listening socket or one for each thread.
+		UringServer(std::vector<Socket>&& sockets, SocketConnection::Transport, const Server::Options&);
+		~UringServer() override;
+
+		void run(Callbacks& callbacks) final;
+		void schedule(int milliseconds, std::function<void()>&&) final;
+		void shutdown(int milliseconds) final;
+
+		// Returns false if the peer is already disconnected.
+		virtual bool peer_endpoint(int socket, Connection::Endpoint&) = 0;
+
+		// Returns true if the kernel supports all io_uring features used by the server.
+		static bool is_supported();
+
+	private:
+		friend UringLoop;
+
+		void on_accepted(UringLoop&, Socket&&);
+		void on_shut_down();
+
+	private:
+		const std::vector<Socket> _sockets;
+		const SocketConnection::Transport _transport;
+		const SocketOptions _socket_options;
+		const bool _quickack;
+		const bool _accept_in_all_threads;
+		const size_t _send_high_water_mark; // Zero for blocking sends.
+		const size_t _send_low_water_mark;
+		const std::shared_ptr<BufferPool> _connection_pool; // Accepted connections are allocated from it.
+		std::vector<std::unique_ptr<UringLoop>> _loops;
+		size_t _next_loop = 0;
+		size_t _next_timer_loop = 0;
+	};
+}
@@ -1,5 +1,134 @@
 #include "common.h"
 
+#include <algorithm>
+#include <fstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+const ynet::Server::Options IoUringOptions = []
+{
+	ynet::Server::Options options;
+	options.io_uring = true;
+	return options;
+}();
+
+const ynet::Server::Options NonblockingOptions = []
+{
+	ynet::Server::Options options;
+	options.nonblocking_send = true;
+	return options;
+}();
+
+const ynet::Server::Options SharedMemoryOptions = []
+{
+	ynet::Server::Options options;
+	options.socket.shared_memory_size = 4096;
+	return options;
+}();
+
+const ynet::Server::Options DescriptorOptions = []
+{
+	ynet::Server::Options options;
+	options.socket.max_received_descriptors = 1;
+	return options;
+}();
+
+const ynet::Server::Options SeqpacketOptions = []
+{
+	ynet::Server::Options options;
+	options.socket.seqpacket = true;
+	options.socket.receive_buffer_size = 256 * 1024;
+	options.socket.kernel_send_buffer_size = 256 * 1024;
+	return options;
+}();
+
+const ynet::SocketOptions CustomSocketOptions = []
+{
+	ynet::SocketOptions options;
+	options.receive_buffer_size = 1000;
+	options.kernel_send_buffer_size = 16 * 1024;
+	options.kernel_receive_buffer_size = 16 * 1024;
+	options.tcp_nodelay = true;
+	options.tcp_quickack = true;
+	options.keepalive = true;
+	options.keepalive_idle = 60;
+	options.keepalive_interval = 10;
+	options.keepalive_count = 3;
+	return options;
+}();
+
+namespace
+{
+	bool send_blocks(ynet::Connection& connection, const std::vector<uint8_t>& buffer, size_t count)
+	{
+		if (count == 1)
+			return connection.send(buffer.data(), buffer.size());
+		// The blocks are of different sizes, with an empty one in the middle.
+		std::vector<ynet::Connection::Block> blocks;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (i == count / 2)
+				blocks.push_back({nullptr, 0});
+			const auto begin = buffer.size() * i * i / (count * count);
+			const auto end = buffer.size() * (i + 1) * (i + 1) / (count * count);
+			blocks.push_back({&buffer[begin], end - begin});
+		}
+		return connection.send(blocks.data(), blocks.size());
+	}
+}
+
+TestClient::Factory with_context(const TestClient::Factory& factory, ynet::ClientContext& context, bool nonblocking_send)
+{
+	return [factory, &context, nonblocking_send](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.context = &context;
+		options.nonblocking_send = nonblocking_send;
+		return factory(callbacks, options);
+	};
+}
+
+TestClient::Factory with_resolver(const TestClient::Factory& factory, ynet::Resolver& resolver)
+{
+	return [factory, &resolver](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.resolver = &resolver;
+		return factory(callbacks, options);
+	};
+}
+
+TestClient::Factory with_shared_memory(const TestClient::Factory& factory)
+{
+	return [factory](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.socket.shared_memory_size = SharedMemoryOptions.socket.shared_memory_size;
+		return factory(callbacks, options);
+	};
+}
+
+TestClient::Factory with_descriptors(const TestClient::Factory& factory)
+{
+	return [factory](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.socket.max_received_descriptors = DescriptorOptions.socket.max_received_descriptors;
+		return factory(callbacks, options);
+	};
+}
+
+TestClient::Factory with_seqpacket(const TestClient::Factory& factory)
+{
+	return [factory](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.socket = SeqpacketOptions.socket;
+		return factory(callbacks, options);
+	};
+}
+
 void TestClient::start(const Factory& factory)
 {
 	ynet::Client::Options options;
@@ -31,10 +160,9 @@ void TestClient::on_stopped()
 	_stop_condition.notify_one();
 }
 
-void TestServer::start(const Factory& factory)
+void TestServer::start(const Factory& factory, ynet::Server::Options options, int shutdown_timeout)
 {
-	ynet::Server::Options options;
-	options.shutdown_timeout = -1;
+	options.shutdown_timeout = shutdown_timeout;
 	_server = factory(*this, options);
 	std::unique_lock<std::mutex> lock(_mutex);
 	_start_condition.wait(lock, [this]() { return _started; });
@@ -60,8 +188,9 @@ void TestServer::on_started()
 	_start_condition.notify_one();
 }
 
-SendTestClient::SendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+SendTestClient::SendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, size_t blocks)
 	: _buffer(buffer)
+	, _blocks(blocks)
 {
 	start(factory);
 }
@@ -73,7 +202,7 @@ SendTestClient::~SendTestClient()
 
 void SendTestClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
 {
-	EXPECT_TRUE(connection->send(_buffer.data(), _buffer.size()));
+	EXPECT_TRUE(send_blocks(*connection, _buffer, _blocks));
 }
 
 void SendTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
@@ -85,11 +214,12 @@ void SendTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, i
 {
 }
 
-SendTestServer::SendTestServer(const Factory& factory, const std::vector<uint8_t>& buffer)
+SendTestServer::SendTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options)
 	: _buffer(buffer)
+	, _receive_buffer_size(options.socket.receive_buffer_size)
 	, _received(buffer.size())
 {
-	start(factory);
+	start(factory, options);
 }
 
 SendTestServer::~SendTestServer()
@@ -104,6 +234,7 @@ void SendTestServer::on_connected(const std::shared_ptr<ynet::Connection>&)
 
 void SendTestServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
 {
+	EXPECT_LE(size, _receive_buffer_size);
 	const auto remaining_size = _received.size() - _received_size;
 	ASSERT_GE(remaining_size, size);
 	::memcpy(&_received[_received_size], static_cast<const uint8_t*>(data), size);
@@ -117,8 +248,9 @@ void SendTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
 	EXPECT_EQ(_received, _buffer);
 }
 
-ReceiveTestClient::ReceiveTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+ReceiveTestClient::ReceiveTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds receive_delay)
 	: _buffer(buffer)
+	, _receive_delay(receive_delay)
 	, _received(buffer.size())
 {
 	start(factory);
@@ -132,6 +264,7 @@ ReceiveTestClient::~ReceiveTestClient()
 void ReceiveTestClient::on_connected(const std::shared_ptr<ynet::Connection>&)
 {
 	ASSERT_EQ(_received_size, 0);
+	std::this_thread::sleep_for(_receive_delay);
 }
 
 void ReceiveTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void* data, size_t size)
@@ -147,10 +280,11 @@ void ReceiveTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&
 	EXPECT_EQ(_received, _buffer);
 }
 
-ReceiveTestServer::ReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer)
+ReceiveTestServer::ReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options, size_t blocks)
 	: _buffer(buffer)
+	, _blocks(blocks)
 {
-	start(factory);
+	start(factory, options);
 }
 
 ReceiveTestServer::~ReceiveTestServer()
@@ -160,7 +294,7 @@ ReceiveTestServer::~ReceiveTestServer()
 
 void ReceiveTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
 {
-	EXPECT_TRUE(connection->send(_buffer.data(), _buffer.size()));
+	EXPECT_TRUE(send_blocks(*connection, _buffer, _blocks));
 	connection->shutdown();
 }
 
@@ -172,3 +306,986 @@ void ReceiveTestServer::on_received(const std::shared_ptr<ynet::Connection>&, co
 void ReceiveTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
 {
 }
+
+BroadcastTestServer::BroadcastTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, size_t clients, const ynet::Server::Options& options)
+	: _buffer(std::make_shared<const std::vector<uint8_t>>(buffer))
+	, _clients(clients)
+{
+	start(factory, options);
+}
+
+BroadcastTestServer::~BroadcastTestServer()
+{
+	stop();
+	// The connections have released the buffer.
+	EXPECT_EQ(_buffer.use_count(), 1);
+}
+
+void BroadcastTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	std::vector<std::shared_ptr<ynet::Connection>> connections;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_connections.emplace_back(connection);
+		if (_connections.size() < _clients)
+			return;
+		connections.swap(_connections);
+	}
+	const std::shared_ptr<const void> data(_buffer, _buffer->data());
+	EXPECT_EQ(ynet::Server::broadcast(connections.data(), connections.size(), data, _buffer->size()), _clients);
+	for (const auto& client_connection : connections)
+		client_connection->shutdown();
+}
+
+void BroadcastTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void BroadcastTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+BackpressureTestServer::BackpressureTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, ynet::Server::Options options)
+	: _buffer(buffer)
+{
+	options.nonblocking_send = true;
+	options.send_high_water_mark = 64 * 1024;
+	options.send_low_water_mark = 16 * 1024;
+	start(factory, options);
+}
+
+BackpressureTestServer::~BackpressureTestServer()
+{
+	stop();
+	EXPECT_EQ(_sent_size, _buffer.size());
+	EXPECT_GT(_full_count, 0);
+	EXPECT_FALSE(_full);
+}
+
+void BackpressureTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	send_more(connection);
+}
+
+void BackpressureTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void BackpressureTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void BackpressureTestServer::on_send_buffer_full(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_FALSE(_full);
+	EXPECT_GE(connection->pending_bytes(), 64 * 1024);
+	_full = true;
+	++_full_count;
+}
+
+void BackpressureTestServer::on_writable(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_TRUE(_full);
+	EXPECT_LE(connection->pending_bytes(), 16 * 1024);
+	_full = false;
+	send_more(connection);
+}
+
+void BackpressureTestServer::send_more(const std::shared_ptr<ynet::Connection>& connection)
+{
+	const size_t block_size = 16 * 1024;
+	while (_sent_size < _buffer.size())
+	{
+		const auto size = std::min(block_size, _buffer.size() - _sent_size);
+		if (!connection->send(&_buffer[_sent_size], size))
+			return;
+		_sent_size += size;
+	}
+	connection->shutdown();
+}
+
+ZerocopyTestServer::ZerocopyTestServer(const Factory& factory, const std::vector<uint8_t>& buffer)
+	: _size(buffer.size())
+{
+	const auto data = std::make_shared<std::vector<uint8_t>>(buffer);
+	_data = std::shared_ptr<const void>(data, data->data());
+	ynet::Server::Options options;
+	options.nonblocking_send = true;
+	options.zerocopy_send = true;
+	start(factory, options);
+}
+
+ZerocopyTestServer::~ZerocopyTestServer()
+{
+	stop();
+	// The completion may be lost if the client disconnects first.
+	EXPECT_LE(_completed, 1);
+	EXPECT_EQ(_data.use_count(), 1);
+}
+
+void ZerocopyTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_TRUE(connection->send_zerocopy(_data, _size));
+	connection->shutdown();
+}
+
+void ZerocopyTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void ZerocopyTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void ZerocopyTestServer::on_zerocopy_completed(const std::shared_ptr<ynet::Connection>&, const std::shared_ptr<const void>& data)
+{
+	EXPECT_EQ(data, _data);
+	++_completed;
+}
+
+FileTestServer::FileTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options)
+	: _buffer(buffer)
+	, _file(std::tmpfile())
+{
+	EXPECT_TRUE(_file);
+	EXPECT_EQ(std::fwrite(buffer.data(), 1, buffer.size(), _file), buffer.size());
+	EXPECT_EQ(std::fflush(_file), 0);
+	start(factory, options);
+}
+
+FileTestServer::~FileTestServer()
+{
+	stop();
+	std::fclose(_file);
+}
+
+void FileTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	const auto file = ::fileno(_file);
+	const auto part_size = _buffer.size() / 4;
+	EXPECT_FALSE(connection->send_file(file, part_size, _buffer.size()));
+	EXPECT_TRUE(connection->send(_buffer.data(), part_size));
+	EXPECT_TRUE(connection->send_file(file, part_size, _buffer.size() - 2 * part_size));
+	EXPECT_TRUE(connection->send(&_buffer[_buffer.size() - part_size], part_size));
+	connection->shutdown();
+}
+
+void FileTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void FileTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+namespace
+{
+	std::vector<uint8_t> concatenate(const std::vector<std::pair<std::shared_ptr<const void>, size_t>>& parts)
+	{
+		std::vector<uint8_t> result;
+		for (const auto& part : parts)
+			result.insert(result.end(), static_cast<const uint8_t*>(part.first.get()), static_cast<const uint8_t*>(part.first.get()) + part.second);
+		return result;
+	}
+}
+
+RetainTestClient::RetainTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+	: _buffer(buffer)
+{
+	start(factory);
+}
+
+RetainTestClient::~RetainTestClient()
+{
+	stop();
+}
+
+void RetainTestClient::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void RetainTestClient::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	auto retained = connection->retain_received();
+	// The client backends receive into pooled buffers, so the data isn't copied.
+	EXPECT_EQ(retained.get(), data);
+	_retained.emplace_back(std::move(retained), size);
+}
+
+void RetainTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	EXPECT_EQ(concatenate(_retained), _buffer);
+}
+
+RetainTestServer::RetainTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options)
+	: _buffer(buffer)
+	, _worker([this]{ run_worker(); })
+{
+	start(factory, options);
+}
+
+RetainTestServer::~RetainTestServer()
+{
+	stop();
+	_worker.join();
+}
+
+void RetainTestServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void RetainTestServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void*, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.emplace_back(connection->retain_received(), size);
+	}
+	_condition.notify_one();
+	_received_size += size;
+	if (_received_size == _buffer.size())
+		connection->shutdown();
+}
+
+void RetainTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_done = true;
+	}
+	_condition.notify_one();
+}
+
+void RetainTestServer::run_worker()
+{
+	std::vector<std::pair<std::shared_ptr<const void>, size_t>> received;
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		_condition.wait(lock, [this]{ return _done || !_queue.empty(); });
+		received.insert(received.end(), _queue.begin(), _queue.end());
+		_queue.clear();
+		if (_done)
+			break;
+	}
+	EXPECT_EQ(concatenate(received), _buffer);
+}
+
+namespace
+{
+	bool send_message(ynet::Connection& connection, ynet::Framing framing, const std::vector<uint8_t>& message)
+	{
+		uint8_t prefix[ynet::MaxFramePrefixSize];
+		const ynet::Connection::Block blocks[] = {
+			{prefix, ynet::write_frame_prefix(framing, message.size(), prefix)},
+			{message.data(), message.size()},
+		};
+		return connection.send(blocks, 2);
+	}
+}
+
+FramedTestClient::FramedTestClient(const Factory& factory, const std::vector<std::vector<uint8_t>>& messages, ynet::Framing framing, size_t expected_replies)
+	: _messages(messages)
+	, _framing(framing)
+	, _expected_replies(expected_replies)
+{
+	start([factory, framing](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.framing = framing;
+		return factory(callbacks, options);
+	});
+}
+
+FramedTestClient::~FramedTestClient()
+{
+	stop();
+}
+
+void FramedTestClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	for (const auto& message : _messages)
+		if (!send_message(*connection, _framing, message))
+			break;
+}
+
+void FramedTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void* data, size_t size)
+{
+	ASSERT_LT(_replies, _messages.size());
+	const auto& message = _messages[_replies++];
+	ASSERT_EQ(size, message.size());
+	EXPECT_TRUE(std::equal(message.begin(), message.end(), static_cast<const uint8_t*>(data)));
+}
+
+void FramedTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	EXPECT_EQ(_replies, _expected_replies);
+}
+
+FramedTestServer::FramedTestServer(const Factory& factory, const std::vector<std::vector<uint8_t>>& messages, const ynet::Server::Options& options, size_t expected_messages)
+	: _messages(messages)
+	, _framing(options.framing)
+	, _expected_messages(expected_messages)
+{
+	start(factory, options);
+}
+
+FramedTestServer::~FramedTestServer()
+{
+	stop();
+}
+
+void FramedTestServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+	ASSERT_EQ(_received, 0);
+}
+
+void FramedTestServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	ASSERT_LT(_received, _messages.size());
+	const auto& message = _messages[_received++];
+	ASSERT_EQ(size, message.size());
+	EXPECT_TRUE(std::equal(message.begin(), message.end(), static_cast<const uint8_t*>(data)));
+	EXPECT_TRUE(send_message(*connection, _framing, message));
+	if (_received == _expected_messages)
+		connection->shutdown();
+}
+
+void FramedTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+	EXPECT_EQ(_received, _expected_messages);
+}
+
+std::vector<std::vector<uint8_t>> make_test_messages()
+{
+	std::vector<std::vector<uint8_t>> messages;
+	for (const size_t size : {0, 1, 127, 128, 300, 100000, 0, 16383, 16384, 1})
+		messages.emplace_back(make_random_buffer(size));
+	// Many small messages are received by a single read.
+	for (size_t i = 0; i < 1000; ++i)
+		messages.emplace_back(make_random_buffer(i % 32));
+	messages.emplace_back(make_random_buffer(200000));
+	return messages;
+}
+
+std::vector<std::vector<uint8_t>> make_seqpacket_test_messages()
+{
+	auto messages = make_test_messages();
+	messages.erase(std::remove_if(messages.begin(), messages.end(), [](const auto& message){ return message.empty(); }), messages.end());
+	return messages;
+}
+
+BatchTestServer::BatchTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, ynet::Server::Options options)
+	: _buffer(buffer)
+{
+	options.batch_received = true;
+	start(factory, options);
+}
+
+BatchTestServer::~BatchTestServer()
+{
+	stop();
+}
+
+void BatchTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_TRUE(_received.emplace(connection.get(), std::vector<uint8_t>()).second);
+}
+
+void BatchTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void BatchTestServer::on_received_batch(const ynet::Server::Received* received, size_t count)
+{
+	ASSERT_GT(count, 0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& item = received[i];
+		auto& connection_received = _received[item.connection.get()];
+		connection_received.insert(connection_received.end(), static_cast<const uint8_t*>(item.data), static_cast<const uint8_t*>(item.data) + item.size);
+		ASSERT_LE(connection_received.size(), _buffer.size());
+		if (connection_received.size() == _buffer.size())
+			item.connection->shutdown();
+	}
+}
+
+void BatchTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	const auto i = _received.find(connection.get());
+	ASSERT_NE(i, _received.end());
+	EXPECT_EQ(i->second, _buffer);
+	_received.erase(i);
+}
+
+ThreadsTestServer::ThreadsTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, unsigned threads, bool reuse_port)
+	: _buffer(buffer)
+{
+	ynet::Server::Options options;
+	options.io_threads = threads;
+	options.reuse_port = reuse_port;
+	start(factory, options);
+}
+
+ThreadsTestServer::~ThreadsTestServer()
+{
+	stop();
+}
+
+size_t ThreadsTestServer::threads_used()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _threads.size();
+}
+
+void ThreadsTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_connections[connection.get()].thread = std::this_thread::get_id();
+	_threads.emplace(std::this_thread::get_id());
+}
+
+void ThreadsTestServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto& state = _connections[connection.get()];
+	EXPECT_EQ(state.thread, std::this_thread::get_id());
+	ASSERT_GE(_buffer.size() - state.received_size, size);
+	EXPECT_EQ(::memcmp(&_buffer[state.received_size], data, size), 0);
+	state.received_size += size;
+	if (state.received_size == _buffer.size())
+		connection->shutdown();
+}
+
+void ThreadsTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const auto i = _connections.find(connection.get());
+	ASSERT_NE(i, _connections.end());
+	EXPECT_EQ(i->second.thread, std::this_thread::get_id());
+	EXPECT_EQ(i->second.received_size, _buffer.size());
+	_connections.erase(i);
+}
+
+IdleTestServer::IdleTestServer(const Factory& factory, std::chrono::milliseconds timeout, const ynet::Server::Options& options)
+	: _timeout(timeout)
+{
+	start(factory, options);
+}
+
+IdleTestServer::~IdleTestServer()
+{
+	stop();
+}
+
+void IdleTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	_connected = std::chrono::steady_clock::now();
+	connection->set_idle_timeout(static_cast<int>(_timeout.count()));
+}
+
+void IdleTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void IdleTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+	EXPECT_GE(std::chrono::steady_clock::now() - _connected, _timeout);
+}
+
+ScheduleTestServer::ScheduleTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds delay, const ynet::Server::Options& options)
+	: _buffer(buffer)
+	, _delay(delay)
+{
+	start(factory, options);
+}
+
+ScheduleTestServer::~ScheduleTestServer()
+{
+	// The scheduled functions shouldn't access the server while it is being destroyed.
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_sent_condition.wait(lock, [this]() { return _sent; });
+	}
+	stop();
+}
+
+void ScheduleTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	const auto step = static_cast<int>(_delay.count() / 2);
+	const auto scheduled = std::chrono::steady_clock::now();
+	EXPECT_TRUE(server().schedule(step, [this, connection, step, scheduled]
+	{
+		EXPECT_TRUE(server().schedule(step, [this, connection, scheduled]
+		{
+			EXPECT_GE(std::chrono::steady_clock::now() - scheduled, _delay);
+			EXPECT_TRUE(connection->send(_buffer.data(), _buffer.size()));
+			connection->shutdown();
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_sent = true;
+			}
+			_sent_condition.notify_one();
+		}));
+	}));
+}
+
+void ScheduleTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void ScheduleTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+FloodTestClient::FloodTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+	: _buffer(buffer)
+{
+	start(factory);
+}
+
+FloodTestClient::~FloodTestClient()
+{
+	stop();
+}
+
+void FloodTestClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	while (connection->send(_buffer.data(), _buffer.size()))
+		;
+}
+
+void FloodTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void FloodTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+}
+
+ShutdownTestServer::ShutdownTestServer(const Factory& factory, int shutdown_timeout, const ynet::Server::Options& options)
+{
+	start(factory, options, shutdown_timeout);
+}
+
+ShutdownTestServer::~ShutdownTestServer()
+{
+	stop();
+}
+
+void ShutdownTestServer::wait_received()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_received_condition.wait(lock, [this]() { return _received; });
+}
+
+void ShutdownTestServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void ShutdownTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_received = true;
+	}
+	_received_condition.notify_one();
+}
+
+void ShutdownTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+AddressTestServer::AddressTestServer(const Factory& factory, ynet::Connection::Endpoint::Family family, const ynet::Server::Options& options)
+	: _family(family)
+{
+	start(factory, options);
+}
+
+AddressTestServer::~AddressTestServer()
+{
+	stop();
+}
+
+void AddressTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	const auto endpoint = connection->endpoint();
+	EXPECT_EQ(endpoint.family, _family);
+	EXPECT_NE(endpoint.port, 0);
+	const auto& address = connection->address();
+	EXPECT_EQ(&address, &connection->address());
+	EXPECT_TRUE(connection->send(address.data(), address.size()));
+	connection->shutdown();
+}
+
+void AddressTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void AddressTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+RelayTestClient::RelayTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+	: _buffer(buffer)
+	, _received(buffer.size())
+{
+	start(factory);
+}
+
+RelayTestClient::~RelayTestClient()
+{
+	stop();
+}
+
+void RelayTestClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	send_more(*connection);
+}
+
+void RelayTestClient::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	const auto remaining_size = _received.size() - _received_size;
+	ASSERT_GE(remaining_size, size);
+	::memcpy(&_received[_received_size], static_cast<const uint8_t*>(data), size);
+	_received_size += size;
+	send_more(*connection);
+	// The peer has received all our data before sending its last chunk.
+	if (_received_size == _received.size())
+		connection->shutdown();
+}
+
+void RelayTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	EXPECT_EQ(_received, _buffer);
+}
+
+void RelayTestClient::send_more(ynet::Connection& connection)
+{
+	// Several chunks are sent ahead, but not enough to fill the socket buffers.
+	const size_t chunk_size = 4096;
+	const size_t window_size = 16 * chunk_size;
+	const auto end = std::min(_received_size + window_size, _buffer.size());
+	while (_sent_size < end)
+	{
+		const auto size = std::min(chunk_size, end - _sent_size);
+		EXPECT_TRUE(connection.send(&_buffer[_sent_size], size));
+		_sent_size += size;
+	}
+}
+
+RelayTestServer::RelayTestServer(const Factory& factory, const ynet::Server::Options& options)
+{
+	start(factory, options);
+}
+
+RelayTestServer::~RelayTestServer()
+{
+	stop();
+}
+
+void RelayTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_unpaired)
+	{
+		_unpaired = connection;
+		return;
+	}
+	_peers.emplace(connection.get(), _unpaired);
+	_peers.emplace(_unpaired.get(), connection);
+	// The data is sent before any data received from the peer later.
+	if (!_unpaired_data.empty())
+	{
+		EXPECT_TRUE(connection->send(_unpaired_data.data(), _unpaired_data.size()));
+	}
+	_unpaired.reset();
+	_unpaired_data.clear();
+}
+
+void RelayTestServer::on_received(const std::shared_ptr<ynet::Connection>& connection, const void* data, size_t size)
+{
+	std::shared_ptr<ynet::Connection> peer;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const auto i = _peers.find(connection.get());
+		if (i == _peers.end())
+		{
+			ASSERT_EQ(connection, _unpaired);
+			_unpaired_data.insert(_unpaired_data.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+			return;
+		}
+		peer = i->second;
+	}
+	EXPECT_TRUE(peer->send(data, size));
+}
+
+void RelayTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_peers.erase(connection.get());
+}
+
+namespace
+{
+	const size_t DescriptorParts = 16;
+}
+
+bool send_with_descriptors(ynet::Connection& connection, const std::vector<uint8_t>& buffer)
+{
+	const auto part_size = buffer.size() / DescriptorParts;
+	for (size_t i = 0; i < DescriptorParts; ++i)
+	{
+		const auto part = &buffer[i * part_size];
+		const auto file = ::memfd_create("ynet-tests", MFD_CLOEXEC);
+		EXPECT_NE(file, -1);
+		EXPECT_EQ(::write(file, part, part_size), static_cast<ssize_t>(part_size));
+		const auto sent = connection.send_descriptors(part, part_size, &file, 1);
+		::close(file);
+		if (!sent)
+			return false;
+	}
+	return true;
+}
+
+void DescriptorReceiver::on_descriptors(const int* descriptors, size_t count)
+{
+	ASSERT_EQ(count, 1);
+	const auto part_size = _buffer.size() / DescriptorParts;
+	// The descriptors come with the data of their part, which may follow the data of the preceding part.
+	const auto offset = _files * part_size;
+	EXPECT_LE(_received_size, offset);
+	if (_files > 0)
+	{
+		EXPECT_GT(_received_size, offset - part_size);
+	}
+	std::vector<uint8_t> contents(part_size + 1);
+	EXPECT_EQ(::pread(descriptors[0], contents.data(), contents.size(), 0), static_cast<ssize_t>(part_size));
+	EXPECT_TRUE(std::equal(&_buffer[offset], &_buffer[offset] + part_size, contents.begin()));
+	::close(descriptors[0]);
+	++_files;
+}
+
+void DescriptorReceiver::on_data(const void* data, size_t size)
+{
+	const auto remaining_size = _received.size() - _received_size;
+	ASSERT_GE(remaining_size, size);
+	::memcpy(&_received[_received_size], data, size);
+	_received_size += size;
+}
+
+void DescriptorReceiver::check() const
+{
+	EXPECT_EQ(_received, _buffer);
+	EXPECT_EQ(_files, DescriptorParts);
+}
+
+DescriptorTestClient::DescriptorTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds receive_delay)
+	: _receive_delay(receive_delay)
+	, _receiver(buffer)
+{
+	start(factory);
+}
+
+DescriptorTestClient::~DescriptorTestClient()
+{
+	stop();
+}
+
+void DescriptorTestClient::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+	std::this_thread::sleep_for(_receive_delay);
+}
+
+void DescriptorTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void* data, size_t size)
+{
+	_receiver.on_data(data, size);
+}
+
+void DescriptorTestClient::on_received_descriptors(const std::shared_ptr<ynet::Connection>&, const int* descriptors, size_t count)
+{
+	_receiver.on_descriptors(descriptors, count);
+}
+
+void DescriptorTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	_receiver.check();
+}
+
+DescriptorTestServer::DescriptorTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options)
+	: _buffer(buffer)
+{
+	start(factory, options);
+}
+
+DescriptorTestServer::~DescriptorTestServer()
+{
+	stop();
+}
+
+void DescriptorTestServer::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_TRUE(send_with_descriptors(*connection, _buffer));
+	connection->shutdown();
+}
+
+void DescriptorTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void DescriptorTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+DescriptorSendTestClient::DescriptorSendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer)
+	: _buffer(buffer)
+{
+	start(factory);
+}
+
+DescriptorSendTestClient::~DescriptorSendTestClient()
+{
+	stop();
+}
+
+void DescriptorSendTestClient::on_connected(const std::shared_ptr<ynet::Connection>& connection)
+{
+	EXPECT_TRUE(send_with_descriptors(*connection, _buffer));
+	connection->shutdown();
+}
+
+void DescriptorSendTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void DescriptorSendTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+}
+
+DescriptorReceiveTestServer::DescriptorReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& options)
+	: _receiver(buffer)
+{
+	start(factory, options);
+}
+
+DescriptorReceiveTestServer::~DescriptorReceiveTestServer()
+{
+	stop();
+}
+
+void DescriptorReceiveTestServer::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+}
+
+void DescriptorReceiveTestServer::on_received(const std::shared_ptr<ynet::Connection>&, const void* data, size_t size)
+{
+	_receiver.on_data(data, size);
+}
+
+void DescriptorReceiveTestServer::on_received_descriptors(const std::shared_ptr<ynet::Connection>&, const int* descriptors, size_t count)
+{
+	_receiver.on_descriptors(descriptors, count);
+}
+
+void DescriptorReceiveTestServer::on_disconnected(const std::shared_ptr<ynet::Connection>&)
+{
+	_receiver.check();
+}
+
+StalledTcpListener::StalledTcpListener(uint16_t port)
+{
+	::sockaddr_in sockaddr = {};
+	sockaddr.sin_family = AF_INET;
+	sockaddr.sin_port = htons(port);
+	sockaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	_listener = ::socket(AF_INET, SOCK_STREAM, 0);
+	const int reuse = 1;
+	::setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse);
+	EXPECT_EQ(::bind(_listener, reinterpret_cast<const ::sockaddr*>(&sockaddr), sizeof sockaddr), 0);
+	// Linux keeps one more connection than the backlog in the accept queue.
+	EXPECT_EQ(::listen(_listener, 0), 0);
+	_client = ::socket(AF_INET, SOCK_STREAM, 0);
+	EXPECT_EQ(::connect(_client, reinterpret_cast<const ::sockaddr*>(&sockaddr), sizeof sockaddr), 0);
+}
+
+StalledTcpListener::~StalledTcpListener()
+{
+	::close(_client);
+	::close(_listener);
+}
+
+FailedConnectTestClient::FailedConnectTestClient(const TestClient::Factory& factory, const ynet::Client::Options& options)
+	: _start_time(std::chrono::steady_clock::now())
+	, _client(factory(*this, options))
+{
+}
+
+FailedConnectTestClient::~FailedConnectTestClient()
+{
+	wait();
+}
+
+std::chrono::steady_clock::duration FailedConnectTestClient::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_stop_condition.wait(lock, [this]() { return _stopped; });
+	return _failure_time;
+}
+
+void FailedConnectTestClient::on_connected(const std::shared_ptr<ynet::Connection>&)
+{
+	ADD_FAILURE();
+}
+
+void FailedConnectTestClient::on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t)
+{
+	ADD_FAILURE();
+}
+
+void FailedConnectTestClient::on_disconnected(const std::shared_ptr<ynet::Connection>&, int&)
+{
+	ADD_FAILURE();
+}
+
+void FailedConnectTestClient::on_failed_to_connect(int&)
+{
+	_failure_time = std::chrono::steady_clock::now() - _start_time;
+}
+
+void FailedConnectTestClient::on_stopped()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopped = true;
+	}
+	_stop_condition.notify_one();
+}
+
+TestHostsFile::TestHostsFile(const std::string& contents)
+{
+	char path[] = "/tmp/ynet-hosts-XXXXXX";
+	const auto file = ::mkstemp(path);
+	EXPECT_NE(file, -1);
+	::close(file);
+	_path = path;
+	write(contents);
+}
+
+TestHostsFile::~TestHostsFile()
+{
+	::unlink(_path.c_str());
+}
+
+void TestHostsFile::write(const std::string& contents)
+{
+	std::ofstream(_path, std::ios::trunc) << contents;
+}
@@ -1,11 +1,34 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <gtest/gtest.h>
 
 #include <ynet.h>
 
+// Server options selecting the io_uring backend where it is supported.
+extern const ynet::Server::Options IoUringOptions;
+extern const ynet::Server::Options NonblockingOptions;
+
+// Server options enabling shared memory with rings small enough for the sides to wait for each other.
+extern const ynet::Server::Options SharedMemoryOptions;
+
+// Server options enabling receiving file descriptors.
+extern const ynet::Server::Options DescriptorOptions;
+
+// Server options enabling SOCK_SEQPACKET sockets with buffers large enough for the test messages.
+extern const ynet::Server::Options SeqpacketOptions;
+
+// Socket options differing from the defaults as much as possible.
+extern const ynet::SocketOptions CustomSocketOptions;
+
 class TestClient : public ynet::Client::Callbacks
 {
 public:
@@ -27,14 +50,30 @@ private:
 	std::unique_ptr<ynet::Client> _client;
 };
 
+// Makes the factory create clients served by the context.
+TestClient::Factory with_context(const TestClient::Factory&, ynet::ClientContext&, bool nonblocking_send = false);
+
+// Makes the factory create clients using the resolver.
+TestClient::Factory with_resolver(const TestClient::Factory&, ynet::Resolver&);
+
+// Makes the factory create clients using shared memory like the servers with SharedMemoryOptions.
+TestClient::Factory with_shared_memory(const TestClient::Factory&);
+
+// Makes the factory create clients receiving file descriptors like the servers with DescriptorOptions.
+TestClient::Factory with_descriptors(const TestClient::Factory&);
+
+// Makes the factory create clients using the socket options of SeqpacketOptions.
+TestClient::Factory with_seqpacket(const TestClient::Factory&);
+
 class TestServer : public ynet::Server::Callbacks
 {
 public:
 	using Factory = std::function<std::unique_ptr<ynet::Server>(ynet::Server::Callbacks&, const ynet::Server::Options&)>;
 
 protected:
-	void start(const Factory&);
+	void start(const Factory&, ynet::Server::Options = {}, int shutdown_timeout = -1);
 	void stop();
+	ynet::Server& server() const { return *_server; }
 
 private:
 	void on_failed_to_start(int&) final;
@@ -50,7 +89,8 @@ private:
 class SendTestClient : public TestClient
 {
 public:
-	SendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	// The buffer may be sent as several blocks using a single call.
+	SendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, size_t blocks = 1);
 	~SendTestClient() override;
 
 private:
@@ -60,12 +100,13 @@ private:
 
 private:
 	const std::vector<uint8_t>& _buffer;
+	const size_t _blocks;
 };
 
 class SendTestServer : public TestServer
 {
 public:
-	SendTestServer(const Factory& factory, const std::vector<uint8_t>& buffer);
+	SendTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = {});
 	~SendTestServer() override;
 
 private:
@@ -75,6 +116,7 @@ private:
 
 private:
 	const std::vector<uint8_t>& _buffer;
+	const size_t _receive_buffer_size;
 	std::vector<uint8_t> _received;
 	size_t _received_size = 0;
 };
@@ -82,7 +124,8 @@ private:
 class ReceiveTestClient : public TestClient
 {
 public:
-	ReceiveTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	// The client may delay receiving to let the server send queue grow.
+	ReceiveTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds receive_delay = {});
 	~ReceiveTestClient() override;
 
 private:
@@ -92,6 +135,7 @@ private:
 
 private:
 	const std::vector<uint8_t>& _buffer;
+	const std::chrono::milliseconds _receive_delay;
 	std::vector<uint8_t> _received;
 	size_t _received_size = 0;
 };
@@ -99,7 +143,7 @@ private:
 class ReceiveTestServer : public TestServer
 {
 public:
-	ReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer);
+	ReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = {}, size_t blocks = 1);
 	~ReceiveTestServer() override;
 
 private:
@@ -109,4 +153,479 @@ private:
 
 private:
 	const std::vector<uint8_t>& _buffer;
+	const size_t _blocks;
+};
+
+// Broadcasts the buffer to the clients once all of them have connected.
+class BroadcastTestServer : public TestServer
+{
+public:
+	BroadcastTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, size_t clients, const ynet::Server::Options& = {});
+	~BroadcastTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::shared_ptr<const std::vector<uint8_t>> _buffer;
+	const size_t _clients;
+	std::mutex _mutex;
+	std::vector<std::shared_ptr<ynet::Connection>> _connections;
+};
+
+class BackpressureTestServer : public TestServer
+{
+public:
+	BackpressureTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, ynet::Server::Options = {});
+	~BackpressureTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_send_buffer_full(const std::shared_ptr<ynet::Connection>&) override;
+	void on_writable(const std::shared_ptr<ynet::Connection>&) override;
+
+	void send_more(const std::shared_ptr<ynet::Connection>&);
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	size_t _sent_size = 0;
+	bool _full = false;
+	size_t _full_count = 0;
+};
+
+class ZerocopyTestServer : public TestServer
+{
+public:
+	ZerocopyTestServer(const Factory& factory, const std::vector<uint8_t>& buffer);
+	~ZerocopyTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_zerocopy_completed(const std::shared_ptr<ynet::Connection>&, const std::shared_ptr<const void>&) override;
+
+private:
+	const size_t _size;
+	std::shared_ptr<const void> _data;
+	size_t _completed = 0;
+};
+
+class FileTestServer : public TestServer
+{
+public:
+	// The middle of the buffer is sent from a file, the rest is sent as regular blocks.
+	FileTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = {});
+	~FileTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	std::FILE* const _file;
+};
+
+// Retains the received data, checking it when the client disconnects.
+class RetainTestClient : public TestClient
+{
+public:
+	RetainTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	~RetainTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	std::vector<std::pair<std::shared_ptr<const void>, size_t>> _retained;
+};
+
+// Passes the received data to a worker thread without copying it,
+// the worker checking it when the connection is closed.
+class RetainTestServer : public TestServer
+{
+public:
+	RetainTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = {});
+	~RetainTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+	void run_worker();
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	size_t _received_size = 0;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::vector<std::pair<std::shared_ptr<const void>, size_t>> _queue;
+	bool _done = false;
+	std::thread _worker;
+};
+
+// Sends the messages using the specified framing, expecting them to be echoed back.
+class FramedTestClient : public TestClient
+{
+public:
+	FramedTestClient(const Factory& factory, const std::vector<std::vector<uint8_t>>& messages, ynet::Framing, size_t expected_replies);
+	~FramedTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+private:
+	const std::vector<std::vector<uint8_t>>& _messages;
+	const ynet::Framing _framing;
+	const size_t _expected_replies;
+	size_t _replies = 0;
+};
+
+// Echoes the received messages, closing the connection when all of them are received.
+class FramedTestServer : public TestServer
+{
+public:
+	FramedTestServer(const Factory& factory, const std::vector<std::vector<uint8_t>>& messages, const ynet::Server::Options&, size_t expected_messages);
+	~FramedTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::vector<std::vector<uint8_t>>& _messages;
+	const ynet::Framing _framing;
+	const size_t _expected_messages;
+	size_t _received = 0;
+};
+
+// Messages of various sizes, including empty ones and ones larger than the default receive buffer.
+std::vector<std::vector<uint8_t>> make_test_messages();
+
+// Test messages without the empty ones, which SOCK_SEQPACKET sockets don't send.
+std::vector<std::vector<uint8_t>> make_seqpacket_test_messages();
+
+// Receives the data from several connections in batches.
+class BatchTestServer : public TestServer
+{
+public:
+	BatchTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, ynet::Server::Options = {});
+	~BatchTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_received_batch(const ynet::Server::Received*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	std::unordered_map<const ynet::Connection*, std::vector<uint8_t>> _received;
+};
+
+class ThreadsTestServer : public TestServer
+{
+public:
+	ThreadsTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, unsigned threads, bool reuse_port = false);
+	~ThreadsTestServer() override;
+
+	size_t threads_used();
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	struct ConnectionState
+	{
+		std::thread::id thread;
+		size_t received_size = 0;
+	};
+
+	const std::vector<uint8_t>& _buffer;
+	size_t _received_size = 0;
+	std::mutex _mutex;
+	std::unordered_map<const ynet::Connection*, ConnectionState> _connections;
+	std::unordered_set<std::thread::id> _threads;
+};
+
+// Expects the connections to be aborted once they have been idle for the specified time.
+class IdleTestServer : public TestServer
+{
+public:
+	IdleTestServer(const Factory& factory, std::chrono::milliseconds timeout, const ynet::Server::Options& = {});
+	~IdleTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::chrono::milliseconds _timeout;
+	std::chrono::steady_clock::time_point _connected;
+};
+
+// Sends the buffer to each connection after the delay, scheduling the send in two steps.
+class ScheduleTestServer : public TestServer
+{
+public:
+	ScheduleTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds delay, const ynet::Server::Options& = {});
+	~ScheduleTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	const std::chrono::milliseconds _delay;
+	std::mutex _mutex;
+	bool _sent = false;
+	std::condition_variable _sent_condition;
+};
+
+// Sends the buffer until the connection fails, ignoring a graceful shutdown.
+class FloodTestClient : public TestClient
+{
+public:
+	FloodTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	~FloodTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+};
+
+class ShutdownTestServer : public TestServer
+{
+public:
+	ShutdownTestServer(const Factory& factory, int shutdown_timeout, const ynet::Server::Options& = {});
+	~ShutdownTestServer() override;
+
+	// Waits until the server receives any data.
+	void wait_received();
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	std::mutex _mutex;
+	bool _received = false;
+	std::condition_variable _received_condition;
+};
+
+// Sends the peer address to the client, expecting it to be of the specified family.
+class AddressTestServer : public TestServer
+{
+public:
+	AddressTestServer(const Factory& factory, ynet::Connection::Endpoint::Family, const ynet::Server::Options& = {});
+	~AddressTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const ynet::Connection::Endpoint::Family _family;
+};
+
+// Sends the buffer in chunks, keeping a limited amount of data ahead of the data received from the peer,
+// so the server relays the data of both peers at the same time.
+class RelayTestClient : public TestClient
+{
+public:
+	RelayTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	~RelayTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+	void send_more(ynet::Connection&);
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	std::vector<uint8_t> _received;
+	size_t _received_size = 0;
+	size_t _sent_size = 0;
+};
+
+// Pairs the connections in the order they are made, sending the data received from each one to its peer.
+// With several threads, the peers are usually served by different ones.
+class RelayTestServer : public TestServer
+{
+public:
+	RelayTestServer(const Factory& factory, const ynet::Server::Options& = {});
+	~RelayTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	std::mutex _mutex;
+	std::shared_ptr<ynet::Connection> _unpaired;
+	std::vector<uint8_t> _unpaired_data; // Received before the peer has connected.
+	std::unordered_map<const ynet::Connection*, std::shared_ptr<ynet::Connection>> _peers;
+};
+
+// Sends the buffer in parts, attaching to each one a memory file with a copy of the part.
+bool send_with_descriptors(ynet::Connection&, const std::vector<uint8_t>& buffer);
+
+// Checks the data and the memory files sent by send_with_descriptors.
+class DescriptorReceiver
+{
+public:
+	explicit DescriptorReceiver(const std::vector<uint8_t>& buffer) : _buffer(buffer), _received(buffer.size()) {}
+
+	void on_descriptors(const int*, size_t);
+	void on_data(const void*, size_t);
+	void check() const;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+	std::vector<uint8_t> _received;
+	size_t _received_size = 0;
+	size_t _files = 0;
+};
+
+class DescriptorTestClient : public TestClient
+{
+public:
+	// The client may delay receiving to let the server send queue grow.
+	DescriptorTestClient(const Factory& factory, const std::vector<uint8_t>& buffer, std::chrono::milliseconds receive_delay = {});
+	~DescriptorTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_received_descriptors(const std::shared_ptr<ynet::Connection>&, const int*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+private:
+	const std::chrono::milliseconds _receive_delay;
+	DescriptorReceiver _receiver;
+};
+
+class DescriptorTestServer : public TestServer
+{
+public:
+	DescriptorTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = {});
+	~DescriptorTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+};
+
+class DescriptorSendTestClient : public TestClient
+{
+public:
+	DescriptorSendTestClient(const Factory& factory, const std::vector<uint8_t>& buffer);
+	~DescriptorSendTestClient() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+
+private:
+	const std::vector<uint8_t>& _buffer;
+};
+
+class DescriptorReceiveTestServer : public TestServer
+{
+public:
+	DescriptorReceiveTestServer(const Factory& factory, const std::vector<uint8_t>& buffer, const ynet::Server::Options& = DescriptorOptions);
+	~DescriptorReceiveTestServer() override;
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_received_descriptors(const std::shared_ptr<ynet::Connection>&, const int*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&) override;
+
+private:
+	DescriptorReceiver _receiver;
+};
+
+// Listening TCP socket with a full backlog, so that connection attempts to it hang.
+class StalledTcpListener
+{
+public:
+	explicit StalledTcpListener(uint16_t port);
+	~StalledTcpListener();
+
+private:
+	int _listener = -1;
+	int _client = -1;
+};
+
+// Expects the client to fail to connect.
+class FailedConnectTestClient : public ynet::Client::Callbacks
+{
+public:
+	FailedConnectTestClient(const TestClient::Factory&, const ynet::Client::Options& = {});
+	~FailedConnectTestClient() override;
+
+	// Waits for the client to stop, returning the time it took to fail.
+	std::chrono::steady_clock::duration wait();
+
+private:
+	void on_connected(const std::shared_ptr<ynet::Connection>&) override;
+	void on_received(const std::shared_ptr<ynet::Connection>&, const void*, size_t) override;
+	void on_disconnected(const std::shared_ptr<ynet::Connection>&, int&) override;
+	void on_failed_to_connect(int&) override;
+	void on_stopped() override;
+
+private:
+	const std::chrono::steady_clock::time_point _start_time;
+	std::chrono::steady_clock::duration _failure_time{};
+	std::mutex _mutex;
+	bool _stopped = false;
+	std::condition_variable _stop_condition;
+	std::unique_ptr<ynet::Client> _client;
+};
+
+// Temporary file in the /etc/hosts format.
+class TestHostsFile
+{
+public:
+	explicit TestHostsFile(const std::string& contents);
+	~TestHostsFile();
+
+	const std::string& path() const { return _path; }
+	void write(const std::string& contents);
+
+private:
+	std::string _path;
 };
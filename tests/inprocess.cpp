@@ -0,0 +1,164 @@
+#include "common.h"
+#include "utils.h"
+
+using namespace std::placeholders;
+
+// This should be larger than the connection buffer size (currently 64K).
+const size_t BufferSize = 1024 * 1024;
+
+TEST(Inprocess, Send)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, Receive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, Threads)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer, 4);
+	{
+		std::vector<std::unique_ptr<SendTestClient>> clients;
+		for (int i = 0; i < 8; ++i)
+			clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer));
+	}
+	EXPECT_EQ(server.threads_used(), 4);
+}
+
+TEST(Inprocess, NonblockingReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer, NonblockingOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, Backpressure)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BackpressureTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Inprocess, VectoredSend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer, 100);
+}
+
+TEST(Inprocess, ZerocopyReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ZerocopyTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, FileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, ContextSend)
+{
+	// In-process clients ignore the context.
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(with_context(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), *context), buffer);
+}
+
+TEST(Inprocess, FailedConnect)
+{
+	// In-process names are separate from local ones.
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	FailedConnectTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2));
+	EXPECT_LT(client.wait(), std::chrono::seconds{1});
+	SendTestClient{std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer};
+}
+
+TEST(Inprocess, Framing)
+{
+	const auto& messages = make_test_messages();
+	// The replies are queued while the client is still sending.
+	auto options = NonblockingOptions;
+	options.framing = ynet::Framing::Varint;
+	FramedTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), messages, options, messages.size());
+	FramedTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), messages, ynet::Framing::Varint, messages.size());
+}
+
+TEST(Inprocess, FramingMessageTooLarge)
+{
+	const std::vector<std::vector<uint8_t>> messages{make_random_buffer(1001)};
+	ynet::Server::Options options;
+	options.framing = ynet::Framing::Varint;
+	options.max_message_size = 1000;
+	FramedTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), messages, options, 0);
+	FramedTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), messages, ynet::Framing::Varint, 0);
+}
+
+TEST(Inprocess, RetainReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	RetainTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, BatchReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BatchTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer);
+	std::vector<std::unique_ptr<SendTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer));
+}
+
+TEST(Inprocess, Broadcast)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = NonblockingOptions;
+	options.io_threads = 2;
+	BroadcastTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer, 8, options);
+	std::vector<std::unique_ptr<ReceiveTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<ReceiveTestClient>(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer));
+}
+
+TEST(Inprocess, IdleTimeout)
+{
+	const std::vector<uint8_t> nothing;
+	IdleTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), std::chrono::milliseconds{100});
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), nothing);
+}
+
+TEST(Inprocess, Schedule)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = NonblockingOptions;
+	options.io_threads = 2;
+	ScheduleTestServer server(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), buffer, std::chrono::milliseconds{100}, options);
+	ReceiveTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Inprocess, ShutdownTimeout)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto server = std::make_unique<ShutdownTestServer>(std::bind(ynet::Server::create_inprocess, _1, "ynet-tests", _2), 100);
+	FloodTestClient client(std::bind(ynet::Client::create_inprocess, _1, "ynet-tests", _2), buffer);
+	server->wait_received();
+	// The client ignores the graceful shutdown, so the server should abort the connection at the deadline.
+	const auto start_time = std::chrono::steady_clock::now();
+	server.reset();
+	const auto shutdown_time = std::chrono::steady_clock::now() - start_time;
+	EXPECT_GE(shutdown_time, std::chrono::milliseconds{100});
+	EXPECT_LT(shutdown_time, std::chrono::seconds{5});
+}
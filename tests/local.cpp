@@ -19,3 +19,231 @@ TEST(Local, Receive)
 	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
 	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
 }
+
+TEST(Local, Threads)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, 4);
+	{
+		std::vector<std::unique_ptr<SendTestClient>> clients;
+		for (int i = 0; i < 8; ++i)
+			clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer));
+	}
+	EXPECT_EQ(server.threads_used(), 4);
+}
+
+TEST(Local, ReusePort)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, 4, true);
+	std::vector<std::unique_ptr<SendTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer));
+}
+
+TEST(Local, IoUringSend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, IoUringOptions);
+	SendTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, IoUringReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, NonblockingReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, NonblockingOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, Backpressure)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BackpressureTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Local, VectoredSend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer, 100);
+}
+
+TEST(Local, ZerocopyReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ZerocopyTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, FileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, NonblockingFileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, NonblockingOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, SocketOptions)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ynet::Server::Options server_options;
+	server_options.listen_backlog = 1024;
+	server_options.socket = CustomSocketOptions;
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, server_options);
+	SendTestClient client([](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.socket = CustomSocketOptions;
+		return ynet::Client::create_local(callbacks, "ynet-tests", options);
+	}, buffer);
+}
+
+TEST(Local, ContextSend)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	SendTestClient client(with_context(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), *context), buffer);
+}
+
+TEST(Local, ContextReceive)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	ReceiveTestClient client(with_context(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), *context), buffer);
+}
+
+TEST(Local, Framing)
+{
+	const auto& messages = make_test_messages();
+	// The replies are queued while the client is still sending.
+	auto options = NonblockingOptions;
+	options.framing = ynet::Framing::Fixed32;
+	FramedTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), messages, options, messages.size());
+	FramedTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), messages, ynet::Framing::Fixed32, messages.size());
+}
+
+TEST(Local, RetainReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	RetainTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, SharedMemorySend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, SharedMemoryOptions);
+	SendTestClient client(with_shared_memory(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer, 100);
+}
+
+TEST(Local, SharedMemoryReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, SharedMemoryOptions);
+	ReceiveTestClient client(with_shared_memory(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer);
+}
+
+TEST(Local, SharedMemoryBackpressure)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BackpressureTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, SharedMemoryOptions);
+	ReceiveTestClient client(with_shared_memory(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Local, SharedMemoryFileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = SharedMemoryOptions;
+	options.nonblocking_send = true;
+	FileTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, options);
+	ReceiveTestClient client(with_shared_memory(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer);
+}
+
+TEST(Local, SharedMemoryContext)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& messages = make_test_messages();
+	// Both sides queue the data while waiting for the peer to read.
+	auto options = SharedMemoryOptions;
+	options.nonblocking_send = true;
+	options.framing = ynet::Framing::Fixed32;
+	FramedTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), messages, options, messages.size());
+	FramedTestClient client(with_shared_memory(with_context(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), *context, true)), messages, ynet::Framing::Fixed32, messages.size());
+}
+
+TEST(Local, Descriptors)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	DescriptorTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	DescriptorTestClient client(with_descriptors(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer);
+}
+
+TEST(Local, NonblockingDescriptors)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	// The descriptors are queued with the data while the client isn't receiving.
+	DescriptorTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer, NonblockingOptions);
+	DescriptorTestClient client(with_descriptors(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Local, ContextDescriptors)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	DescriptorTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	DescriptorTestClient client(with_descriptors(with_context(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), *context)), buffer);
+}
+
+TEST(Local, ReceiveDescriptors)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	DescriptorReceiveTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), buffer);
+	DescriptorSendTestClient client(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), buffer);
+}
+
+TEST(Local, Seqpacket)
+{
+	const auto& messages = make_seqpacket_test_messages();
+	// The replies are queued while the client is still sending.
+	auto options = SeqpacketOptions;
+	options.nonblocking_send = true;
+	FramedTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), messages, options, messages.size());
+	FramedTestClient client(with_seqpacket(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), messages, ynet::Framing::None, messages.size());
+}
+
+TEST(Local, SeqpacketContext)
+{
+	ynet::ClientContext::Options context_options;
+	context_options.receive_buffer_size = SeqpacketOptions.socket.receive_buffer_size;
+	const auto context = ynet::ClientContext::create(context_options);
+	const auto& messages = make_seqpacket_test_messages();
+	auto options = SeqpacketOptions;
+	options.nonblocking_send = true;
+	FramedTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), messages, options, messages.size());
+	FramedTestClient client(with_seqpacket(with_context(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2), *context, true)), messages, ynet::Framing::None, messages.size());
+}
+
+TEST(Local, SeqpacketTruncated)
+{
+	const std::vector<std::vector<uint8_t>> messages{make_random_buffer(1), make_random_buffer(100000)};
+	// The second message doesn't fit into the receive buffer, which aborts the connection.
+	auto options = SeqpacketOptions;
+	options.socket.receive_buffer_size = 64 * 1024;
+	FramedTestServer server(std::bind(ynet::Server::create_local, _1, "ynet-tests", _2), messages, options, 1);
+	FramedTestClient client(with_seqpacket(std::bind(ynet::Client::create_local, _1, "ynet-tests", _2)), messages, ynet::Framing::None, 1);
+}
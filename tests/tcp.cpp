@@ -19,3 +19,411 @@ TEST(Tcp, Receive)
 	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20001, _2), buffer);
 	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20001, _2), buffer);
 }
+
+TEST(Tcp, Threads)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_tcp, _1, 20002, _2), buffer, 4);
+	{
+		std::vector<std::unique_ptr<SendTestClient>> clients;
+		for (int i = 0; i < 8; ++i)
+			clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20002, _2), buffer));
+	}
+	EXPECT_EQ(server.threads_used(), 4);
+}
+
+TEST(Tcp, ReusePort)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_tcp, _1, 20003, _2), buffer, 4, true);
+	std::vector<std::unique_ptr<SendTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20003, _2), buffer));
+}
+
+TEST(Tcp, IoUringSend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_tcp, _1, 20004, _2), buffer, IoUringOptions);
+	SendTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20004, _2), buffer);
+}
+
+TEST(Tcp, IoUringReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20005, _2), buffer, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20005, _2), buffer);
+}
+
+TEST(Tcp, NonblockingReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20006, _2), buffer, NonblockingOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20006, _2), buffer);
+}
+
+TEST(Tcp, Backpressure)
+{
+	// TCP socket buffers can hold several megabytes.
+	const auto& buffer = make_random_buffer(16 * BufferSize);
+	BackpressureTestServer server(std::bind(ynet::Server::create_tcp, _1, 20007, _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20007, _2), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Tcp, IoUringBackpressure)
+{
+	// TCP socket buffers can hold several megabytes.
+	const auto& buffer = make_random_buffer(16 * BufferSize);
+	BackpressureTestServer server(std::bind(ynet::Server::create_tcp, _1, 20008, _2), buffer, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20008, _2), buffer, std::chrono::milliseconds{100});
+}
+
+TEST(Tcp, VectoredSend)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_tcp, _1, 20009, _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20009, _2), buffer, 100);
+}
+
+TEST(Tcp, VectoredNonblockingReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20010, _2), buffer, NonblockingOptions, 100);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20010, _2), buffer);
+}
+
+TEST(Tcp, ZerocopyReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ZerocopyTestServer server(std::bind(ynet::Server::create_tcp, _1, 20011, _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20011, _2), buffer);
+}
+
+TEST(Tcp, FileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_tcp, _1, 20012, _2), buffer);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20012, _2), buffer);
+}
+
+TEST(Tcp, NonblockingFileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_tcp, _1, 20013, _2), buffer, NonblockingOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20013, _2), buffer);
+}
+
+TEST(Tcp, IoUringFileReceive)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	FileTestServer server(std::bind(ynet::Server::create_tcp, _1, 20014, _2), buffer, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20014, _2), buffer);
+}
+
+TEST(Tcp, SocketOptions)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ynet::Server::Options server_options;
+	server_options.listen_backlog = 1024;
+	server_options.socket = CustomSocketOptions;
+	SendTestServer server(std::bind(ynet::Server::create_tcp, _1, 20015, _2), buffer, server_options);
+	SendTestClient client([](ynet::Client::Callbacks& callbacks, ynet::Client::Options options)
+	{
+		options.socket = CustomSocketOptions;
+		return ynet::Client::create_tcp(callbacks, "localhost", 20015, options);
+	}, buffer);
+}
+
+TEST(Tcp, ContextSend)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_tcp, _1, 20016, _2), buffer);
+	SendTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20016, _2), *context), buffer);
+}
+
+TEST(Tcp, ContextNonblockingSend)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	SendTestServer server(std::bind(ynet::Server::create_tcp, _1, 20017, _2), buffer);
+	SendTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20017, _2), *context, true), buffer, 16);
+}
+
+TEST(Tcp, ContextReceive)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20018, _2), buffer);
+	ReceiveTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20018, _2), *context), buffer);
+}
+
+TEST(Tcp, ContextThreads)
+{
+	ynet::ClientContext::Options context_options;
+	context_options.threads = 2;
+	const auto context = ynet::ClientContext::create(context_options);
+	const auto& buffer = make_random_buffer(BufferSize);
+	ThreadsTestServer server(std::bind(ynet::Server::create_tcp, _1, 20019, _2), buffer, 4);
+	{
+		std::vector<std::unique_ptr<SendTestClient>> clients;
+		for (int i = 0; i < 8; ++i)
+			clients.emplace_back(std::make_unique<SendTestClient>(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20019, _2), *context), buffer));
+	}
+	EXPECT_EQ(server.threads_used(), 4);
+}
+
+TEST(Tcp, ConnectTimeout)
+{
+	StalledTcpListener listener(20020);
+	ynet::Client::Options options;
+	options.connect_timeout = 200;
+	FailedConnectTestClient client(std::bind(ynet::Client::create_tcp, _1, "127.0.0.1", 20020, _2), options);
+	const auto elapsed = client.wait();
+	EXPECT_GE(elapsed, std::chrono::milliseconds{200});
+	// The system connect timeout is much longer.
+	EXPECT_LT(elapsed, std::chrono::seconds{5});
+}
+
+TEST(Tcp, ContextConnectTimeout)
+{
+	const auto context = ynet::ClientContext::create();
+	StalledTcpListener listener(20021);
+	ynet::Client::Options options;
+	options.connect_timeout = 200;
+	FailedConnectTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "127.0.0.1", 20021, _2), *context), options);
+	const auto elapsed = client.wait();
+	EXPECT_GE(elapsed, std::chrono::milliseconds{200});
+	EXPECT_LT(elapsed, std::chrono::seconds{5});
+}
+
+TEST(Tcp, ResolverCache)
+{
+	TestHostsFile hosts_file("127.0.0.1 ynet-test ynet-test-alias\n");
+	ynet::Resolver::Options resolver_options;
+	resolver_options.hosts_file = hosts_file.path();
+	const auto resolver = ynet::Resolver::create(resolver_options);
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20022, _2), buffer);
+	ReceiveTestClient{with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20022, _2), *resolver), buffer};
+	ReceiveTestClient{with_context(with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test-alias", 20022, _2), *resolver), *context), buffer};
+	// The names are resolved from the cache.
+	hosts_file.write("");
+	ReceiveTestClient{with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test-alias", 20022, _2), *resolver), buffer};
+	ReceiveTestClient{with_context(with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20022, _2), *resolver), *context), buffer};
+}
+
+TEST(Tcp, ResolverNegativeCache)
+{
+	TestHostsFile hosts_file("");
+	ynet::Resolver::Options resolver_options;
+	resolver_options.hosts_file = hosts_file.path();
+	const auto resolver = ynet::Resolver::create(resolver_options);
+	resolver_options.negative_ttl = 0;
+	const auto uncaching_resolver = ynet::Resolver::create(resolver_options);
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20023, _2), buffer);
+	FailedConnectTestClient{with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20023, _2), *resolver)};
+	// The failure is cached.
+	hosts_file.write("127.0.0.1 ynet-test\n");
+	FailedConnectTestClient{with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20023, _2), *resolver)};
+	FailedConnectTestClient{with_context(with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20023, _2), *resolver), *context)};
+	ReceiveTestClient{with_context(with_resolver(std::bind(ynet::Client::create_tcp, _1, "ynet-test", 20023, _2), *uncaching_resolver), *context), buffer};
+}
+
+TEST(Tcp, Framing)
+{
+	const auto& messages = make_test_messages();
+	// The replies are queued while the client is still sending.
+	auto options = NonblockingOptions;
+	options.framing = ynet::Framing::Varint;
+	FramedTestServer server(std::bind(ynet::Server::create_tcp, _1, 20024, _2), messages, options, messages.size());
+	FramedTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20024, _2), messages, ynet::Framing::Varint, messages.size());
+}
+
+TEST(Tcp, IoUringFraming)
+{
+	const auto& messages = make_test_messages();
+	auto options = IoUringOptions;
+	options.nonblocking_send = true;
+	options.framing = ynet::Framing::Fixed32;
+	FramedTestServer server(std::bind(ynet::Server::create_tcp, _1, 20025, _2), messages, options, messages.size());
+	const auto context = ynet::ClientContext::create();
+	FramedTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20025, _2), *context), messages, ynet::Framing::Fixed32, messages.size());
+}
+
+TEST(Tcp, FramingMessageTooLarge)
+{
+	const std::vector<std::vector<uint8_t>> messages{make_random_buffer(1001)};
+	ynet::Server::Options options;
+	options.framing = ynet::Framing::Varint;
+	options.max_message_size = 1000;
+	// The server aborts the connection as soon as it receives the message size.
+	FramedTestServer server(std::bind(ynet::Server::create_tcp, _1, 20026, _2), messages, options, 0);
+	FramedTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20026, _2), messages, ynet::Framing::Varint, 0);
+}
+
+TEST(Tcp, RetainReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	RetainTestServer server(std::bind(ynet::Server::create_tcp, _1, 20027, _2), buffer);
+	SendTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20027, _2), buffer);
+}
+
+TEST(Tcp, IoUringRetainReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	RetainTestServer server(std::bind(ynet::Server::create_tcp, _1, 20028, _2), buffer, IoUringOptions);
+	SendTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20028, _2), buffer);
+}
+
+TEST(Tcp, ContextRetainReceived)
+{
+	const auto context = ynet::ClientContext::create();
+	const auto& buffer = make_random_buffer(BufferSize);
+	ReceiveTestServer server(std::bind(ynet::Server::create_tcp, _1, 20029, _2), buffer);
+	RetainTestClient client(with_context(std::bind(ynet::Client::create_tcp, _1, "localhost", 20029, _2), *context), buffer);
+}
+
+TEST(Tcp, BatchReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BatchTestServer server(std::bind(ynet::Server::create_tcp, _1, 20030, _2), buffer);
+	std::vector<std::unique_ptr<SendTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20030, _2), buffer));
+}
+
+TEST(Tcp, IoUringBatchReceived)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BatchTestServer server(std::bind(ynet::Server::create_tcp, _1, 20031, _2), buffer, IoUringOptions);
+	std::vector<std::unique_ptr<SendTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<SendTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20031, _2), buffer));
+}
+
+TEST(Tcp, FramingBatchReceived)
+{
+	const auto& messages = make_test_messages();
+	auto options = NonblockingOptions;
+	options.framing = ynet::Framing::Varint;
+	options.batch_received = true;
+	// The default on_received_batch passes the messages to on_received.
+	FramedTestServer server(std::bind(ynet::Server::create_tcp, _1, 20032, _2), messages, options, messages.size());
+	FramedTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20032, _2), messages, ynet::Framing::Varint, messages.size());
+}
+
+TEST(Tcp, Broadcast)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = NonblockingOptions;
+	options.io_threads = 2;
+	BroadcastTestServer server(std::bind(ynet::Server::create_tcp, _1, 20033, _2), buffer, 8, options);
+	std::vector<std::unique_ptr<ReceiveTestClient>> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.emplace_back(std::make_unique<ReceiveTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20033, _2), buffer));
+}
+
+TEST(Tcp, BlockingBroadcast)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	BroadcastTestServer server(std::bind(ynet::Server::create_tcp, _1, 20034, _2), buffer, 4);
+	std::vector<std::unique_ptr<ReceiveTestClient>> clients;
+	for (int i = 0; i < 4; ++i)
+		clients.emplace_back(std::make_unique<ReceiveTestClient>(std::bind(ynet::Client::create_tcp, _1, "localhost", 20034, _2), buffer));
+}
+
+TEST(Tcp, IdleTimeout)
+{
+	const std::vector<uint8_t> nothing;
+	IdleTestServer server(std::bind(ynet::Server::create_tcp, _1, 20035, _2), std::chrono::milliseconds{100});
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20035, _2), nothing);
+}
+
+TEST(Tcp, IoUringIdleTimeout)
+{
+	const std::vector<uint8_t> nothing;
+	IdleTestServer server(std::bind(ynet::Server::create_tcp, _1, 20036, _2), std::chrono::milliseconds{100}, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20036, _2), nothing);
+}
+
+TEST(Tcp, Schedule)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = NonblockingOptions;
+	options.io_threads = 2;
+	ScheduleTestServer server(std::bind(ynet::Server::create_tcp, _1, 20037, _2), buffer, std::chrono::milliseconds{100}, options);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20037, _2), buffer);
+}
+
+TEST(Tcp, IoUringSchedule)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	ScheduleTestServer server(std::bind(ynet::Server::create_tcp, _1, 20038, _2), buffer, std::chrono::milliseconds{100}, IoUringOptions);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20038, _2), buffer);
+}
+
+TEST(Tcp, ShutdownTimeout)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto server = std::make_unique<ShutdownTestServer>(std::bind(ynet::Server::create_tcp, _1, 20039, _2), 100);
+	FloodTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20039, _2), buffer);
+	server->wait_received();
+	// The client ignores the graceful shutdown, so the server should abort the connection at the deadline.
+	const auto start_time = std::chrono::steady_clock::now();
+	server.reset();
+	const auto shutdown_time = std::chrono::steady_clock::now() - start_time;
+	EXPECT_GE(shutdown_time, std::chrono::milliseconds{100});
+	EXPECT_LT(shutdown_time, std::chrono::seconds{5});
+}
+
+TEST(Tcp, IoUringShutdownTimeout)
+{
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto server = std::make_unique<ShutdownTestServer>(std::bind(ynet::Server::create_tcp, _1, 20040, _2), 100, IoUringOptions);
+	FloodTestClient client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20040, _2), buffer);
+	server->wait_received();
+	const auto start_time = std::chrono::steady_clock::now();
+	server.reset();
+	const auto shutdown_time = std::chrono::steady_clock::now() - start_time;
+	EXPECT_GE(shutdown_time, std::chrono::milliseconds{100});
+	EXPECT_LT(shutdown_time, std::chrono::seconds{5});
+}
+
+TEST(Tcp, IoUringRelay)
+{
+	// Each thread sends data to a connection served by the other one.
+	const auto& buffer = make_random_buffer(BufferSize);
+	auto options = IoUringOptions;
+	options.io_threads = 2;
+	RelayTestServer server(std::bind(ynet::Server::create_tcp, _1, 20043, _2), options);
+	RelayTestClient first_client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20043, _2), buffer);
+	RelayTestClient second_client(std::bind(ynet::Client::create_tcp, _1, "localhost", 20043, _2), buffer);
+}
+
+TEST(Tcp, DualStack)
+{
+	const std::string ipv4 = "127.0.0.1";
+	const std::string ipv6 = "::1";
+	const std::vector<uint8_t> ipv4_buffer(ipv4.begin(), ipv4.end());
+	const std::vector<uint8_t> ipv6_buffer(ipv6.begin(), ipv6.end());
+	{
+		AddressTestServer server(std::bind(ynet::Server::create_tcp, _1, 20041, _2), ynet::Connection::Endpoint::Family::IPv4);
+		ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, ipv4, 20041, _2), ipv4_buffer);
+	}
+	{
+		AddressTestServer server(std::bind(ynet::Server::create_tcp, _1, 20041, _2), ynet::Connection::Endpoint::Family::IPv6, IoUringOptions);
+		ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, ipv6, 20041, _2), ipv6_buffer);
+	}
+}
+
+TEST(Tcp, BoundAddress)
+{
+	const std::string address = "::1";
+	const std::vector<uint8_t> buffer(address.begin(), address.end());
+	AddressTestServer server(std::bind(ynet::Server::create_tcp_bound, _1, address, 20042, _2), ynet::Connection::Endpoint::Family::IPv6);
+	ReceiveTestClient client(std::bind(ynet::Client::create_tcp, _1, address, 20042, _2), buffer);
+}